@@ -12,6 +12,7 @@
 #include <kernel/multitasking/tasks/task_small.h>
 #include <kernel/syscall/sysfuncs.h>
 #include <kernel/drivers/pit/pit.h>
+#include <kernel/drivers/serial/serial.h>
 
 #include <kernel/util/amc/amc.h>
 #include <kernel/util/amc/amc_internal.h>
@@ -54,6 +55,7 @@ void panic_with_regs(const char* msg, register_state_x86_64_t* regs) {
 
     // Error message
     snprintf(buf, sizeof(buf), "Critical error! %s\n", msg);
+    serial_puts_with_severity(buf, LOG_SEVERITY_ERROR);
     kernel_gfx_write_line_rendered_string(buf);
 
     if (regs) {
@@ -74,6 +76,8 @@ void panic_with_regs(const char* msg, register_state_x86_64_t* regs) {
         kernel_gfx_write_line_rendered_string(buf);
     }
 
+    // Log output is normally sent from an interrupt handler, which will never run again
+    serial_flush_synchronously();
     asm("hlt");
 }
 
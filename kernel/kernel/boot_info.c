@@ -142,7 +142,9 @@ static void multiboot_interpret_framebuffer(struct multiboot_info* mboot_data, b
     out_info->framebuffer.height = mboot_data->framebuffer_height;
     out_info->framebuffer.bits_per_pixel = mboot_data->framebuffer_bpp;
     out_info->framebuffer.bytes_per_pixel = (int)(out_info->framebuffer.bits_per_pixel / BITS_PER_BYTE);
-    out_info->framebuffer.size = out_info->framebuffer.width * out_info->framebuffer.height * out_info->framebuffer.bytes_per_pixel;
+    // Rows may be padded beyond the visible width
+    out_info->framebuffer.pixels_per_scanline = mboot_data->framebuffer_pitch / out_info->framebuffer.bytes_per_pixel;
+    out_info->framebuffer.size = mboot_data->framebuffer_pitch * out_info->framebuffer.height;
     printf("out_info framebuffer 0x%08x\n", out_info->framebuffer.address);
 }
 
@@ -8,6 +8,8 @@
 #include <std/printf.h>
 #include <kernel/boot_info.h>
 #include <kernel/util/amc/amc.h>
+#include <kernel/util/kernel_info/kernel_info.h>
+#include <kernel/util/profiler/profiler.h>
 
 //channel 0 used for generating IRQ0
 #define PIT_PORT_CHANNEL0 0x40
@@ -22,6 +24,8 @@ static volatile uintptr_t ms_timestamp = 0;
 
 static int tick_callback(register_state_t* regs) {
 	ms_timestamp += boot_info_get()->ms_per_pit_tick;
+	kernel_info_publish_clock(ms_timestamp, boot_info_get()->ms_per_pit_tick);
+	profiler_handle_timer_tick(regs);
 	// Wake sleeping services before sending EOI, or else we
 	// might get interrupted by another tick while the AMC spinlock is held
 	amc_wake_sleeping_services();
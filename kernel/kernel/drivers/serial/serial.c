@@ -1,7 +1,7 @@
 #include "serial.h"
 #include "kernel/drivers/pit/pit.h"
-#include "kernel/util/spinlock/spinlock.h"
 #include <kernel/smp.h>
+#include <kernel/interrupts/interrupts.h>
 
 // Ref: https://www.lookrs232.com/rs232/fcr.htm
 
@@ -20,12 +20,40 @@
 #define LINE_CONTROL_REGISTER (PORT + 3)
 #define MODEM_CONTROL_REGISTER (PORT + 4)
 
-#define BUF_SIZE (1028*8)
-static char buffer[BUF_SIZE] = {0};
-static int idx = 0;
+#define INTERRUPT_IDENTIFICATION_REGISTER (PORT + 2)
+#define LINE_STATUS_REGISTER (PORT + 5)
+
+// Interrupt when the transmit holding register is empty (so we know when we can send more)
+#define INTERRUPT_ENABLE_TRANSMITTER_EMPTY (1 << 1)
+// Set when the transmit FIFO is empty
+#define LINE_STATUS_TRANSMITTER_EMPTY (1 << 5)
+#define TRANSMIT_FIFO_SIZE 16
+
+// Log output is recorded in the kernel log ring, then drained to the port from here.
+// Until serial_enable_interrupts() is called, whoever logs drains the ring synchronously.
+// Afterwards, the port's transmitter-empty interrupt drains it one FIFO-full at a time,
+// and logging never waits on the port.
+static bool _interrupts_enabled = false;
+static bool _transmitter_interrupt_armed = false;
+
+// Set while a core is draining. Only ever claimed without waiting: a core that finds the
+// drain busy leaves its output to the owner, which re-checks for new output before giving up ownership.
+static bool _drain_active = false;
+static log_ring_cursor_t _drain_cursor = {0};
+static uint64_t _drain_reported_drop_count = 0;
+// The entry currently being sent, formatted for the port
+// Sized for the prefix plus the entry's text with every \n expanded to \r\n
+static char _drain_line[128 + (LOG_ENTRY_TEXT_SIZE * 2)];
+static uint32_t _drain_line_length = 0;
+static uint32_t _drain_line_offset = 0;
+// Set while the owner stages the next entry, along with the drain state from before it started.
+// If the owner is interrupted and the drain is taken over, the new owner rolls back and stages the entry again.
+static bool _drain_staging = false;
+static log_ring_cursor_t _drain_staging_cursor = {0};
+static uint64_t _drain_staging_reported_drop_count = 0;
 
 int serial_waiting() {
-	return inb(PORT + 5) & 1;
+	return inb(LINE_STATUS_REGISTER) & 1;
 }
 
 char serial_get() {
@@ -34,85 +62,162 @@ char serial_get() {
 }
 
 bool is_transmitting() {
-	return inb(PORT + 5) & 0x20;
+	return inb(LINE_STATUS_REGISTER) & LINE_STATUS_TRANSMITTER_EMPTY;
 }
 
-void __serial_putchar(char c) {
-	while (is_transmitting() == 0);
-	if (c == '\n') {
-        // Add an extra carriage return
-        outb(PORT, '\r');
-    }
-	outb(PORT, c);
+static bool _drain_has_pending_output(void) {
+	return _drain_line_offset < _drain_line_length || log_ring_has_unread(&_drain_cursor);
+}
+
+// Formats the next entry in the ring into the drain line
+// Returns false if the ring has been fully drained
+static bool _drain_stage_next_entry(void) {
+	_drain_staging_cursor = _drain_cursor;
+	_drain_staging_reported_drop_count = _drain_reported_drop_count;
+	__atomic_store_n(&_drain_staging, true, __ATOMIC_SEQ_CST);
+
+	log_entry_t entry;
+	if (log_ring_read(&_drain_cursor, &entry, 1) == 0) {
+		__atomic_store_n(&_drain_staging, false, __ATOMIC_SEQ_CST);
+		return false;
+	}
+
+	uint32_t length = 0;
+	uint64_t drop_count = _drain_cursor.dropped_count + log_ring_unattributed_drop_count();
+	if (drop_count != _drain_reported_drop_count) {
+		length += snprintf(_drain_line + length, sizeof(_drain_line) - length, "[%d log entries dropped]\r\n", drop_count - _drain_reported_drop_count);
+		_drain_reported_drop_count = drop_count;
+	}
+	if (entry.flags & LOG_ENTRY_FLAG_LINE_START) {
+		length += snprintf(_drain_line + length, sizeof(_drain_line) - length, "Cpu[%d],Pid[%d],Clk[%d]: ", entry.cpu, entry.pid, entry.timestamp_ms);
+	}
+	for (uint32_t i = 0; i < entry.length; i++) {
+		if (entry.text[i] == '\n') {
+			// Add an extra carriage return
+			_drain_line[length++] = '\r';
+		}
+		_drain_line[length++] = entry.text[i];
+	}
+	_drain_line_length = length;
+	_drain_line_offset = 0;
+	__atomic_store_n(&_drain_staging, false, __ATOMIC_SEQ_CST);
+	return true;
 }
 
-void __serial_writestring(char* str) {
-	char* ptr = str;
-	while (*ptr) {
-		__serial_putchar(*(ptr++));
+// Sends up to max_bytes of pending output. Must be called with the drain claimed.
+// If wait is set, spins until the port can accept each byte. Otherwise, the caller
+// has already seen that the transmit FIFO is empty.
+// Returns false if the ring has been fully drained
+static bool _drain_send(uint32_t max_bytes, bool wait) {
+	for (uint32_t i = 0; i < max_bytes; i++) {
+		if (_drain_line_offset == _drain_line_length && !_drain_stage_next_entry()) {
+			return false;
+		}
+		if (wait) {
+			while (!is_transmitting());
+		}
+		outb(DATA_REGISTER, _drain_line[_drain_line_offset++]);
 	}
+	return _drain_has_pending_output();
 }
 
-static void serial_flush() {
-	__serial_writestring(buffer);
-    // It's only necessary to memset up to where we last wrote
-	memset(buffer, 0, idx);
-	idx = 0;
+static bool _drain_try_claim(void) {
+	return !__atomic_exchange_n(&_drain_active, true, __ATOMIC_ACQUIRE);
 }
 
-void serial_putchar(char c) {
-	if (idx + 1 >= BUF_SIZE) {
-		//buffer full, flush to real serial
-		serial_flush();
+static void _drain_release(void) {
+	__atomic_store_n(&_drain_active, false, __ATOMIC_RELEASE);
+	// Pairs with the fence in serial_puts_with_severity(): either the logging core sees that
+	// the drain was released, or we see its output when we re-check
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void _drain_synchronously(void) {
+	while (_drain_try_claim()) {
+		_drain_send(UINT32_MAX, true);
+		_drain_release();
+		if (!_drain_has_pending_output()) {
+			return;
+		}
 	}
-	//append c to buffer
-	buffer[idx+0] = c;
-	//buffer[idx+1] = '\0';
-	idx++;
-	//also flush on newline
-	if (c == '\n') {
-		serial_flush();
+}
+
+static void _arm_transmitter_interrupt(void) {
+	// If the transmitter is already empty, the UART raises the interrupt as soon as it's armed
+	if (!__atomic_exchange_n(&_transmitter_interrupt_armed, true, __ATOMIC_SEQ_CST)) {
+		outb(INTERRUPT_ENABLE_REGISTER, INTERRUPT_ENABLE_TRANSMITTER_EMPTY);
 	}
 }
 
-void serial_puts_int(char* str, bool print_prefix) {
-    if (print_prefix) {
-        char prefix[64] = {0};
-        snprintf(prefix, sizeof(prefix), "Cpu[%d],Pid[%d],Clk[%d]: ", cpu_id(), getpid(), tick_count());
+static int _handle_irq(register_state_t* regs) {
+	// Reading the identification register acknowledges the transmitter-empty interrupt
+	inb(INTERRUPT_IDENTIFICATION_REGISTER);
 
-        // Hold a lock, so we don't get output intermixed from other cores
-        // Note that the lock is held before our two 'inner' calls, rather than within the inner calls
-        // Otherwise, there is a race between the two calls
-        static spinlock_t serial_output_lock = {.name = "Serial output"};
-        spinlock_acquire(&serial_output_lock);
+	if ((inb(LINE_STATUS_REGISTER) & LINE_STATUS_TRANSMITTER_EMPTY) && _drain_try_claim()) {
+		bool has_more_output = _drain_send(TRANSMIT_FIFO_SIZE, false);
+		if (!has_more_output) {
+			// Nothing more to send. Disarm before clearing the flag, so that a core that
+			// sees the flag cleared and re-arms can't have its write overwritten.
+			outb(INTERRUPT_ENABLE_REGISTER, 0x00);
+			__atomic_store_n(&_transmitter_interrupt_armed, false, __ATOMIC_SEQ_CST);
+		}
+		_drain_release();
+		if (!has_more_output && _drain_has_pending_output()) {
+			_arm_transmitter_interrupt();
+		}
+	}
 
-        serial_puts_int(prefix, false);
-        serial_puts_int(str, false);
+	apic_signal_end_of_interrupt(regs->int_no);
+	return 0;
+}
 
-        spinlock_release(&serial_output_lock);
+void serial_puts_with_severity(char* str, log_severity_t severity) {
+	log_ring_write(severity, str);
+	// Pairs with the fences in _drain_release() and _handle_irq()
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
 
-        return;
-    }
+	if (!__atomic_load_n(&_interrupts_enabled, __ATOMIC_ACQUIRE)) {
+		_drain_synchronously();
+	}
+	else if (!__atomic_load_n(&_transmitter_interrupt_armed, __ATOMIC_RELAXED)) {
+		_arm_transmitter_interrupt();
+	}
+}
 
-    char* ptr = str;
-    while (*ptr) {
-        serial_putchar(*(ptr++));
-    }
+void serial_puts(char* str) {
+	serial_puts_with_severity(str, LOG_SEVERITY_INFO);
 }
 
+void serial_flush_synchronously(void) {
+	// Only used when the system is going down, so take over the drain even if another core
+	// (or the code we interrupted) holds it.
+	__atomic_store_n(&_drain_active, true, __ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&_drain_staging, __ATOMIC_SEQ_CST)) {
+		// The owner was interrupted midway through staging an entry, so its line is incomplete
+		// Drop it and rewind, so that the entry is read and formatted again from the start
+		_drain_cursor = _drain_staging_cursor;
+		_drain_reported_drop_count = _drain_staging_reported_drop_count;
+		_drain_line_length = 0;
+		_drain_line_offset = 0;
+		__atomic_store_n(&_drain_staging, false, __ATOMIC_SEQ_CST);
+	}
+	_drain_send(UINT32_MAX, true);
+	_drain_release();
+}
 
-void serial_puts(char* str) {
-    static bool previous_output_contained_newline = false;
-    serial_puts_int(str, previous_output_contained_newline);
-    // If this output ended on a newline, the next line should come with the info prefix
-    previous_output_contained_newline = str[strlen(str) - 1] == '\n';
+void serial_enable_interrupts(void) {
+	interrupt_setup_callback(INT_VECTOR_APIC_4, _handle_irq);
+	__atomic_store_n(&_interrupts_enabled, true, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	// Send anything that was logged while we were switching over
+	if (_drain_has_pending_output()) {
+		_arm_transmitter_interrupt();
+	}
 }
 
 void serial_init() {
 	printf_info("Initializing serial driver...");
 
-	memset(buffer, 0, BUF_SIZE);
-
     // Disable interrupts
 	outb(INTERRUPT_ENABLE_REGISTER, 0x00);
 
@@ -149,12 +254,5 @@ void serial_init() {
     // [5-7]: Unused
 	outb(MODEM_CONTROL_REGISTER, 0b00001011);
 
-    // TODO(PT): Switch to an interrupt-based model for this controller, instead of polling
-    /*
-    // Enable interrupts.
-    // Bit pattern:
-    // : Interrupt when the transmitter is empty (so we know when we can send more)
-    interrupt_setup_callback(INT_VECTOR_APIC_4, (int_callback_t)_handle_irq);
-    outb(INTERRUPT_ENABLE_REGISTER, 0b10);
-    */
+    // The transmitter-empty interrupt is armed on demand once serial_enable_interrupts() is called
 }
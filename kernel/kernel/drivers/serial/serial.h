@@ -4,10 +4,20 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <std/std.h>
+#include <kernel/util/log_ring/log_ring.h>
 
 void serial_init();
 
-void serial_putchar(char c);
+// Output is recorded in the kernel log ring, and sent to the port asynchronously
+// once serial_enable_interrupts() has been called
 void serial_puts(char* str);
+void serial_puts_with_severity(char* str, log_severity_t severity);
+
+// Must be called once the APIC is set up
+void serial_enable_interrupts(void);
+
+// Sends everything in the log ring to the port before returning
+// For use when the system is about to halt
+void serial_flush_synchronously(void);
 
 #endif
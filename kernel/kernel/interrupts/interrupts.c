@@ -49,6 +49,7 @@ void interrupt_handle(register_state_t* regs) {
 		handler(regs);
 	}
 	else {
+		adi_record_spurious_interrupt(int_no);
 		// Spurious IRQ?
 		if (int_no == INT_VECTOR_PIC_7) {
 			// Just ignore it
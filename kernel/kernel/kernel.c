@@ -19,6 +19,7 @@
 // Kernel features
 #include <kernel/syscall/syscall.h>
 #include <kernel/util/elf/elf.h>
+#include <kernel/util/kernel_info/kernel_info.h>
 #include <kernel/multitasking/tasks/task_small.h>
 #include <kernel/smp.h>
 
@@ -62,6 +63,9 @@ void draw2(int color) {
 
 
 void _start(axle_boot_info_t* boot_info) {
+    // Pick the fastest memcpy/memset variants before the first large copies
+    memory_detect_cpu_features();
+
     // Environment info
     boot_info_read(boot_info);
 
@@ -78,6 +82,7 @@ void _start(axle_boot_info_t* boot_info) {
     interrupt_setup_callback(INT_VECTOR_INT14, (int_callback_t)_handle_page_fault);
     pmm_init();
     vmm_init(boot_info->boot_pml4);
+    kernel_info_init();
 
     syscall_init();
 
@@ -104,6 +109,8 @@ static void _kernel_bootstrap_part2(void) {
     //
     // Detect and boot other APs
     smp_init();
+    // Now that the APIC is set up, log output can be sent from the serial port's interrupt handler
+    serial_enable_interrupts();
 
     // Early boot is finished
     // Multitasking and program loading is now available
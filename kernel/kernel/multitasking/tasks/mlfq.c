@@ -4,6 +4,7 @@
 #include <std/math.h>
 #include <std/printf.h>
 #include <std/kheap.h>
+#include <std/slab.h>
 #include <kernel/util/spinlock/spinlock.h>
 #include <kernel/drivers/pit/pit.h>
 #include <stddef.h>
@@ -26,11 +27,13 @@ typedef struct mlfq_queue {
 } mlfq_queue_t;
 
 static array_m* _queues = 0;
+static slab_cache_t* _mlfq_ent_cache = NULL;
 
 void mlfq_init(void) {
     _queues = array_m_create(MLFQ_QUEUE_COUNT);
+    _mlfq_ent_cache = slab_cache_create("mlfq_ent_t", sizeof(mlfq_ent_t), NULL);
     for (uint32_t i = 0; i < MLFQ_QUEUE_COUNT; i++) {
-        mlfq_queue_t* q = kcalloc(1, sizeof(mlfq_queue_t));
+        mlfq_queue_t* q = kcalloc_tagged(1, sizeof(mlfq_queue_t), KHEAP_TAG_TASKING);
         q->round_robin_tasks = array_m_create(128);
         q->quantum = _mlfq_quantums[i];
         q->spinlock.name = "MLFQ queue spinlock";
@@ -44,8 +47,9 @@ void mlfq_add_task_to_queue(task_small_t* task, uint32_t queue_idx) {
     // Tasks are always enqueued to the highest priority queue
     //printf("adding to queue %d (size: %d)\n", queue_idx, _queues->size);
     mlfq_queue_t* queue = array_m_lookup(_queues, queue_idx);
-    mlfq_ent_t* ent = kcalloc(1, sizeof(mlfq_ent_t));
+    mlfq_ent_t* ent = slab_alloc(_mlfq_ent_cache);
     ent->task = task;
+    ent->last_schedule_start = 0;
     ent->ttl_remaining = queue->quantum;
     array_m_insert(queue->round_robin_tasks, ent);
     //printf("MLFQ added task [%d %s] to q %d idx %d\n", task->id, task->name, queue_idx, array_m_index(queue->round_robin_tasks, ent));
@@ -117,7 +121,7 @@ void mlfq_delete_task(task_small_t* task) {
     printf("Removing task [%d %s] from MLFQ scheduler pool. Found in Q%d idx %d\n", task->id, task->name, queue_idx, entry_idx);
     mlfq_ent_t* ent = array_m_lookup(q->round_robin_tasks, entry_idx);
     array_m_remove(q->round_robin_tasks, entry_idx);
-    kfree(ent);
+    slab_free(_mlfq_ent_cache, ent);
 
     spinlock_release(&q->spinlock);
 }
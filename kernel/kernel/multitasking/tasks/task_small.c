@@ -1,6 +1,7 @@
 #include "task_small.h"
 
 #include <std/kheap.h>
+#include <std/slab.h>
 #include <std/timer.h>
 #include <std/printf.h>
 #include <std/memory.h>
@@ -14,6 +15,8 @@
 #include <kernel/smp.h>
 
 #include <kernel/pmm/pmm.h>
+#include <kernel/util/elf/elf_image.h>
+#include <kernel/util/memory_pressure/memory_pressure.h>
 
 #include "mlfq.h"
 #include "task_small_int.h"
@@ -27,6 +30,8 @@ static task_small_t* _iosentinel_task = 0;
 static task_small_t* _task_list_head = 0;
 
 static bool _multitasking_ready = false;
+
+static slab_cache_t* _task_cache = NULL;
 const uint64_t _task_context_offset = offsetof(struct task_small, machine_state);
 const uint64_t _task_is_currently_executing_offset = offsetof(struct task_small, is_currently_executing);
 const uint64_t _task_cpu_id_offset = offsetof(struct task_small, cpu_id);
@@ -140,13 +145,9 @@ void _thread_destroy(task_small_t* thread) {
     //printf("Free kernel stack 0x%p\n", thread->kernel_stack_malloc_head);
     kfree((void*)thread->kernel_stack_malloc_head);
 
-    // Free the string table and symbol table that were copied to the heap
-    // TODO(PT): These are only heap copies when the underlying program was loaded from an ELF
-    if (thread->elf_symbol_table.strtab) {
-        kfree((void *) thread->elf_symbol_table.strtab);
-    }
-    if (thread->elf_symbol_table.symtab) {
-        kfree((void *) thread->elf_symbol_table.symtab);
+    // Programs loaded from an ELF share the image's string table and symbol table
+    if (thread->elf_image) {
+        elf_image_release(thread->elf_image);
     }
 
     if (!thread->is_thread) {
@@ -165,7 +166,7 @@ void _thread_destroy(task_small_t* thread) {
     if (thread->is_managed_by_parent) {
         kfree(thread->managing_parent_service_name);
     }
-    kfree(thread);
+    slab_free(_task_cache, thread);
 }
 
 void task_set_name(task_small_t* task, const char* new_name) {
@@ -176,7 +177,7 @@ void task_set_name(task_small_t* task, const char* new_name) {
 }
 
 task_small_t* _thread_create(void* entry_point, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3) {
-    task_small_t* new_task = kmalloc(sizeof(task_small_t));
+    task_small_t* new_task = slab_alloc(_task_cache);
     memset(new_task, 0, sizeof(task_small_t));
     new_task->id = next_pid++;
     new_task->blocked_info.status = RUNNABLE;
@@ -184,7 +185,7 @@ task_small_t* _thread_create(void* entry_point, uintptr_t arg1, uintptr_t arg2,
     new_task->lock.name = "[Task lock]";
 
     uint32_t stack_size = 0x2000;
-    char* stack = kcalloc(1, stack_size);
+    char* stack = kcalloc_tagged(1, stack_size, KHEAP_TAG_TASKING);
     //printf("New thread [%d]: Made kernel stack 0x%08x\n", new_task->id, stack);
 
     uintptr_t* stack_top = (uintptr_t*)(stack + stack_size - sizeof(uintptr_t)); // point to top of malloc'd stack
@@ -503,15 +504,8 @@ void idle_task() {
 }
 
 static void _free_low_identity_map(vas_state_t* vas) {
-    vas_range_t* low_identity_map_range = NULL;
-    for (int i = 0; i < vas->range_count; i++) {
-        vas_range_t* range = &vas->ranges[i];
-        if (range->start == 0x0) {
-            low_identity_map_range = range;
-            break;
-        }
-    }
-    assert(low_identity_map_range, "Failed to find low-memory identity map");
+    const vas_range_t* low_identity_map_range = vas_find_range(vas, 0x0);
+    assert(low_identity_map_range && low_identity_map_range->start == 0x0, "Failed to find low-memory identity map");
     vas_delete_range(vas, low_identity_map_range->start, low_identity_map_range->size);
     // Free the low PML4 entries
     // These all use 1GB pages, so we only need to free the PML4E's themselves,
@@ -558,6 +552,8 @@ void tasking_init_part2(void* continue_func_ptr) {
 
     // reaper cleans up and frees the resources of ZOMBIE tasks
     task_small_t* reaper_tcb = task_spawn("reaper", reaper_task);
+    // Tells services to trim their caches when physical memory runs low
+    task_spawn("memory pressure monitor", memory_pressure_monitor_task);
 
     printf("Multitasking initialized\n");
     _multitasking_ready = true;
@@ -579,6 +575,7 @@ void tasking_init(void* continue_func) {
         return;
     }
 
+    _task_cache = slab_cache_create("task_small_t", sizeof(task_small_t), NULL);
     mlfq_init();
 
     cpu_set_current_task(thread_spawn(tasking_init_part2, continue_func, 0, 0));
@@ -75,6 +75,8 @@ typedef struct task_small {
 	uintptr_t kernel_stack_malloc_head;
 
 	elf_t elf_symbol_table;
+	// The image the program was loaded from, if any. Owns elf_symbol_table.
+	struct elf_image* elf_image;
 
 	bool is_managed_by_parent;
 	char* managing_parent_service_name;
@@ -97,6 +99,10 @@ task_small_t* task_spawn(const char* task_name, void* entry_point);
 task_small_t* task_spawn__with_args(const char* task_name, void* entry_point, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3);
 
 task_small_t* tasking_get_task_with_pid(int pid);
+// Invokes the callback with the task with the provided PID, or NULL, while the task list is locked.
+// The task can't be destroyed until the callback returns, so the callback must not block or touch the task list.
+typedef void (*tasking_task_callback_t)(task_small_t* task, void* ctx);
+void tasking_with_task_with_pid(int pid, tasking_task_callback_t callback, void* ctx);
 task_small_t* tasking_get_current_task();
 
 // Block a task because it must wait for the provided condition
@@ -12,8 +12,18 @@ uintptr_t pmm_alloc(void);
 void pmm_alloc_address(uintptr_t address);
 uintptr_t pmm_alloc_continuous_range(uintptr_t size);
 
+// Drops a reference to the frame, returning it to the free pool once it's unreferenced
 void pmm_free(uintptr_t frame_addr);
 
+// Records an additional mapping of a frame (i.e. a copy-on-write page)
+void pmm_frame_retain(uintptr_t frame_addr);
+uint32_t pmm_frame_reference_count(uintptr_t frame_addr);
+
+// Frames available to pmm_alloc(), and the number of frames the PMM manages in total
+// Safe to read without any locks held, though the free count may change immediately
+uintptr_t pmm_free_frame_count(void);
+uintptr_t pmm_total_frame_count(void);
+
 void pmm_dump(void);
 uintptr_t pmm_allocated_memory(void);
 
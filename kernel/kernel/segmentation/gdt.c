@@ -143,7 +143,7 @@ static void tss_init(gdt_descriptor_t* gdt) {
         .base_high = (base >> 32) & 0xFFFFFFFF,
         .must_be_zero_high = 0,
     };
-    memcpy(&gdt[5], &tss_descriptor, sizeof(tss_descriptor));
+    memcpy(&gdt[6], &tss_descriptor, sizeof(tss_descriptor));
 }
 
 gdt_descriptor_t* gdt_create_for_protected_mode(uintptr_t* out_size) {
@@ -302,10 +302,12 @@ void gdt_create_for_long_mode(gdt_descriptor_t** gdt_out, uintptr_t* gdt_out_siz
         .base_high = 0
     };
     memcpy(&table[4], &user_data_long, sizeof(user_data_long));
+    // sysret expects the user code selector to follow the user data selector (see gdt_init())
+    memcpy(&table[5], &user_code_long, sizeof(user_code_long));
 
     tss_descriptor_t tss_descriptor = {0};
     *tss_out = tss_descriptor_create_for_long_mode(&tss_descriptor);
-    memcpy(&table[5], &tss_descriptor, sizeof(tss_descriptor_t));
+    memcpy(&table[6], &tss_descriptor, sizeof(tss_descriptor_t));
 }
 
 void gdt_init() {
@@ -410,6 +412,12 @@ void gdt_init() {
     };
     memcpy(&_g_gdt_entries[4], &user_data_long, sizeof(user_data_long));
 
+    // sysret loads the user SS from STAR[63:48] + 8, and the user CS from STAR[63:48] + 16.
+    // The user data selector therefore needs to be followed by a user code selector.
+    // Rather than renumbering the selectors that iretq-based returns use, duplicate
+    // the user code descriptor here. Returns from syscall run with CS = 0x2b.
+    memcpy(&_g_gdt_entries[5], &user_code_long, sizeof(user_code_long));
+
     gdt_activate(&_g_gdt_pointer);
     gdt_load_cs(0x08);
     gdt_load_ds(0x10);
@@ -420,6 +428,8 @@ void gdt_init() {
 void tss_set_kernel_stack(uint64_t stack) {
     cpu_private_info()->tss->rsp0_low = (stack & 0xFFFFFFFF);
     cpu_private_info()->tss->rsp0_high = ((stack >> 32) & 0xFFFFFFFF);
+    // The syscall instruction doesn't consult the TSS, so keep a copy where the syscall entry stub can find it
+    cpu_private_info()->syscall_kernel_stack = stack;
 }
 
 tss_t* bsp_tss(void) {
@@ -11,6 +11,11 @@
 #include <kernel/segmentation/gdt.h>
 #include <kernel/segmentation/gdt_structures.h>
 #include <kernel/multitasking/tasks/task_small.h>
+#include <kernel/vmm/tlb.h>
+#include <kernel/syscall/syscall.h>
+#include <kernel/util/kernel_info/kernel_info.h>
+#include <kernel/util/log_ring/log_ring.h>
+#include <kernel/util/profiler/profiler.h>
 
 #include <kernel/ap_bootstrap.h>
 
@@ -22,6 +27,12 @@ static bool _mapped_cpu_info_in_bsp = false;
 void ap_entry_part2(void);
 
 void ap_c_entry(void) {
+    vmm_enable_pat_on_current_core();
+    tlb_register_current_core();
+    syscall_enable_fast_entry();
+    kernel_info_register_cpu();
+    log_ring_register_current_core();
+    profiler_register_current_core();
     tasking_ap_startup(smp_core_continue);
     // Should never return
     assert(false, "tasking_ap_startup was not supposed to return control here");
@@ -88,6 +99,11 @@ void smp_init(void) {
         break;
     }
 
+    // Now that the BSP's APIC is set up, other cores can be asked to invalidate their TLBs
+    tlb_init_shootdown();
+    // Likewise, the BSP can now ask other cores to record profiler samples
+    profiler_init();
+
     // Do per-core work
     for (uintptr_t i = 0; i < smp_info->processor_count; i++) {
         processor_info_t* processor_info = &smp_info->processors[i];
@@ -32,6 +32,10 @@ typedef struct cpu_core_private_info {
     tss_t* tss;
     uintptr_t lapic_timer_ticks_per_ms;
     task_small_t* idle_task;
+    // Read by the syscall entry stub via the GS base, so the offsets of these fields are fixed
+    // (see syscall_entry.s.x86_64.arch_specific)
+    uintptr_t syscall_kernel_stack;
+    uintptr_t syscall_user_rsp_scratch;
 } cpu_core_private_info_t;
 
 typedef struct interrupt_override_info {
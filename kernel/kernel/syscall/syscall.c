@@ -1,57 +1,101 @@
 #include "syscall.h"
 #include "sysfuncs.h"
+#include <stddef.h>
+#include <kernel/assert.h>
+#include <kernel/smp.h>
 #include <kernel/interrupts/interrupts.h>
 #include <kernel/drivers/terminal/terminal.h>
 #include <kernel/drivers/pit/pit.h>
 
-#include <std/array_m.h>
-
+// Must match MAX_SYSCALLS in syscall_entry.s
 #define MAX_SYSCALLS 128
 
-static int syscall_handler(register_state_t* regs);
+#define MSR_IA32_EFER			0xC0000080
+#define MSR_IA32_STAR			0xC0000081
+#define MSR_IA32_LSTAR			0xC0000082
+#define MSR_IA32_FMASK			0xC0000084
+#define MSR_IA32_KERNEL_GS_BASE	0xC0000102
 
-typedef struct syscall_entry {
-	void* func_ptr;
-	bool wants_register_state;
-} syscall_entry_t;
+#define EFER_SYSCALL_ENABLE			(1 << 0)
+#define RFLAGS_TRAP_FLAG			(1 << 8)
+#define RFLAGS_INTERRUPT_ENABLE		(1 << 9)
+#define RFLAGS_DIRECTION_FLAG		(1 << 10)
 
-array_m* syscalls = {0};
+static int syscall_handler(register_state_t* regs);
+void syscall_entry(void);
+void syscall_return_address_invalid(uintptr_t return_address);
+
+// Read directly by the syscall entry stub, so these are flat tables indexed by syscall number
+void* syscall_table[MAX_SYSCALLS] = {0};
+bool syscall_table_wants_register_state[MAX_SYSCALLS] = {0};
+static uint32_t _syscall_count = 0;
+static bool _syscalls_setup = false;
 
 void syscall_init() {
 	printf_info("Syscalls init...");
 
+	// Older binaries still enter via int 0x80
 	interrupt_setup_callback(INT_VECTOR_SYSCALL, (int_callback_t)syscall_handler);
-	syscalls = array_m_create(MAX_SYSCALLS);
 	create_sysfuncs();
+	_syscalls_setup = true;
+	syscall_enable_fast_entry();
+}
+
+void syscall_enable_fast_entry(void) {
+#if defined __x86_64__
+	// The entry stub accesses these fields by fixed offsets
+	assert(offsetof(cpu_core_private_info_t, syscall_kernel_stack) == 80, "Syscall entry stub offsets are out of date");
+	assert(offsetof(cpu_core_private_info_t, syscall_user_rsp_scratch) == 88, "Syscall entry stub offsets are out of date");
+
+	// STAR[47:32]: syscall loads CS from this selector, and SS from the following one
+	// STAR[63:48]: sysret loads SS from this selector + 8, and CS from this selector + 16
+	// With the user code selector at 0x18, this yields user SS 0x23 and user CS 0x2b (see gdt_init())
+	uint32_t star_high = (0x08 << 0) | ((0x18 | 3) << 16);
+	x86_msr_set(MSR_IA32_STAR, 0, star_high);
+
+	uintptr_t entry = (uintptr_t)&syscall_entry;
+	x86_msr_set(MSR_IA32_LSTAR, entry & 0xFFFFFFFF, entry >> 32);
+
+	// Run syscalls with interrupts disabled, as the int 0x80 interrupt gate does
+	// The SysV ABI also expects DF to be clear, and we don't want to single-step the entry stub
+	x86_msr_set(MSR_IA32_FMASK, RFLAGS_TRAP_FLAG | RFLAGS_INTERRUPT_ENABLE | RFLAGS_DIRECTION_FLAG, 0);
+
+	// Every core maps its private info at the same address
+	uint64_t kernel_gs_base = CPU_CORE_DATA_BASE;
+	x86_msr_set(MSR_IA32_KERNEL_GS_BASE, kernel_gs_base & 0xFFFFFFFF, kernel_gs_base >> 32);
+
+	uint32_t efer_low = 0;
+	uint32_t efer_high = 0;
+	x86_msr_get(MSR_IA32_EFER, &efer_low, &efer_high);
+	x86_msr_set(MSR_IA32_EFER, efer_low | EFER_SYSCALL_ENABLE, efer_high);
+#endif
 }
 
 bool syscall_is_setup() {
-	// Has the syscalls array been created?
-	return (syscalls);
+	return _syscalls_setup;
 }
 
 void syscall_add(void* syscall, bool wants_register_state) {
-	if (syscalls->size + 1 == MAX_SYSCALLS) {
-		printf_err("Not installing syscall %d, too many in use!", syscalls->size);
+	if (_syscall_count + 1 == MAX_SYSCALLS) {
+		printf_err("Not installing syscall %d, too many in use!", _syscall_count);
 		return;
 	}
-	syscall_entry_t* entry = kcalloc(1, sizeof(syscall_entry_t));
-	entry->func_ptr = syscall;
-	entry->wants_register_state = wants_register_state;
-	array_m_insert(syscalls, entry);
+	syscall_table[_syscall_count] = syscall;
+	syscall_table_wants_register_state[_syscall_count] = wants_register_state;
+	_syscall_count += 1;
 }
 
 #if defined __i386__
 static int syscall_handler(register_state_t* regs) {
 	//check requested syscall number
 	//stored in eax
-	if (!syscalls || regs->eax >= MAX_SYSCALLS) {
+	if (regs->eax >= MAX_SYSCALLS || !syscall_table[regs->eax]) {
 		printf_err("Syscall %d called but not defined", regs->eax);
 		return -1;
 	}
 
 	//location of syscall funcptr
-	int (*location)() = (int(*)())array_m_lookup(syscalls, regs->eax);
+	int (*location)() = (int(*)())syscall_table[regs->eax];
 
 	//we don't know how many arguments the function wants.
 	//so just push them all on the stack in correct order
@@ -78,28 +122,44 @@ static int syscall_handler(register_state_t* regs) {
 #elif defined __x86_64__
 static int syscall_handler(register_state_x86_64_t* regs) {
 	// Requested syscall number stored in rax
-	if (!syscalls || regs->rax >= MAX_SYSCALLS) {
+	if (regs->rax >= MAX_SYSCALLS || !syscall_table[regs->rax]) {
 		printf_err("Syscall %d called but not defined", regs->rax);
+		// Both entry paths return rax to the caller
+		regs->rax = -1;
 		return -1;
 	}
 
 	// If the syscall is marked as receiving the register state, pass it in.
 	// Otherwise, we'll have to do a best-effort calling convention.
-	syscall_entry_t* entry = array_m_lookup(syscalls, regs->rax);
-	if (entry->wants_register_state) {
-		void(*syscall_func)(register_state_x86_64_t*, uint64_t, uint64_t, uint64_t) = (void(*)(register_state_x86_64_t*, uint64_t, uint64_t, uint64_t))entry->func_ptr;
+	void* func_ptr = syscall_table[regs->rax];
+	if (syscall_table_wants_register_state[regs->rax]) {
+		void(*syscall_func)(register_state_x86_64_t*, uint64_t, uint64_t, uint64_t) = (void(*)(register_state_x86_64_t*, uint64_t, uint64_t, uint64_t))func_ptr;
 		// Match the register order that the newlib syscall support passes arguments
 		syscall_func(regs, regs->rbx, regs->rcx, regs->rdx);
 		return 0;
 	}
 	else {
 		// We don't know here how many arguments the syscall handler accepts, so just provide them all.
-		uint64_t(*syscall)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) = (uint64_t(*)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t))entry->func_ptr;
+		uint64_t(*syscall)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) = (uint64_t(*)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t))func_ptr;
 		// Match the register order that the newlib syscall support passes arguments
 		regs->rax = syscall(regs->rbx, regs->rcx, regs->rdx, regs->rsi, regs->rdi);
 		return regs->rax;
 	}
 }
+
+// Invoked by the syscall entry stub for syscalls that can't take the lightweight path.
+// The stub builds the same frame as int 0x80, with the second parameter in the rcx slot.
+void syscall_handle_register_state(register_state_x86_64_t* regs) {
+	syscall_handler(regs);
+	if (regs->return_rip >> 47) {
+		syscall_return_address_invalid(regs->return_rip);
+	}
+}
+
+void syscall_return_address_invalid(uintptr_t return_address) {
+	printf_err("Syscall return address 0x%p is non-canonical", return_address);
+	task_assert(false, "Syscall would return to a non-canonical address", NULL);
+}
 #else 
     FAIL_TO_COMPILE();
 #endif
@@ -6,6 +6,8 @@
 void syscall_init();
 bool syscall_is_setup();
 void syscall_add(void* syscall, bool wants_register_state);
+// Configures the syscall/sysret MSRs on the current core
+void syscall_enable_fast_entry(void);
 
 #define DECL_SYSCALL(fn, ...) int sys_##fn(__VA_ARGS__)
 
@@ -16,9 +18,18 @@ void syscall_add(void* syscall, bool wants_register_state);
 #define _ASM_SYSCALL_ARGS_4(P1, P2, P3, P4) _ASM_SYSCALL_ARGS_3(P1, P2, P3), P4 p4
 #define _ASM_SYSCALL_ARGS_5(P1, P2, P3, P4, P5) _ASM_SYSCALL_ARGS_4(P1, P2, P3, P4), P5 p5
 
-#define _ASM_SYSCALL_BODY_0(num) "int $0x80" : "=a" (a) : "0" (num)
+// The syscall instruction clobbers rcx and r11, so the second parameter is passed in r10
+// GCC has no constraint for r10, so bind it with a register variable
+#define _ASM_SYSCALL_P2_0()
+#define _ASM_SYSCALL_P2_1()
+#define _ASM_SYSCALL_P2_2() register uintptr_t p2_r10 asm("r10") = (uintptr_t)p2;
+#define _ASM_SYSCALL_P2_3() _ASM_SYSCALL_P2_2()
+#define _ASM_SYSCALL_P2_4() _ASM_SYSCALL_P2_2()
+#define _ASM_SYSCALL_P2_5() _ASM_SYSCALL_P2_2()
+
+#define _ASM_SYSCALL_BODY_0(num) "syscall" : "=a" (a) : "0" (num)
 #define _ASM_SYSCALL_BODY_1(num) _ASM_SYSCALL_BODY_0(num), "b" ((uintptr_t)p1)
-#define _ASM_SYSCALL_BODY_2(num) _ASM_SYSCALL_BODY_1(num), "c" ((uintptr_t)p2)
+#define _ASM_SYSCALL_BODY_2(num) _ASM_SYSCALL_BODY_1(num), "r" (p2_r10)
 #define _ASM_SYSCALL_BODY_3(num) _ASM_SYSCALL_BODY_2(num), "d" ((uintptr_t)p3)
 #define _ASM_SYSCALL_BODY_4(num) _ASM_SYSCALL_BODY_3(num), "S" ((uintptr_t)p4)
 #define _ASM_SYSCALL_BODY_5(num) _ASM_SYSCALL_BODY_4(num), "D" ((uintptr_t)p5)
@@ -28,7 +39,8 @@ void syscall_add(void* syscall, bool wants_register_state);
 
 #define __DEFN_SYSCALL(N, fn, num, ...) \
 int sys_##fn(_ASM_SYSCALL_ARGS_##N(__VA_ARGS__)) { \
-	int a; asm volatile(_ASM_SYSCALL_BODY_##N(num)); return a; \
+	_ASM_SYSCALL_P2_##N() \
+	int a; asm volatile(_ASM_SYSCALL_BODY_##N(num) : "rcx", "r11", "memory"); return a; \
 }
 #define _DEFN_SYSCALL(N, fn, num, ...) __DEFN_SYSCALL(N, fn, num, ##__VA_ARGS__)
 #define DEFN_SYSCALL(fn, num, ...) _DEFN_SYSCALL(ARG_COUNT(__VA_ARGS__), fn, num, ##__VA_ARGS__)
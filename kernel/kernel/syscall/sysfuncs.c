@@ -9,6 +9,8 @@
 #include <kernel/drivers/pit/pit.h>
 #include <kernel/assert.h>
 #include <kernel/util/unistd/write.h>
+#include <kernel/util/log_ring/log_ring.h>
+#include <kernel/util/profiler/profiler.h>
 
 void* sbrk(int increment);
 
@@ -46,4 +48,13 @@ void create_sysfuncs() {
 	syscall_add((void*)&ms_since_boot, false);
 	// task_assert() needs a register snapshot to construct backtraces
 	syscall_add((void*)&task_assert_wrapper, true);
+
+	syscall_add((void*)&log_ring_read, false);
+
+	syscall_add((void*)&profiler_start, false);
+	syscall_add((void*)&profiler_stop, false);
+	syscall_add((void*)&profiler_read_samples, false);
+	syscall_add((void*)&profiler_symbolize, false);
+
+	syscall_add((void*)&adi_irq_stats_read, false);
 }
@@ -2,12 +2,14 @@
 #include <stdbool.h>
 
 #include <std/math.h>
+#include <std/memory.h>
 #include <std/printf.h>
 #include <std/string.h>
 #include <kernel/interrupts/pic.h>
 #include <kernel/util/amc/amc_internal.h>
 #include <kernel/util/spinlock/spinlock.h>
 #include <kernel/multitasking/tasks/task_small.h>
+#include <kernel/util/kernel_info/kernel_info.h>
 
 #include "adi.h"
 #include "kernel/smp.h"
@@ -16,6 +18,66 @@
 #define MAX_INT_VECTOR 128
 static adi_driver_t _adi_drivers[MAX_IRQ] = {0};
 
+// A driver may fall behind its interrupts, so remember when each pending interrupt fired
+#define ADI_PENDING_TIMESTAMP_COUNT 16
+
+typedef struct adi_irq_timing {
+    uint64_t fired_at_us[ADI_PENDING_TIMESTAMP_COUNT];
+    uint32_t fired_head;
+    uint32_t fired_count;
+    // When adi_event_await() last returned to service an interrupt, or 0 if it's been acknowledged
+    uint64_t dispatched_at_us;
+} adi_irq_timing_t;
+
+// Protects the stats and timings, which are updated from interrupt context on any core
+static spinlock_t _adi_stats_lock = {.name = "[adi stats lock]"};
+static adi_irq_stats_t _adi_irq_stats[MAX_INT_VECTOR] = {0};
+static adi_irq_timing_t _adi_irq_timings[MAX_INT_VECTOR] = {0};
+
+static uint32_t _adi_latency_bucket(uint64_t latency_us) {
+    if (!latency_us) {
+        return 0;
+    }
+    uint32_t bucket = 64 - __builtin_clzll(latency_us);
+    return min(bucket, ADI_LATENCY_BUCKET_COUNT - 1);
+}
+
+// Must be called with the stats lock held
+static void _adi_record_interrupt_fired(uint32_t irq, uint64_t now) {
+    adi_irq_timing_t* timing = &_adi_irq_timings[irq];
+    // If the driver is this far behind, the interrupt is counted but not timed
+    if (timing->fired_count < ADI_PENDING_TIMESTAMP_COUNT) {
+        uint32_t idx = (timing->fired_head + timing->fired_count) % ADI_PENDING_TIMESTAMP_COUNT;
+        timing->fired_at_us[idx] = now;
+        timing->fired_count += 1;
+    }
+}
+
+static void _adi_record_interrupt_dispatched(uint32_t irq) {
+    uint64_t now = kernel_info_us_since_boot();
+    spinlock_acquire(&_adi_stats_lock);
+    adi_irq_timing_t* timing = &_adi_irq_timings[irq];
+    if (timing->fired_count) {
+        uint64_t fired_at = timing->fired_at_us[timing->fired_head];
+        timing->fired_head = (timing->fired_head + 1) % ADI_PENDING_TIMESTAMP_COUNT;
+        timing->fired_count -= 1;
+        _adi_irq_stats[irq].dispatch_latency_histogram[_adi_latency_bucket(now - fired_at)] += 1;
+    }
+    timing->dispatched_at_us = now;
+    spinlock_release(&_adi_stats_lock);
+}
+
+static void _adi_record_interrupt_serviced(uint32_t irq) {
+    uint64_t now = kernel_info_us_since_boot();
+    spinlock_acquire(&_adi_stats_lock);
+    adi_irq_timing_t* timing = &_adi_irq_timings[irq];
+    if (timing->dispatched_at_us) {
+        _adi_irq_stats[irq].service_latency_histogram[_adi_latency_bucket(now - timing->dispatched_at_us)] += 1;
+        timing->dispatched_at_us = 0;
+    }
+    spinlock_release(&_adi_stats_lock);
+}
+
 static adi_driver_t* _adi_driver_matching_data(const char* name, task_small_t* task, uint32_t irq) {
     /*
      * Returns the first adi driver matching the provided data.
@@ -49,9 +111,22 @@ static void _adi_interrupt_handler(register_state_t* regs) {
     assert(_adi_drivers[irq].task != NULL, "IRQ does not have a corresponding driver");
 
     adi_driver_t* driver = _adi_drivers + irq;
-    driver->pending_irq_count += 1;
-
     task_small_t* task = (task_small_t*)driver->task;
+
+    uint64_t now = kernel_info_us_since_boot();
+    spinlock_acquire(&_adi_stats_lock);
+    _adi_irq_stats[irq].interrupt_count += 1;
+    if (task->blocked_info.status == ZOMBIE) {
+        // Nobody will ever service this interrupt, so acknowledge it now to keep the vector usable
+        _adi_irq_stats[irq].dropped_count += 1;
+        spinlock_release(&_adi_stats_lock);
+        apic_signal_end_of_interrupt(irq);
+        return;
+    }
+    _adi_record_interrupt_fired(irq, now);
+    spinlock_release(&_adi_stats_lock);
+
+    driver->pending_irq_count += 1;
     tasking_unblock_task_with_reason(task, IRQ_WAIT);
     mlfq_goto_task(task);
 }
@@ -77,6 +152,8 @@ void adi_register_driver(const char* name, uint32_t irq) {
     // Copy the string so we can access it in kernel-space
     _adi_drivers[irq].name = strdup(name);
     _adi_drivers[irq].pending_irq_count = 0;
+    _adi_irq_stats[irq].irq = irq;
+    strncpy(_adi_irq_stats[irq].driver_name, name, sizeof(_adi_irq_stats[irq].driver_name) - 1);
     printf("Mapped _adi_drivers[%d] = %s\n", irq, _adi_drivers[irq].name);
 
     // Set up an interrupt handler that will unblock the driver process
@@ -99,6 +176,7 @@ bool adi_event_await(uint32_t irq) {
     // If the driver has at least one interrupt to service now, don't block
     if (driver->pending_irq_count) {
         spinlock_release(&s);
+        _adi_record_interrupt_dispatched(irq);
         return true;
     }
     
@@ -122,16 +200,49 @@ bool adi_event_await(uint32_t irq) {
     assert(unblock_reason == IRQ_WAIT || unblock_reason == AMC_AWAIT_MESSAGE, "ADI driver awoke for unknown reason");
 
     spinlock_release(&s);
-    return unblock_reason == IRQ_WAIT;
+    if (unblock_reason == IRQ_WAIT) {
+        _adi_record_interrupt_dispatched(irq);
+        return true;
+    }
+    return false;
 }
 
 void adi_send_eoi(uint32_t irq) {
     adi_driver_t* driver = _adi_drivers + irq;
     assert(driver->pending_irq_count > 0, "adi_send_eoi without any interrupt to ack");
     driver->pending_irq_count -= 1;
+    _adi_record_interrupt_serviced(irq);
     apic_signal_end_of_interrupt(irq);
 }
 
+int adi_irq_stats_read(adi_irq_stats_t* out, uint32_t max_count) {
+    uint32_t count = 0;
+    for (uint32_t irq = 0; irq < MAX_INT_VECTOR && count < max_count; irq++) {
+        // Take a snapshot, so the caller's buffer isn't touched with the lock held
+        adi_irq_stats_t snapshot;
+        spinlock_acquire(&_adi_stats_lock);
+        memcpy(&snapshot, &_adi_irq_stats[irq], sizeof(snapshot));
+        spinlock_release(&_adi_stats_lock);
+
+        if (!snapshot.driver_name[0] && !snapshot.interrupt_count && !snapshot.spurious_count) {
+            continue;
+        }
+        snapshot.irq = irq;
+        memcpy(&out[count++], &snapshot, sizeof(snapshot));
+    }
+    return count;
+}
+
+void adi_record_spurious_interrupt(uint32_t irq) {
+    if (irq >= MAX_INT_VECTOR) {
+        return;
+    }
+    spinlock_acquire(&_adi_stats_lock);
+    _adi_irq_stats[irq].interrupt_count += 1;
+    _adi_irq_stats[irq].spurious_count += 1;
+    spinlock_release(&_adi_stats_lock);
+}
+
 bool adi_services_interrupt(uint32_t irq) {
     assert(irq > 0 && irq < MAX_INT_VECTOR, "Invalid IRQ provided");
     return _adi_drivers[irq].task != NULL;
@@ -14,6 +14,25 @@ typedef struct adi_driver {
     void* task; // task_small_t
 } adi_driver_t;
 
+// Latencies are bucketed by their log2: bucket 0 counts latencies under 1us,
+// and bucket i counts latencies in [2^(i-1), 2^i) us. The last bucket also counts anything longer.
+#define ADI_LATENCY_BUCKET_COUNT 24
+
+typedef struct adi_irq_stats {
+    uint32_t irq;
+    // Empty if no driver is registered for the IRQ
+    char driver_name[32];
+    uint64_t interrupt_count;
+    // Interrupts delivered on the vector while nothing was set up to handle them
+    uint64_t spurious_count;
+    // Interrupts acknowledged without being delivered, because the driver had exited
+    uint64_t dropped_count;
+    // From the interrupt firing to adi_event_await() returning in the driver
+    uint64_t dispatch_latency_histogram[ADI_LATENCY_BUCKET_COUNT];
+    // From adi_event_await() returning to the driver calling adi_send_eoi()
+    uint64_t service_latency_histogram[ADI_LATENCY_BUCKET_COUNT];
+} adi_irq_stats_t;
+
 // ############
 // Called externally by drivers to interface with adi
 // ############
@@ -33,10 +52,17 @@ bool adi_event_await(uint32_t irq);
 // This sends the "end-of-interrupt" signal to the PIC
 void adi_send_eoi(uint32_t irq);
 
+// Copies the statistics of each IRQ that has a driver or has seen interrupts
+// Returns the number of entries copied
+int adi_irq_stats_read(adi_irq_stats_t* out, uint32_t max_count);
+
 // ############
 // Called internally from kernel mode
 // ############
 
+// Counts an interrupt that arrived on a vector without a handler
+void adi_record_spurious_interrupt(uint32_t irq);
+
 // Returns whether there is a driver registered to handle the provided IRQ
 bool adi_services_interrupt(uint32_t irq);
 
@@ -1,4 +1,5 @@
 #include <std/kheap.h>
+#include <std/slab.h>
 #include <std/math.h>
 #include <std/string.h>
 #include <std/printf.h>
@@ -7,6 +8,7 @@
 #include <std/hash_map.h>
 #include <kernel/util/elf/elf.h>
 #include <kernel/util/spinlock/spinlock.h>
+#include <kernel/util/shmem/shmem.h>
 
 #include "amc.h"
 #include "amc_internal.h"
@@ -54,6 +56,13 @@ static array_m* _amc_messages_to_unknown_services_pool = 0;
 
 static array_m* _asleep_procs = 0;
 
+// Most messages are small, so they're served by per-CPU slab caches rather than the kernel heap
+// Messages larger than the biggest size class fall back to kmalloc()
+static const uint32_t _amc_message_size_classes[] = {256, 512, 1024, 2048};
+#define AMC_MESSAGE_SIZE_CLASS_COUNT (sizeof(_amc_message_size_classes) / sizeof(_amc_message_size_classes[0]))
+static slab_cache_t* _amc_message_caches[AMC_MESSAGE_SIZE_CLASS_COUNT] = {0};
+static spinlock_t _amc_message_caches_lock = {.name = "[AMC message caches lock]"};
+
 static hash_map_t* _amc_services_by_name = 0;
 static hash_map_t* _amc_services_by_task = 0;
 
@@ -209,7 +218,7 @@ void amc_register_service(const char* name) {
         return;
     }
 
-    amc_service_t* service = kcalloc(1, sizeof(amc_service_t));
+    amc_service_t* service = kcalloc_tagged(1, sizeof(amc_service_t), KHEAP_TAG_AMC);
 
     printf("Registering service with name 0x%08x (%s)\n", name, name);
     char buf[256];
@@ -294,6 +303,8 @@ void amc_teardown_service_for_task(task_small_t* task) {
         _amc_core_shared_memory_destroy(service, 0);
     }
     array_m_destroy(service->shmem_regions);
+    // Drop the service's mappings of shared memory objects, freeing any that nobody else maps
+    shmem_unmap_all(task->vas_state);
 
     // Inform other services that this service is now dead
     // Save the service names that we will inform to avoid holding the _amc_services lock twice,
@@ -342,7 +353,38 @@ static void _amc_print_inbox(amc_service_t* inbox) {
     printf("--------------------------------------\n");
 }
 
+static slab_cache_t* _amc_message_cache_for_size(uint32_t total_msg_size) {
+    for (uint32_t i = 0; i < AMC_MESSAGE_SIZE_CLASS_COUNT; i++) {
+        if (total_msg_size > _amc_message_size_classes[i]) {
+            continue;
+        }
+        // Messages can be sent by the core before any service is registered, so create caches on first use
+        if (!_amc_message_caches[i]) {
+            spinlock_acquire(&_amc_message_caches_lock);
+            if (!_amc_message_caches[i]) {
+                _amc_message_caches[i] = slab_cache_create("amc_message_t", _amc_message_size_classes[i], NULL);
+            }
+            spinlock_release(&_amc_message_caches_lock);
+        }
+        return _amc_message_caches[i];
+    }
+    return NULL;
+}
+
+static amc_message_t* _amc_message_alloc(uint32_t total_msg_size) {
+    slab_cache_t* cache = _amc_message_cache_for_size(total_msg_size);
+    if (cache) {
+        return slab_alloc(cache);
+    }
+    return kmalloc_tagged(total_msg_size, KHEAP_TAG_AMC);
+}
+
 void amc_message_free(amc_message_t* msg) {
+    slab_cache_t* cache = _amc_message_cache_for_size(msg->len + sizeof(amc_message_t));
+    if (cache) {
+        slab_free(cache, msg);
+        return;
+    }
     kfree(msg);
 }
 
@@ -574,7 +616,8 @@ static bool _amc_message_send_from_service_name(
     }
 
     uint32_t total_msg_size = buf_size + sizeof(amc_message_t);
-    uint8_t* queued_msg = kcalloc(1, total_msg_size);
+    // Every byte of the message is written below, so there's no need to zero it
+    uint8_t* queued_msg = (uint8_t*)_amc_message_alloc(total_msg_size);
     amc_message_t* header = (amc_message_t*)queued_msg;
     strncpy((char*)header->source, source_service, sizeof(header->source));
     strncpy((char*)header->dest, destination_service, sizeof(header->dest));
@@ -9,20 +9,21 @@
 
 #include <kernel/boot_info.h>
 #include <kernel/util/elf/elf.h>
+#include <kernel/util/elf/elf_image.h>
+#include <kernel/util/memory_pressure/memory_pressure.h>
+#include <kernel/util/shmem/shmem.h>
 
 #include "amc_internal.h"
 #include "core_commands.h"
 #include "kernel/drivers/pit/pit.h"
 #include "kernel/pmm/pmm.h"
 
-const uint64_t _AMC_SHARED_MEMORY_BASE = 0x7f0000000000;
-
 static void _amc_core_copy_amc_services(const char* source_service) {
     printf("Request to copy services\n");
    
     array_m* services = amc_services();
     uint32_t response_size = sizeof(amc_service_list_t) + (sizeof(amc_service_description_t) * services->size);
-    amc_service_list_t* service_list = kcalloc(1, response_size);
+    amc_service_list_t* service_list = kcalloc_tagged(1, response_size, KHEAP_TAG_AMC);
     service_list->event = AMC_COPY_SERVICES_RESPONSE;
     service_list->service_count = services->size;
 
@@ -67,7 +68,8 @@ static void _amc_core_awm_map_framebuffer(const char* source_service) {
     }
     */
     uint64_t framebuf_size = framebuf_end_addr - framebuf_start_addr;
-    uint64_t mapped_framebuffer = vas_map_range(vas_get_active_state(), 0x7d0000000000, framebuf_size, framebuf_start_addr, VAS_RANGE_ACCESS_LEVEL_READ_WRITE, VAS_RANGE_PRIVILEGE_LEVEL_USER);
+    // awm only ever streams writes to the framebuffer, so let the CPU combine them into bursts
+    uint64_t mapped_framebuffer = vas_map_range__write_combining(vas_get_active_state(), 0x7d0000000000, framebuf_size, framebuf_start_addr, VAS_RANGE_ACCESS_LEVEL_READ_WRITE, VAS_RANGE_PRIVILEGE_LEVEL_USER);
     printf("Mapped framebuffer to 0x%p\n", mapped_framebuffer);
 
     amc_framebuffer_info_t msg = {
@@ -107,7 +109,8 @@ static void _amc_core_file_server_map_initrd(const char* source_service) {
     // Map the ramdisk into the proc's address space
     boot_info_t* bi = boot_info_get();
     uint32_t page_padded_size = (bi->initrd_size + (PAGE_SIZE - 1)) & ~(PAGE_SIZE - 1);
-    uintptr_t mapped_initrd = vas_map_range(vas_get_active_state(), 0x7d0000000000, page_padded_size, bi->initrd_start, VAS_RANGE_ACCESS_LEVEL_READ_WRITE, VAS_RANGE_PRIVILEGE_LEVEL_USER);
+    // Read-only, so that exec can identify an initrd file by its physical address and reuse its cached image
+    uintptr_t mapped_initrd = vas_map_range(vas_get_active_state(), 0x7d0000000000, page_padded_size, bi->initrd_start, VAS_RANGE_ACCESS_LEVEL_READ_ONLY, VAS_RANGE_PRIVILEGE_LEVEL_USER);
     spinlock_release(&current_service->spinlock);
 
     // And mark the pages as accessible to usermode
@@ -122,12 +125,34 @@ static void _amc_core_file_server_map_initrd(const char* source_service) {
     amc_message_send__from_core(source_service, &msg, sizeof(amc_initrd_info_t));
 }
 
-static void AMC_EXEC_TRAMPOLINE_NAME(const char* program_name, void* buf, uint32_t buf_size) {
+// Runs as the new task's entry point. The program name is the kernel-owned copy made when spawning.
+static void AMC_EXEC_TRAMPOLINE_NAME(char* program_name, elf_image_t* image) {
     char* argv[] = {program_name, NULL};
-    elf_load_buffer(program_name, argv, buf, buf_size, true);
+    elf_load_image(program_name, argv, image);
 	panic("noreturn");
 }
 
+// Returns the physical address of the buffer if it's a view of the initrd, or 0 otherwise
+// The initrd can never change, so its location identifies a file's contents
+static uintptr_t _exec_buffer_initrd_phys_addr(void* buffer_addr, uint32_t buffer_size) {
+    vas_state_t* vas = vas_get_active_state();
+    uintptr_t start = (uintptr_t)buffer_addr;
+    uintptr_t last_byte = start + buffer_size - 1;
+    if (!buffer_size || last_byte < start || !vas_is_page_present(vas, start) || !vas_is_page_present(vas, last_byte)) {
+        return 0;
+    }
+
+    uintptr_t phys_start = vas_get_phys_frame(vas, start & PAGING_PAGE_MASK) + (start & (PAGE_SIZE - 1));
+    uintptr_t phys_last_byte = vas_get_phys_frame(vas, last_byte & PAGING_PAGE_MASK) + (last_byte & (PAGE_SIZE - 1));
+    boot_info_t* bi = boot_info_get();
+    // The initrd is mapped contiguously, so a buffer that begins and ends within it lies entirely within it
+    bool is_within_initrd = (
+        phys_start >= bi->initrd_start && phys_last_byte < bi->initrd_end &&
+        phys_last_byte - phys_start == buffer_size - 1
+    );
+    return is_within_initrd ? phys_start : 0;
+}
+
 static void _amc_core_file_server_exec_buffer(const char* source_service, void* buf, uint32_t buf_size) {
     //assert(!strncmp(source_service, "com.axle.file_server", AMC_MAX_SERVICE_NAME_LEN), "Only File Server may use this syscall");
     // This syscall is heavily restricted
@@ -142,20 +167,26 @@ static void _amc_core_file_server_exec_buffer(const char* source_service, void*
     printf("exec buffer(program_name: %s, buffer_addr: 0x%p, buffer_size: %p)\n", cmd->program_name, cmd->buffer_addr, cmd->buffer_size);
 	printf("[%d ms] exec_buffer (buffer size %d)\n", ms_since_boot(), cmd->buffer_size);
 
-    // Copy the buffer to kernel space
-    char* copy = kmalloc(cmd->buffer_size);
-    memcpy(copy, cmd->buffer_addr, cmd->buffer_size);
+    // Lay out the program's segments directly from the sender's buffer, rather than copying the whole file to
+    // kernel space first. Programs launched from the initrd reuse the image built for a previous launch.
+    uintptr_t source_phys_addr = _exec_buffer_initrd_phys_addr(cmd->buffer_addr, cmd->buffer_size);
+    elf_image_t* image = elf_image_for_buffer(cmd->program_name, cmd->buffer_addr, cmd->buffer_size, source_phys_addr);
+    if (!image) {
+        printf("[%d] Not launching %s because it isn't a loadable ELF\n", getpid(), cmd->program_name);
+        return;
+    }
     // Copy program name to kernel space
     // TODO(PT): Where should this be freed?
     char* name_copy = strdup(cmd->program_name);
 
+    // The new task takes over our reference to the image
     if (cmd->with_supervisor) {
         task_small_t* child = task_spawn__managed__with_args(
             name_copy,
             AMC_EXEC_TRAMPOLINE_NAME, 
             (uintptr_t)name_copy, 
-            (uintptr_t)copy, 
-            cmd->buffer_size
+            (uintptr_t)image, 
+            0
         );
     }
     else {
@@ -163,8 +194,8 @@ static void _amc_core_file_server_exec_buffer(const char* source_service, void*
             name_copy,
             AMC_EXEC_TRAMPOLINE_NAME, 
             (uintptr_t)name_copy, 
-            (uintptr_t)copy, 
-            cmd->buffer_size
+            (uintptr_t)image, 
+            0
         );
     }
     printf("[%d] Continuing from task_spawn\n", getpid());
@@ -179,6 +210,21 @@ static void _amc_core_handle_profile_request(const char* source_service) {
     amc_message_send__from_core(source_service, &resp, sizeof(resp));
 }
 
+static void _amc_core_dump_kheap_allocation_stats(const char* source_service, void* buf, uint32_t buf_size) {
+    if (buf_size < sizeof(amc_kheap_dump_allocation_stats_cmd_t)) {
+        printf("Dropping kheap dump request from %s with invalid size %d\n", source_service, buf_size);
+        return;
+    }
+    amc_kheap_dump_allocation_stats_cmd_t* cmd = (amc_kheap_dump_allocation_stats_cmd_t*)buf;
+    printf("Dumping kernel heap allocation stats for %s\n", source_service);
+    kheap_dump_allocation_stats(cmd->top_site_count);
+}
+
+static void _amc_core_memory_pressure_subscribe(const char* source_service) {
+    printf("%s subscribed to memory pressure events\n", source_service);
+    memory_pressure_subscribe(source_service);
+}
+
 static void _amc_core_handle_notify_service_died(const char* source_service, void* buf, uint32_t buf_size) {
     amc_service_t* source = amc_service_with_name(source_service);
     assert(source != NULL, "Failed to find service that sent the message...");
@@ -247,23 +293,18 @@ static void _amc_shared_memory_create(const char* source_service, void* buf, uin
 
     printf("[AMC] Creating shared memory [%s <-> %s] of size 0x%p\n", source->name, remote->name, cmd->buffer_size);
 
-    uint64_t local_vas_base = vas_alloc_range(
-        source->task->vas_state, 
-        _AMC_SHARED_MEMORY_BASE, 
-        cmd->buffer_size, 
-        VAS_RANGE_ACCESS_LEVEL_READ_WRITE, 
-        VAS_RANGE_PRIVILEGE_LEVEL_USER
-    );
-    uint64_t remote_vas_base = vas_copy_phys_mapping(
-        remote->task->vas_state,
-        source->task->vas_state, 
-        _AMC_SHARED_MEMORY_BASE,
-        cmd->buffer_size,
-        local_vas_base,
-        VAS_RANGE_ACCESS_LEVEL_READ_WRITE,
-        VAS_RANGE_PRIVILEGE_LEVEL_USER
-    );
-    printf("[AMC] local VAS 0x%p remote VAS 0x%p\n", local_vas_base, remote_vas_base);
+    // Backed by a shared memory object, so the region is released once both services have died
+    uint64_t local_vas_base = 0;
+    uint64_t remote_vas_base = 0;
+    uint32_t handle = shmem_create(source->task->vas_state, cmd->buffer_size, cmd->buffer_size, &local_vas_base);
+    if (handle != 0) {
+        shmem_share(handle, source->task->vas_state, remote->task->vas_state, &remote_vas_base);
+        printf("[AMC] local VAS 0x%p remote VAS 0x%p\n", local_vas_base, remote_vas_base);
+    }
+    else {
+        // The requested size was empty or too large. Reply with null buffers so the caller isn't left waiting.
+        printf("[AMC] Dropping shared memory request from %s with invalid size 0x%p\n", source->name, cmd->buffer_size);
+    }
 
     amc_shared_memory_create_response_t msg = {
         .event = AMC_SHARED_MEMORY_CREATE_RESPONSE,
@@ -273,6 +314,73 @@ static void _amc_shared_memory_create(const char* source_service, void* buf, uin
     amc_message_send__from_core(source_service, &msg, sizeof(amc_shared_memory_create_response_t));
 }
 
+static void _amc_core_shmem_create(const char* source_service, void* buf, uint32_t buf_size) {
+    if (buf_size < sizeof(amc_shmem_create_cmd_t)) {
+        printf("Dropping shmem create request from %s with invalid size %d\n", source_service, buf_size);
+        return;
+    }
+    amc_service_t* source = amc_service_with_name(source_service);
+    assert(source != NULL, "Failed to find service that sent the message...");
+    amc_shmem_create_cmd_t* cmd = (amc_shmem_create_cmd_t*)buf;
+
+    amc_shmem_create_response_t resp = {.event = AMC_SHMEM_CREATE_RESPONSE};
+    uint64_t local_base = 0;
+    resp.handle = shmem_create(source->task->vas_state, cmd->size, cmd->max_size, &local_base);
+    resp.local_buffer_start = local_base;
+    amc_message_send__from_core(source_service, &resp, sizeof(resp));
+}
+
+static void _amc_core_shmem_share(const char* source_service, void* buf, uint32_t buf_size) {
+    if (buf_size < sizeof(amc_shmem_share_cmd_t)) {
+        printf("Dropping shmem share request from %s with invalid size %d\n", source_service, buf_size);
+        return;
+    }
+    amc_service_t* source = amc_service_with_name(source_service);
+    assert(source != NULL, "Failed to find service that sent the message...");
+    amc_shmem_share_cmd_t* cmd = (amc_shmem_share_cmd_t*)buf;
+
+    amc_shmem_share_response_t resp = {.event = AMC_SHMEM_SHARE_RESPONSE, .handle = cmd->handle};
+    amc_service_t* remote = amc_service_with_name(cmd->remote_service_name);
+    if (!remote) {
+        printf("[AMC] %s tried to share memory with unknown service %s\n", source_service, cmd->remote_service_name);
+    }
+    else {
+        uint64_t remote_base = 0;
+        resp.success = shmem_share(cmd->handle, source->task->vas_state, remote->task->vas_state, &remote_base);
+        resp.remote_buffer_start = remote_base;
+    }
+    amc_message_send__from_core(source_service, &resp, sizeof(resp));
+}
+
+static void _amc_core_shmem_resize(const char* source_service, void* buf, uint32_t buf_size) {
+    if (buf_size < sizeof(amc_shmem_resize_cmd_t)) {
+        printf("Dropping shmem resize request from %s with invalid size %d\n", source_service, buf_size);
+        return;
+    }
+    amc_service_t* source = amc_service_with_name(source_service);
+    assert(source != NULL, "Failed to find service that sent the message...");
+    amc_shmem_resize_cmd_t* cmd = (amc_shmem_resize_cmd_t*)buf;
+
+    amc_shmem_resize_response_t resp = {
+        .event = AMC_SHMEM_RESIZE_RESPONSE,
+        .handle = cmd->handle,
+        .success = shmem_resize(cmd->handle, source->task->vas_state, cmd->new_size),
+        .size = cmd->new_size,
+    };
+    amc_message_send__from_core(source_service, &resp, sizeof(resp));
+}
+
+static void _amc_core_shmem_unmap(const char* source_service, void* buf, uint32_t buf_size) {
+    if (buf_size < sizeof(amc_shmem_unmap_cmd_t)) {
+        printf("Dropping shmem unmap request from %s with invalid size %d\n", source_service, buf_size);
+        return;
+    }
+    amc_service_t* source = amc_service_with_name(source_service);
+    assert(source != NULL, "Failed to find service that sent the message...");
+    amc_shmem_unmap_cmd_t* cmd = (amc_shmem_unmap_cmd_t*)buf;
+    shmem_unmap(cmd->handle, source->task->vas_state);
+}
+
 static void _amc_query_service(const char* source_service, void* buf, uint32_t buf_size) {
     amc_service_t* source = amc_service_with_name(source_service);
     assert(source != NULL, "Failed to find service that sent the message...");
@@ -576,6 +684,24 @@ void amc_core_handle_message(const char* source_service, void* buf, uint32_t buf
     else if (u32buf[0] == TASK_VIEWER_GET_TASK_INFO) {
         _amc_core_send_task_info(source_service);
     }
+    else if (u32buf[0] == AMC_KHEAP_DUMP_ALLOCATION_STATS) {
+        _amc_core_dump_kheap_allocation_stats(source_service, buf, buf_size);
+    }
+    else if (u32buf[0] == AMC_MEMORY_PRESSURE_SUBSCRIBE) {
+        _amc_core_memory_pressure_subscribe(source_service);
+    }
+    else if (u32buf[0] == AMC_SHMEM_CREATE_REQUEST) {
+        _amc_core_shmem_create(source_service, buf, buf_size);
+    }
+    else if (u32buf[0] == AMC_SHMEM_SHARE_REQUEST) {
+        _amc_core_shmem_share(source_service, buf, buf_size);
+    }
+    else if (u32buf[0] == AMC_SHMEM_RESIZE_REQUEST) {
+        _amc_core_shmem_resize(source_service, buf, buf_size);
+    }
+    else if (u32buf[0] == AMC_SHMEM_UNMAP) {
+        _amc_core_shmem_unmap(source_service, buf, buf_size);
+    }
     else {
         printf("Unknown message: %d\n", u32buf[0]);
         assert(0, "Unknown message to core");
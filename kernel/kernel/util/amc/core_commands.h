@@ -240,6 +240,112 @@ typedef struct amc_supervised_process_event {
     amc_supervised_process_event_payload_t payload;
 } amc_supervised_process_event_t;
 
+// Prints the kernel heap's per-subsystem accounting and top allocation sites to the syslog
+
+#define AMC_KHEAP_DUMP_ALLOCATION_STATS 216
+
+typedef struct amc_kheap_dump_allocation_stats_cmd {
+    uint32_t event; // AMC_KHEAP_DUMP_ALLOCATION_STATS
+    uint32_t top_site_count;
+} amc_kheap_dump_allocation_stats_cmd_t;
+
+// Asks the kernel to send the caller an AMC_MEMORY_PRESSURE_EVENT whenever free physical memory
+// crosses a watermark, and periodically while memory stays under pressure.
+// Subscriptions are dropped when the subscriber's service dies.
+
+#define AMC_MEMORY_PRESSURE_SUBSCRIBE 217
+#define AMC_MEMORY_PRESSURE_EVENT 218
+
+typedef enum amc_memory_pressure_level {
+    AMC_MEMORY_PRESSURE_NONE = 0,
+    // Services should drop cached data that's cheap to recreate
+    AMC_MEMORY_PRESSURE_LOW = 1,
+    // Services should drop everything that isn't needed to make progress
+    AMC_MEMORY_PRESSURE_MEDIUM = 2,
+    // Allocations are about to fail
+    AMC_MEMORY_PRESSURE_CRITICAL = 3,
+} amc_memory_pressure_level_t;
+
+typedef struct amc_memory_pressure_subscribe_cmd {
+    uint32_t event; // AMC_MEMORY_PRESSURE_SUBSCRIBE
+} amc_memory_pressure_subscribe_cmd_t;
+
+typedef struct amc_memory_pressure_event {
+    uint32_t event; // AMC_MEMORY_PRESSURE_EVENT
+    uint32_t level; // amc_memory_pressure_level_t
+    uint64_t free_frames;
+    uint64_t total_frames;
+    // How much memory would need to be released, across the system, to leave the pressured state
+    uint64_t bytes_to_reclaim;
+} amc_memory_pressure_event_t;
+
+// Shared memory objects
+// An object is a set of physical frames identified by a handle, which can be mapped into any number of services.
+// Each mapping reserves enough address space for the object's maximum size, so the object can be
+// grown and shrunk in place without moving any mapping. The object is freed once its last mapping goes away,
+// either explicitly or because the service holding it died.
+// Only a service that currently maps an object can share, resize, or unmap it.
+
+// Creates an object and maps it into the caller
+#define AMC_SHMEM_CREATE_REQUEST 219
+#define AMC_SHMEM_CREATE_RESPONSE 219
+
+typedef struct amc_shmem_create_cmd {
+    uint32_t event; // AMC_SHMEM_CREATE_REQUEST
+    uint64_t size;
+    // The object can later be grown up to this size. Zero means the object can't grow past its initial size.
+    uint64_t max_size;
+} amc_shmem_create_cmd_t;
+
+typedef struct amc_shmem_create_response {
+    uint32_t event; // AMC_SHMEM_CREATE_RESPONSE
+    uint32_t handle;
+    uintptr_t local_buffer_start;
+} amc_shmem_create_response_t;
+
+// Maps an object that the caller holds into another service
+#define AMC_SHMEM_SHARE_REQUEST 220
+#define AMC_SHMEM_SHARE_RESPONSE 220
+
+typedef struct amc_shmem_share_cmd {
+    uint32_t event; // AMC_SHMEM_SHARE_REQUEST
+    uint32_t handle;
+    char remote_service_name[AMC_MAX_SERVICE_NAME_LEN];
+} amc_shmem_share_cmd_t;
+
+typedef struct amc_shmem_share_response {
+    uint32_t event; // AMC_SHMEM_SHARE_RESPONSE
+    uint32_t handle;
+    bool success;
+    uintptr_t remote_buffer_start;
+} amc_shmem_share_response_t;
+
+// Grows or shrinks an object in every service that maps it
+// Shrinking unmaps the tail of the object everywhere, so the services involved must agree to stop using it first
+#define AMC_SHMEM_RESIZE_REQUEST 221
+#define AMC_SHMEM_RESIZE_RESPONSE 221
+
+typedef struct amc_shmem_resize_cmd {
+    uint32_t event; // AMC_SHMEM_RESIZE_REQUEST
+    uint32_t handle;
+    uint64_t new_size;
+} amc_shmem_resize_cmd_t;
+
+typedef struct amc_shmem_resize_response {
+    uint32_t event; // AMC_SHMEM_RESIZE_RESPONSE
+    uint32_t handle;
+    bool success;
+    uint64_t size;
+} amc_shmem_resize_response_t;
+
+// Drops the caller's mapping of an object. No response is sent.
+#define AMC_SHMEM_UNMAP 222
+
+typedef struct amc_shmem_unmap_cmd {
+    uint32_t event; // AMC_SHMEM_UNMAP
+    uint32_t handle;
+} amc_shmem_unmap_cmd_t;
+
 void amc_core_handle_message(const char* source_service, void* buf, uint32_t buf_size);
 
 #endif
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include <kernel/multitasking/tasks/task_small.h>
 #include <kernel/assert.h>
 #include <kernel/util/amc/amc_internal.h>
+#include <kernel/util/kernel_info/kernel_info.h>
+#include "elf_image.h"
 
 void user_mode(uintptr_t stack_top, uintptr_t entry_point);
 
@@ -67,148 +69,30 @@ bool elf_validate_header(elf_header* hdr) {
 	return true;
 }
 
-bool elf_load_segment(unsigned char* src, elf_phdr* seg) {
-	if (seg->type != PT_LOAD) {
-		printf("Tried to load non-loadable segment\n");
-		return false; 
-	}
-
-	unsigned char* src_base = src + seg->offset;
-	// Check where to map the binary memory within the address space
-	uintptr_t dest_base = seg->vaddr;
-	uintptr_t dest_limit = dest_base + seg->memsz;
-
-	//printf("Page-aligned segment size: 0x%p\n", page_aligned_size);
-	printf("pid %d Allocating at 0x%p\n", getpid(), seg->vaddr);
-	// Floor the vmaddr to a page boundary
-	uintptr_t vm_page_base = seg->vaddr & PAGING_PAGE_MASK;
-	// Account for the extra bytes we may have just added via the flooring above
-	uintptr_t page_aligned_size = (seg->memsz + (seg->vaddr - vm_page_base));
-	page_aligned_size = (page_aligned_size + (PAGE_SIZE - 1)) & PAGING_PAGE_MASK;
-
-	// Map the segment memory
-	//pmm_debug_on();
-	uintptr_t* base = vas_alloc_range(vas_get_active_state(), vm_page_base, page_aligned_size, VAS_RANGE_ACCESS_LEVEL_READ_WRITE, VAS_RANGE_PRIVILEGE_LEVEL_USER);
-	//pmm_debug_off();
-	assert(base == vm_page_base, "Failed to map program at its requested address");
-
-	// Zero-out any unused bits...
-	memset(base, 0, page_aligned_size);
-	// Copy the file data, and ignore our floor() from earlier
-	memcpy(seg->vaddr, src_base, seg->filesz);
-
-	return true;
-}
-
-uintptr_t elf_load_small(unsigned char* src) {
-	elf_header* hdr = (elf_header*)src;
-	uintptr_t phdr_table_addr = (uintptr_t)hdr + hdr->phoff;
-
-	int segcount = hdr->phnum; 
-	task_assert(segcount > 0, "No loadable segments in ELF", NULL);
-
-	printf("[%d] Loading %d ELF segments\n", getpid(), segcount);
-	bool found_loadable_seg = false;
-	for (int i = 0; i < segcount; i++) {
-		elf_phdr* segment = (elf_phdr*)(phdr_table_addr + (i * hdr->phentsize));
-		if (elf_load_segment(src, segment)) {
-			found_loadable_seg = true;
-		}
-	}
-
-	//return entry point
-	if (found_loadable_seg) {
-		return hdr->entry;
-	}
-
-	task_assert(segcount > 0, "Failed to find an entry point", NULL);
-	return 0;
-}
-
-char* elf_get_string_table(void* file, uint32_t binary_size) {
-	elf_header* hdr = (elf_header*)file;
-	char* string_table;
-	uint32_t i = 0;
-	for (int x = 0; x < hdr->shentsize * hdr->shnum; x += hdr->shentsize) {
-		task_assert(hdr->shoff + x<= binary_size, "Tried to read beyond the end of an ELF", NULL);
-
-		elf_s_header* shdr = (elf_s_header*)(file + (hdr->shoff + x));
-		if (i == hdr->shstrndx) {
-			string_table = (char *)(file + shdr->offset);
-			return string_table;
-		}
-		i++;
-	}
-	return NULL;
-}
-
-static void _record_elf_symbol_table(void* buf, elf_t* elf) {
-	elf_header* hdr = (elf_header*)buf;
-	elf_s_header* shstrtab = (uint8_t*)((uint8_t*)buf + hdr->shoff + (hdr->shstrndx * hdr->shentsize));
-	uint8_t* strtab = (uint8_t*)buf + shstrtab->offset;
-
-	for (int i = 0; i < hdr->shentsize * hdr->shnum; i += hdr->shentsize) {
-		elf_s_header* shdr = (elf_s_header*)(buf + (hdr->shoff + i));
-		if (shdr->type == 0) continue;
-		uint8_t* name = strtab + shdr->name;
-		if (!strcmp(name, ".strtab")) {
-			elf->strtab = (const char*)((uint8_t*)buf + shdr->offset);
-			elf->strtabsz = shdr->size;
-		}
-		if (!strcmp(name, ".symtab")) {
-			elf->symtab = (elf_symbol_t *)((uint8_t *) buf + shdr->offset);
-			elf->symtabsz = shdr->size;
-		}
-	}
-}
-
 // TODO(PT): Ensure this is in the sysroot
 //#include <sys/axle/syscalls.h>
 
 void elf_load_buffer(char* program_name, char** argv, uint8_t* buf, uint32_t buf_size, bool free_buffer) {
-	printf("ELF loading %s for PID %d\n", program_name, getpid());
-	elf_header* hdr = (elf_header*)buf;
-
-	// Note that since we don't call this through a syscall, we have no register state available
-	task_assert(elf_validate_header(hdr), "ELF header validation failed", NULL);
-
-	task_small_t* current_task = tasking_get_task_with_pid(getpid());
-    char* string_table = elf_get_string_table(hdr, buf_size);
-
-    // Copy the strings/symbols data to the heap, since we're freeing the underlying ELF buffer later on
-    elf_t symbols_data;
-	_record_elf_symbol_table(buf, &symbols_data);
-    void* string_table_copy = kmalloc(symbols_data.strtabsz);
-    memcpy(string_table_copy, symbols_data.strtab, symbols_data.strtabsz);
-    current_task->elf_symbol_table.strtabsz = symbols_data.strtabsz;
-    current_task->elf_symbol_table.strtab = string_table_copy;
-
-    void* symbol_table_copy = kmalloc(symbols_data.symtabsz);
-    memcpy(symbol_table_copy, symbols_data.symtab, symbols_data.symtabsz);
-    current_task->elf_symbol_table.symtabsz = symbols_data.symtabsz;
-    current_task->elf_symbol_table.symtab = symbol_table_copy;
-
-	uintptr_t prog_break = 0;
-	uintptr_t bss_loc = 0;
-	for (int x = 0; x < hdr->shentsize * hdr->shnum; x += hdr->shentsize) {
-		task_assert(hdr->shoff + x<= buf_size, "Tried to read beyond the end of an ELF", NULL);
-
-		elf_s_header* shdr = (elf_s_header*)((uintptr_t)buf + (hdr->shoff + x));
-		char* section_name = (char*)((uintptr_t)string_table + shdr->name);
-
-		//alloc memory for .bss segment
-		if (!strcmp(section_name, ".bss")) {
-			//set program break to .bss segment
-			prog_break = shdr->addr + shdr->size;
-			bss_loc = shdr->addr;
-		}
-	}
-
-	uintptr_t entry_point = elf_load_small((unsigned char*)buf);
+	// The buffer isn't a view of the initrd, so the image can't be cached
+	elf_image_t* image = elf_image_for_buffer(program_name, buf, buf_size, 0);
 	if (free_buffer) {
 		printf("[ELF] Freeing buffer 0x%p\n", buf);
 		kfree(buf);
 	}
+	// Note that since we don't call this through a syscall, we have no register state available
+	task_assert(image != NULL, "ELF validation failed", NULL);
+	elf_load_image(program_name, argv, image);
+}
+
+void elf_load_image(char* program_name, char** argv, elf_image_t* image) {
+	printf("ELF loading %s for PID %d\n", program_name, getpid());
+	task_small_t* current_task = tasking_get_task_with_pid(getpid());
+
+	// Text and read-only data are shared with every other instance of the program, and data is copy-on-write
+	elf_image_map_into_vas(image, vas_get_active_state());
+	uintptr_t entry_point = image->entry_point;
+	uintptr_t prog_break = image->prog_break;
+	uintptr_t bss_loc = image->bss_loc;
 
 	task_assert(entry_point != 0, "Failed to find an ELF entry point", NULL);
 
@@ -229,6 +113,9 @@ void elf_load_buffer(char* program_name, char** argv, uint8_t* buf, uint32_t buf
 		VAS_RANGE_ACCESS_LEVEL_READ_WRITE, VAS_RANGE_PRIVILEGE_LEVEL_USER
 	);
 	printf("[%d] allocated ELF stack at 0x%08x\n", getpid(), stack_bottom);
+
+	// Allow the program to read the clock and its PID without making syscalls
+	kernel_info_map_into_process(vas_get_active_state(), current_task->id);
     uintptr_t *stack_top = (uintptr_t *)(stack_bottom + stack_size); // point to top of malloc'd stack
 	uintptr_t* stack_top_orig = stack_top;
 	printf("[%d] Set ESP to 0x%08x\n", getpid(), stack_top);
@@ -256,6 +143,9 @@ void elf_load_buffer(char* program_name, char** argv, uint8_t* buf, uint32_t buf
 	//printf("Set elf->machine_state = 0x%08x\n", stack_top);
     spinlock_acquire(&current_task->lock);
     // TODO(PT): Per-task lock?
+	// The task's reference to the image is dropped when it dies
+	current_task->elf_image = image;
+	current_task->elf_symbol_table = image->symbol_table;
 	current_task->machine_state = (task_context_t*)stack_top;
     current_task->sbrk_base = prog_break;
 	current_task->sbrk_current_break = prog_break;
@@ -164,6 +164,18 @@ enum elf_rt_types {
 #define PT_DYNAMIC	2
 #define PT_INTERP	3
 
+// Segment permission flags
+#define PF_X		(1 << 0)
+#define PF_W		(1 << 1)
+#define PF_R		(1 << 2)
+
+struct elf_image;
+
+bool elf_validate_header(elf_header* hdr);
+
 void elf_load_buffer(char* program_name, char** argv, uint8_t* buf, uint32_t buf_size, bool free_buffer);
+// Maps the image into the current task's address space and jumps to its entry point
+// Takes ownership of the caller's reference to the image
+void elf_load_image(char* program_name, char** argv, struct elf_image* image);
 
 #endif
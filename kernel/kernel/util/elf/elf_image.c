@@ -0,0 +1,314 @@
+#include "elf_image.h"
+#include "elf.h"
+
+#include <std/kheap.h>
+#include <std/math.h>
+#include <std/memory.h>
+#include <std/printf.h>
+#include <std/string.h>
+
+#include <kernel/pmm/pmm.h>
+#include <kernel/drivers/pit/pit.h>
+#include <kernel/assert.h>
+#include <kernel/util/spinlock/spinlock.h>
+
+#define ELF_IMAGE_CACHE_CAPACITY 32
+
+// Protects the cache list and every image's reference count
+static spinlock_t _elf_image_cache_lock = {.name = "[ELF image cache lock]"};
+static elf_image_t* _elf_image_cache = NULL;
+static uint32_t _elf_image_cache_count = 0;
+
+static bool _range_within_buffer(uintptr_t offset, uintptr_t size, uint32_t buf_size) {
+    return offset <= buf_size && size <= buf_size - offset;
+}
+
+static void _elf_image_destroy(elf_image_t* image) {
+    for (uint32_t i = 0; i < image->segment_count; i++) {
+        elf_image_segment_t* segment = &image->segments[i];
+        if (!segment->frames) {
+            continue;
+        }
+        for (uint32_t j = 0; j < segment->page_count; j++) {
+            if (segment->frames[j]) {
+                pmm_free(segment->frames[j]);
+            }
+        }
+        kfree(segment->frames);
+    }
+    kfree(image->segments);
+    if (image->symbol_table.strtab) {
+        kfree((void*)image->symbol_table.strtab);
+    }
+    if (image->symbol_table.symtab) {
+        kfree(image->symbol_table.symtab);
+    }
+    kfree(image);
+}
+
+// Copies the symbol and string tables, and finds the .bss section to set up the program break
+static bool _elf_image_record_sections(elf_image_t* image, uint8_t* buf, uint32_t buf_size) {
+    elf_header* hdr = (elf_header*)buf;
+    if (!hdr->shnum) {
+        return true;
+    }
+    if (hdr->shentsize < sizeof(elf_s_header) || !_range_within_buffer(hdr->shoff, hdr->shentsize * hdr->shnum, buf_size) || hdr->shstrndx >= hdr->shnum) {
+        printf("[ELF] Section header table lies outside the file\n");
+        return false;
+    }
+
+    elf_s_header* shstrtab = (elf_s_header*)(buf + hdr->shoff + (hdr->shstrndx * hdr->shentsize));
+    if (!_range_within_buffer(shstrtab->offset, shstrtab->size, buf_size)) {
+        printf("[ELF] Section name table lies outside the file\n");
+        return false;
+    }
+    const char* section_names = (const char*)(buf + shstrtab->offset);
+
+    for (uint32_t i = 0; i < hdr->shnum; i++) {
+        elf_s_header* shdr = (elf_s_header*)(buf + hdr->shoff + (i * hdr->shentsize));
+        if (shdr->type == 0 || shdr->name >= shstrtab->size) {
+            continue;
+        }
+        const char* name = section_names + shdr->name;
+        bool is_strtab = !strncmp(name, ".strtab", shstrtab->size - shdr->name);
+        bool is_symtab = !strncmp(name, ".symtab", shstrtab->size - shdr->name);
+        if (!strncmp(name, ".bss", shstrtab->size - shdr->name)) {
+            // Set the program break to the end of the .bss section
+            image->bss_loc = shdr->addr;
+            image->prog_break = shdr->addr + shdr->size;
+        }
+        if (!is_strtab && !is_symtab) {
+            continue;
+        }
+        if (!_range_within_buffer(shdr->offset, shdr->size, buf_size)) {
+            printf("[ELF] Symbol data lies outside the file\n");
+            return false;
+        }
+        void* copy = kmalloc_tagged(shdr->size, KHEAP_TAG_ELF);
+        memcpy(copy, buf + shdr->offset, shdr->size);
+        if (is_strtab) {
+            image->symbol_table.strtab = (const char*)copy;
+            image->symbol_table.strtabsz = shdr->size;
+        }
+        else {
+            image->symbol_table.symtab = (elf_symbol_t*)copy;
+            image->symbol_table.symtabsz = shdr->size;
+        }
+    }
+    return true;
+}
+
+static bool _elf_image_build_segment(elf_image_segment_t* out, uint8_t* buf, uint32_t buf_size, elf_phdr* seg) {
+    if (!_range_within_buffer(seg->offset, seg->filesz, buf_size) || seg->filesz > seg->memsz) {
+        printf("[ELF] Segment data lies outside the file\n");
+        return false;
+    }
+    if (seg->vaddr >= USER_MODE_STACK_BOTTOM || seg->memsz > USER_MODE_STACK_BOTTOM - seg->vaddr) {
+        printf("[ELF] Segment at 0x%p lies outside the program's address space\n", seg->vaddr);
+        return false;
+    }
+
+    // Floor the vmaddr to a page boundary
+    out->vm_page_base = seg->vaddr & PAGING_PAGE_MASK;
+    // Account for the extra bytes we may have just added via the flooring above
+    uintptr_t page_aligned_size = (seg->memsz + (seg->vaddr - out->vm_page_base));
+    page_aligned_size = (page_aligned_size + (PAGE_SIZE - 1)) & PAGING_PAGE_MASK;
+    out->page_count = page_aligned_size / PAGE_SIZE;
+    out->writable = (seg->flags & PF_W) != 0;
+    out->frames = kcalloc_tagged(out->page_count, sizeof(uint64_t), KHEAP_TAG_ELF);
+
+    uintptr_t file_data_end = seg->vaddr + seg->filesz;
+    for (uint32_t i = 0; i < out->page_count; i++) {
+        // Frames are handed out zeroed, so only the file data needs to be copied
+        out->frames[i] = pmm_alloc();
+
+        uintptr_t page_start = out->vm_page_base + (i * PAGE_SIZE);
+        uintptr_t copy_start = max(page_start, seg->vaddr);
+        uintptr_t copy_end = min(page_start + PAGE_SIZE, file_data_end);
+        if (copy_start < copy_end) {
+            memcpy(
+                (void*)(PMA_TO_VMA(out->frames[i]) + (copy_start - page_start)),
+                buf + seg->offset + (copy_start - seg->vaddr),
+                copy_end - copy_start
+            );
+        }
+    }
+    return true;
+}
+
+static bool _elf_image_segments_overlap(elf_image_segment_t* a, elf_image_segment_t* b) {
+    uintptr_t a_end = a->vm_page_base + (a->page_count * PAGE_SIZE);
+    uintptr_t b_end = b->vm_page_base + (b->page_count * PAGE_SIZE);
+    return a->vm_page_base < b_end && b->vm_page_base < a_end;
+}
+
+static elf_image_t* _elf_image_build(const char* program_name, uint8_t* buf, uint32_t buf_size) {
+    elf_header* hdr = (elf_header*)buf;
+    if (buf_size < sizeof(elf_header) || !elf_validate_header(hdr)) {
+        printf("[ELF] %s: header validation failed\n", program_name);
+        return NULL;
+    }
+    if (hdr->phentsize < sizeof(elf_phdr) || !_range_within_buffer(hdr->phoff, hdr->phentsize * hdr->phnum, buf_size)) {
+        printf("[ELF] %s: program header table lies outside the file\n", program_name);
+        return NULL;
+    }
+
+    elf_image_t* image = kcalloc_tagged(1, sizeof(elf_image_t), KHEAP_TAG_ELF);
+    image->entry_point = hdr->entry;
+    image->segments = kcalloc_tagged(max(hdr->phnum, 1), sizeof(elf_image_segment_t), KHEAP_TAG_ELF);
+
+    if (!_elf_image_record_sections(image, buf, buf_size)) {
+        _elf_image_destroy(image);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < hdr->phnum; i++) {
+        elf_phdr* seg = (elf_phdr*)(buf + hdr->phoff + (i * hdr->phentsize));
+        if (seg->type != PT_LOAD) {
+            continue;
+        }
+        elf_image_segment_t* segment = &image->segments[image->segment_count++];
+        if (!_elf_image_build_segment(segment, buf, buf_size, seg)) {
+            _elf_image_destroy(image);
+            return NULL;
+        }
+        // Each page can only be mapped once, so segments must not share pages
+        for (uint32_t j = 0; j < image->segment_count - 1; j++) {
+            if (_elf_image_segments_overlap(segment, &image->segments[j])) {
+                printf("[ELF] %s: loadable segments share a page\n", program_name);
+                _elf_image_destroy(image);
+                return NULL;
+            }
+        }
+    }
+
+    if (!image->segment_count || !image->entry_point) {
+        printf("[ELF] %s: no loadable segments or entry point\n", program_name);
+        _elf_image_destroy(image);
+        return NULL;
+    }
+    return image;
+}
+
+// Must be called with the cache lock held
+static elf_image_t* _elf_image_cache_find(uintptr_t source_phys_addr, uint32_t source_size) {
+    for (elf_image_t* image = _elf_image_cache; image != NULL; image = image->next) {
+        if (image->source_phys_addr == source_phys_addr && image->source_size == source_size) {
+            return image;
+        }
+    }
+    return NULL;
+}
+
+// Unlinks the least recently used image that no task is running, if any
+// Must be called with the cache lock held
+static elf_image_t* _elf_image_cache_evict(void) {
+    elf_image_t* victim = NULL;
+    for (elf_image_t* image = _elf_image_cache; image != NULL; image = image->next) {
+        // The only reference is the cache's
+        if (image->reference_count == 1 && (!victim || image->last_used_ms < victim->last_used_ms)) {
+            victim = image;
+        }
+    }
+    if (!victim) {
+        return NULL;
+    }
+
+    for (elf_image_t** link = &_elf_image_cache; *link != NULL; link = &(*link)->next) {
+        if (*link == victim) {
+            *link = victim->next;
+            break;
+        }
+    }
+    _elf_image_cache_count -= 1;
+    return victim;
+}
+
+elf_image_t* elf_image_for_buffer(const char* program_name, uint8_t* buf, uint32_t buf_size, uintptr_t source_phys_addr) {
+    if (source_phys_addr) {
+        spinlock_acquire(&_elf_image_cache_lock);
+        elf_image_t* cached = _elf_image_cache_find(source_phys_addr, buf_size);
+        if (cached) {
+            cached->reference_count += 1;
+            cached->last_used_ms = ms_since_boot();
+        }
+        spinlock_release(&_elf_image_cache_lock);
+        if (cached) {
+            printf("[ELF] Reusing cached image for %s\n", program_name);
+            return cached;
+        }
+    }
+
+    elf_image_t* image = _elf_image_build(program_name, buf, buf_size);
+    if (!image || !source_phys_addr) {
+        if (image) {
+            image->reference_count = 1;
+        }
+        return image;
+    }
+
+    image->source_phys_addr = source_phys_addr;
+    image->source_size = buf_size;
+    image->last_used_ms = ms_since_boot();
+    // One reference for the caller, and one for the cache
+    image->reference_count = 2;
+
+    spinlock_acquire(&_elf_image_cache_lock);
+    // Another core may have built the same image in the meantime
+    elf_image_t* cached = _elf_image_cache_find(source_phys_addr, buf_size);
+    elf_image_t* evicted = NULL;
+    if (cached) {
+        cached->reference_count += 1;
+    }
+    else {
+        if (_elf_image_cache_count >= ELF_IMAGE_CACHE_CAPACITY) {
+            evicted = _elf_image_cache_evict();
+        }
+        if (_elf_image_cache_count < ELF_IMAGE_CACHE_CAPACITY) {
+            image->next = _elf_image_cache;
+            _elf_image_cache = image;
+            _elf_image_cache_count += 1;
+        }
+        else {
+            // Every cached image is running, so nothing can be evicted. Hand the image to the caller uncached.
+            image->reference_count = 1;
+        }
+    }
+    spinlock_release(&_elf_image_cache_lock);
+
+    if (evicted) {
+        _elf_image_destroy(evicted);
+    }
+    if (cached) {
+        _elf_image_destroy(image);
+        return cached;
+    }
+    return image;
+}
+
+void elf_image_retain(elf_image_t* image) {
+    spinlock_acquire(&_elf_image_cache_lock);
+    image->reference_count += 1;
+    spinlock_release(&_elf_image_cache_lock);
+}
+
+void elf_image_release(elf_image_t* image) {
+    spinlock_acquire(&_elf_image_cache_lock);
+    assert(image->reference_count > 0, "ELF image over-released");
+    image->reference_count -= 1;
+    bool should_destroy = image->reference_count == 0;
+    spinlock_release(&_elf_image_cache_lock);
+
+    // Cached images always hold the cache's reference, so this image isn't in the cache
+    if (should_destroy) {
+        _elf_image_destroy(image);
+    }
+}
+
+void elf_image_map_into_vas(elf_image_t* image, vas_state_t* vas) {
+    for (uint32_t i = 0; i < image->segment_count; i++) {
+        elf_image_segment_t* segment = &image->segments[i];
+        // Writable segments are only ever written to through private copies, so every instance sees the original contents
+        vas_map_shared_frames(vas, segment->vm_page_base, segment->page_count, segment->frames, segment->writable);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef ELF_IMAGE_H
+#define ELF_IMAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/elf.h>
+#include <kernel/vmm/vmm.h>
+
+// A program's loadable segments, laid out in frames that are mapped into each instance of the program.
+// Read-only segments (text and rodata) are shared outright, and writable segments are shared
+// copy-on-write, so launching another instance of a program doesn't copy anything.
+// Images built from the initrd are cached by their location in the initrd, which can never change
+// (file_server only gets a read-only mapping of it). The cache holds at most ELF_IMAGE_CACHE_CAPACITY images.
+
+typedef struct elf_image_segment {
+    uintptr_t vm_page_base;
+    uint32_t page_count;
+    bool writable;
+    // Each frame holds a reference owned by the image
+    uint64_t* frames;
+} elf_image_segment_t;
+
+typedef struct elf_image {
+    // Physical address of the file the image was built from, or 0 if the image isn't cached
+    uintptr_t source_phys_addr;
+    uint32_t source_size;
+
+    uintptr_t entry_point;
+    uintptr_t bss_loc;
+    uintptr_t prog_break;
+    // Shared by every instance of the program
+    elf_t symbol_table;
+
+    uint32_t segment_count;
+    elf_image_segment_t* segments;
+
+    // One per task running the image, plus one while the image is cached
+    uint32_t reference_count;
+    uint64_t last_used_ms;
+    struct elf_image* next;
+} elf_image_t;
+
+// Returns a referenced image for the ELF in buf, building it if necessary, or NULL if the ELF isn't loadable
+// If source_phys_addr is non-zero, the buffer must be an immutable view of that physical range,
+// and the image is cached for later calls with the same source
+elf_image_t* elf_image_for_buffer(const char* program_name, uint8_t* buf, uint32_t buf_size, uintptr_t source_phys_addr);
+
+void elf_image_retain(elf_image_t* image);
+void elf_image_release(elf_image_t* image);
+
+// Maps the image's segments into the provided address space
+void elf_image_map_into_vas(elf_image_t* image, vas_state_t* vas);
+
+#endif
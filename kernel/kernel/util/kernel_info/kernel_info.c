@@ -0,0 +1,136 @@
+#include <std/common.h>
+#include <std/memory.h>
+#include <std/printf.h>
+#include <kernel/pmm/pmm.h>
+#include <kernel/vmm/vmm.h>
+
+#include "kernel_info.h"
+
+// How long to observe the TSC against the timer before trusting it for interpolation
+#define TSC_CALIBRATION_PERIOD_MS 100
+
+static uintptr_t _kernel_info_frame = 0;
+static kernel_info_t* _kernel_info = NULL;
+
+static bool _tsc_is_invariant = false;
+static uint64_t _tsc_calibration_start_tsc = 0;
+static uint64_t _tsc_calibration_start_ms = 0;
+
+static uint64_t _rdtsc(void) {
+    uint32_t low;
+    uint32_t high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static bool _cpu_has_invariant_tsc(void) {
+    uint32_t eax = 0;
+    uint32_t edx = 0;
+    cpuid(0x80000000, &eax, &edx);
+    if (eax < 0x80000007) {
+        return false;
+    }
+    // Advanced power management leaf
+    cpuid(0x80000007, &eax, &edx);
+    return (edx & (1 << 8)) != 0;
+}
+
+void kernel_info_init(void) {
+    _kernel_info_frame = pmm_alloc();
+    kernel_info_t* info = (kernel_info_t*)PMA_TO_VMA(_kernel_info_frame);
+    memset(info, 0, PAGE_SIZE);
+    // The BSP
+    info->cpu_count = 1;
+
+    // If the TSC might change rate or stop, readers have to make do with the tick count
+    _tsc_is_invariant = _cpu_has_invariant_tsc();
+    printf("[Kernel info] Shared page at phys 0x%p, invariant TSC: %d\n", _kernel_info_frame, _tsc_is_invariant);
+
+    _kernel_info = info;
+}
+
+void kernel_info_publish_clock(uint64_t ms_since_boot, uint32_t ms_per_tick) {
+    kernel_info_t* info = _kernel_info;
+    if (!info) {
+        return;
+    }
+    uint64_t tsc = _rdtsc();
+
+    // Derive the TSC rate from the timer, once enough time has passed for the measurement to be meaningful
+    uint64_t tsc_ticks_per_ms = info->tsc_ticks_per_ms;
+    if (_tsc_is_invariant && !tsc_ticks_per_ms) {
+        if (!_tsc_calibration_start_tsc) {
+            _tsc_calibration_start_tsc = tsc;
+            _tsc_calibration_start_ms = ms_since_boot;
+        }
+        else if (ms_since_boot - _tsc_calibration_start_ms >= TSC_CALIBRATION_PERIOD_MS) {
+            tsc_ticks_per_ms = (tsc - _tsc_calibration_start_tsc) / (ms_since_boot - _tsc_calibration_start_ms);
+        }
+    }
+
+    info->clock_sequence += 1;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    info->ms_per_tick = ms_per_tick;
+    info->ms_since_boot = ms_since_boot;
+    info->tsc_at_last_tick = tsc;
+    info->tsc_ticks_per_ms = tsc_ticks_per_ms;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    info->clock_sequence += 1;
+}
+
+uint64_t kernel_info_us_since_boot(void) {
+    kernel_info_t* info = _kernel_info;
+    if (!info) {
+        return 0;
+    }
+    uint32_t sequence;
+    uint64_t ms;
+    uint64_t tsc_at_last_tick;
+    uint64_t tsc_ticks_per_ms;
+    uint32_t ms_per_tick;
+    // Retry if the clock was updated on another core while we read it
+    do {
+        sequence = info->clock_sequence;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        ms = info->ms_since_boot;
+        tsc_at_last_tick = info->tsc_at_last_tick;
+        tsc_ticks_per_ms = info->tsc_ticks_per_ms;
+        ms_per_tick = info->ms_per_tick;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((sequence & 1) || sequence != info->clock_sequence);
+
+    uint64_t us = ms * 1000;
+    // Interpolate within the current tick, but never run ahead of the next one
+    uint64_t tsc = _rdtsc();
+    if (tsc_ticks_per_ms && tsc > tsc_at_last_tick) {
+        uint64_t elapsed_us = ((tsc - tsc_at_last_tick) * 1000) / tsc_ticks_per_ms;
+        uint64_t tick_us = ms_per_tick * 1000;
+        if (elapsed_us >= tick_us) {
+            elapsed_us = tick_us - 1;
+        }
+        us += elapsed_us;
+    }
+    return us;
+}
+
+void kernel_info_register_cpu(void) {
+    __atomic_fetch_add(&_kernel_info->cpu_count, 1, __ATOMIC_RELAXED);
+}
+
+void kernel_info_map_into_process(void* vas_state, uint64_t pid) {
+    vas_state_t* vas = (vas_state_t*)vas_state;
+
+    // The shared page is referenced by every process, and is never freed
+    // Each mapping takes its own reference, so clones of the address space can share the page too
+    uint64_t kernel_info_frame = _kernel_info_frame;
+    vas_map_shared_frames(vas, KERNEL_INFO_BASE, 1, &kernel_info_frame, false);
+
+    // The process page is freed along with the address space
+    uint64_t process_info_frame = pmm_alloc();
+    kernel_process_info_t* process_info = (kernel_process_info_t*)PMA_TO_VMA(process_info_frame);
+    memset(process_info, 0, PAGE_SIZE);
+    process_info->pid = pid;
+    vas_map_shared_frames(vas, KERNEL_INFO_PROCESS_BASE, 1, &process_info_frame, false);
+    // The mapping now holds the only reference
+    pmm_free(process_info_frame);
+}
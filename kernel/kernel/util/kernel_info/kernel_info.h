@@ -0,0 +1,49 @@
+#ifndef KERNEL_INFO_H
+#define KERNEL_INFO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Every process has two read-only pages mapped at this address, which the kernel publishes into.
+// They allow processes to read frequently-requested kernel state without making a syscall.
+// The first page is shared by every process, and the second is specific to the process.
+// The pages are mapped at a fixed address, so they sit below every range allocator's base (0x7c0000000000 and up).
+// Those allocators only search upwards from their base, so they'll never be asked to place anything here.
+#define KERNEL_INFO_BASE 0x7b0000000000LL
+#define KERNEL_INFO_PROCESS_BASE (KERNEL_INFO_BASE + 0x1000)
+
+typedef struct kernel_info {
+    // Incremented before and after the clock fields are updated, so it's odd while an update is in progress.
+    // Readers should retry if it was odd, or if it changed while they were reading.
+    volatile uint32_t clock_sequence;
+    uint32_t ms_per_tick;
+    volatile uint64_t ms_since_boot;
+    // TSC value when ms_since_boot was last updated, to interpolate between ticks
+    volatile uint64_t tsc_at_last_tick;
+    // Zero if the TSC can't be used to interpolate between ticks
+    volatile uint64_t tsc_ticks_per_ms;
+    volatile uint32_t cpu_count;
+} kernel_info_t;
+
+typedef struct kernel_process_info {
+    uint64_t pid;
+} kernel_process_info_t;
+
+// ############
+// Called internally from kernel mode
+// ############
+
+void kernel_info_init(void);
+
+// Invoked on each timer tick
+void kernel_info_publish_clock(uint64_t ms_since_boot, uint32_t ms_per_tick);
+// Microsecond-resolution clock, interpolated between timer ticks with the TSC when it's usable.
+// Otherwise, this only advances once per tick.
+uint64_t kernel_info_us_since_boot(void);
+// Invoked as each core comes online
+void kernel_info_register_cpu(void);
+
+// Map the kernel info pages into a process's address space
+void kernel_info_map_into_process(void* vas_state, uint64_t pid);
+
+#endif
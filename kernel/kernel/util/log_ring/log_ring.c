@@ -0,0 +1,184 @@
+#include "log_ring.h"
+
+#include <std/kheap.h>
+#include <std/memory.h>
+#include <std/string.h>
+#include <std/math.h>
+
+#include <kernel/smp.h>
+#include <kernel/drivers/pit/pit.h>
+#include <kernel/multitasking/tasks/task_small.h>
+
+typedef struct log_ring {
+    log_entry_t entries[LOG_RING_ENTRY_COUNT];
+    // Only ever written by the owning core
+    uint64_t write_count;
+    bool at_line_start;
+} log_ring_t;
+
+// The BSP logs long before the heap is available, so its ring is allocated statically
+static log_ring_t _bsp_ring = {.at_line_start = true};
+static log_ring_t* _rings[LOG_RING_MAX_CORES] = {&_bsp_ring};
+
+// Shared by every core, so that readers can merge the rings in the order entries were logged
+static uint64_t _next_sequence = 1;
+// Entries logged by a core whose ring hasn't been allocated yet
+static uint64_t _unattributed_drop_count = 0;
+
+static uint64_t _irq_disable_save(void) {
+    uint64_t rflags;
+    asm volatile("pushfq; popq %0; cli" : "=r"(rflags) : : "memory");
+    return rflags;
+}
+
+static void _irq_restore(uint64_t rflags) {
+    // Interrupt enable flag
+    if (rflags & (1 << 9)) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+static log_ring_t* _ring_for_core(uintptr_t core) {
+    if (core >= LOG_RING_MAX_CORES) {
+        return NULL;
+    }
+    return __atomic_load_n(&_rings[core], __ATOMIC_ACQUIRE);
+}
+
+void log_ring_register_current_core(void) {
+    uintptr_t core = cpu_id();
+    if (core >= LOG_RING_MAX_CORES || _ring_for_core(core)) {
+        return;
+    }
+    log_ring_t* ring = kcalloc_tagged(1, sizeof(log_ring_t), KHEAP_TAG_DIAGNOSTICS);
+    ring->at_line_start = true;
+    __atomic_store_n(&_rings[core], ring, __ATOMIC_RELEASE);
+}
+
+void log_ring_write(log_severity_t severity, const char* text) {
+    uint32_t length = strlen(text);
+    if (!length) {
+        return;
+    }
+
+    // With interrupts disabled, nothing else can write to this core's ring
+    uint64_t rflags = _irq_disable_save();
+    uintptr_t core = cpu_id();
+    log_ring_t* ring = _ring_for_core(core);
+    if (!ring) {
+        __atomic_fetch_add(&_unattributed_drop_count, 1, __ATOMIC_RELAXED);
+        _irq_restore(rflags);
+        return;
+    }
+
+    uint64_t timestamp_ms = ms_since_boot();
+    int32_t pid = getpid();
+
+    // Text that doesn't fit in one entry spills into the next
+    while (length > 0) {
+        uint32_t chunk_length = min(length, LOG_ENTRY_TEXT_SIZE);
+        log_entry_t* entry = &ring->entries[ring->write_count % LOG_RING_ENTRY_COUNT];
+
+        // Mark the entry invalid while it's rewritten, so readers can detect a torn copy
+        __atomic_store_n(&entry->sequence, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        entry->timestamp_ms = timestamp_ms;
+        entry->pid = pid;
+        entry->cpu = core;
+        entry->severity = severity;
+        entry->flags = ring->at_line_start ? LOG_ENTRY_FLAG_LINE_START : 0;
+        entry->length = chunk_length;
+        memcpy(entry->text, text, chunk_length);
+
+        uint64_t sequence = __atomic_fetch_add(&_next_sequence, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->sequence, sequence, __ATOMIC_RELEASE);
+        __atomic_store_n(&ring->write_count, ring->write_count + 1, __ATOMIC_RELEASE);
+
+        ring->at_line_start = text[chunk_length - 1] == '\n';
+        text += chunk_length;
+        length -= chunk_length;
+    }
+
+    _irq_restore(rflags);
+}
+
+// Returns the index of the ring whose next unread entry was logged first, or -1 if every ring has been read
+// Entries that the cursor has fallen too far behind to read are skipped and counted as dropped
+static int32_t _next_ring_to_read(log_ring_cursor_t* cursor) {
+    int32_t next_ring = -1;
+    uint64_t next_sequence = UINT64_MAX;
+    for (uint32_t i = 0; i < LOG_RING_MAX_CORES; i++) {
+        log_ring_t* ring = _ring_for_core(i);
+        if (!ring) {
+            continue;
+        }
+        uint64_t write_count = __atomic_load_n(&ring->write_count, __ATOMIC_ACQUIRE);
+        if (cursor->positions[i] >= write_count) {
+            continue;
+        }
+        if (write_count - cursor->positions[i] > LOG_RING_ENTRY_COUNT) {
+            uint64_t oldest_held = write_count - LOG_RING_ENTRY_COUNT;
+            cursor->dropped_count += oldest_held - cursor->positions[i];
+            cursor->positions[i] = oldest_held;
+        }
+
+        // An entry that's being overwritten reads as sequence 0. It'll be picked
+        // first and then discarded as torn, which is the right outcome.
+        log_entry_t* entry = &ring->entries[cursor->positions[i] % LOG_RING_ENTRY_COUNT];
+        uint64_t sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+        if (sequence < next_sequence) {
+            next_sequence = sequence;
+            next_ring = i;
+        }
+    }
+    return next_ring;
+}
+
+static bool _copy_entry(log_ring_t* ring, uint64_t position, log_entry_t* out) {
+    log_entry_t* entry = &ring->entries[position % LOG_RING_ENTRY_COUNT];
+    uint64_t sequence_before = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+    memcpy(out, entry, sizeof(log_entry_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t sequence_after = __atomic_load_n(&entry->sequence, __ATOMIC_RELAXED);
+    if (sequence_before == 0 || sequence_before != sequence_after) {
+        return false;
+    }
+    // Once the writer has caught up to this slot, its contents may already belong to a newer entry
+    uint64_t write_count = __atomic_load_n(&ring->write_count, __ATOMIC_ACQUIRE);
+    return write_count - position < LOG_RING_ENTRY_COUNT;
+}
+
+int log_ring_read(log_ring_cursor_t* cursor, log_entry_t* out, uint32_t max_entries) {
+    // Note that an entry can become visible slightly after one that was logged later on
+    // another core, so the merged order is only approximately the order entries were logged.
+    uint32_t read_count = 0;
+    while (read_count < max_entries) {
+        int32_t ring_idx = _next_ring_to_read(cursor);
+        if (ring_idx < 0) {
+            break;
+        }
+        if (_copy_entry(_ring_for_core(ring_idx), cursor->positions[ring_idx], &out[read_count])) {
+            read_count += 1;
+        }
+        else {
+            cursor->dropped_count += 1;
+        }
+        cursor->positions[ring_idx] += 1;
+    }
+    return read_count;
+}
+
+bool log_ring_has_unread(log_ring_cursor_t* cursor) {
+    for (uint32_t i = 0; i < LOG_RING_MAX_CORES; i++) {
+        log_ring_t* ring = _ring_for_core(i);
+        if (ring && cursor->positions[i] < __atomic_load_n(&ring->write_count, __ATOMIC_ACQUIRE)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t log_ring_unattributed_drop_count(void) {
+    return __atomic_load_n(&_unattributed_drop_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,66 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Kernel log output is recorded in a ring per core, rather than written straight to the serial port.
+// Each core only ever writes to its own ring, with interrupts disabled, so logging never takes a lock.
+// Readers (the serial drain and the log_ring_read syscall) each keep their own cursor, and see entries
+// from every core merged in the order they were logged. A reader that falls more than a ring's worth
+// of entries behind loses the oldest ones, and the cursor counts what was dropped.
+
+#define LOG_RING_MAX_CORES 64
+#define LOG_RING_ENTRY_COUNT 256
+#define LOG_ENTRY_TEXT_SIZE 232
+
+// printf_err(), printk_err() and failed assertions log errors. Everything else is informational.
+typedef enum log_severity {
+    LOG_SEVERITY_INFO = 0,
+    LOG_SEVERITY_ERROR = 1,
+} log_severity_t;
+
+// Set if the entry's text begins a new line of output
+#define LOG_ENTRY_FLAG_LINE_START (1 << 0)
+
+typedef struct log_entry {
+    // Order of the entry across every core. Zero while the entry is being written.
+    uint64_t sequence;
+    uint64_t timestamp_ms;
+    int32_t pid;
+    uint8_t cpu;
+    uint8_t severity;
+    uint8_t flags;
+    uint8_t length;
+    // Not NUL-terminated
+    char text[LOG_ENTRY_TEXT_SIZE];
+} log_entry_t;
+
+typedef struct log_ring_cursor {
+    // Count of entries consumed from each core's ring
+    uint64_t positions[LOG_RING_MAX_CORES];
+    // Entries that were overwritten before this cursor could read them
+    uint64_t dropped_count;
+} log_ring_cursor_t;
+
+// Copies up to max_entries of the oldest unread entries, and advances the cursor past them
+// Returns the number of entries copied
+// Zero-initialize a cursor to start at the oldest entry still held
+int log_ring_read(log_ring_cursor_t* cursor, log_entry_t* out, uint32_t max_entries);
+
+// ############
+// Called internally from kernel mode
+// ############
+
+// Allocates the ring for an AP. The BSP's ring is available from the first instruction.
+void log_ring_register_current_core(void);
+
+void log_ring_write(log_severity_t severity, const char* text);
+
+// Whether the cursor has any unread entries
+bool log_ring_has_unread(log_ring_cursor_t* cursor);
+
+// Entries that were discarded because the logging core didn't have a ring yet
+uint64_t log_ring_unattributed_drop_count(void);
+
+#endif
@@ -0,0 +1,137 @@
+#include "memory_pressure.h"
+
+#include <std/printf.h>
+#include <std/memory.h>
+#include <std/string.h>
+#include <std/common.h>
+
+#include <kernel/assert.h>
+#include <kernel/pmm/pmm.h>
+#include <kernel/multitasking/tasks/task_small.h>
+#include <kernel/util/amc/amc.h>
+#include <kernel/util/amc/amc_internal.h>
+#include <kernel/util/spinlock/spinlock.h>
+
+#define MEMORY_PRESSURE_MAX_SUBSCRIBERS 32
+#define MEMORY_PRESSURE_SAMPLE_INTERVAL_MS 100
+// While under pressure, remind subscribers this often in case their last trim wasn't enough
+#define MEMORY_PRESSURE_REMINDER_INTERVAL_MS 1000
+
+// Percentage of frames that must be free to stay out of each level
+// Indexed by amc_memory_pressure_level_t
+static const uint32_t _level_watermarks[] = {
+    0,
+    25, // LOW
+    10, // MEDIUM
+    3,  // CRITICAL
+};
+// A level is only left once free memory is this many percentage points above its watermark,
+// so that a system hovering around a watermark doesn't flood subscribers with events
+#define MEMORY_PRESSURE_HYSTERESIS_PERCENT 2
+
+static spinlock_t _subscribers_lock = {.name = "[Memory pressure subscribers lock]"};
+static char _subscribers[MEMORY_PRESSURE_MAX_SUBSCRIBERS][AMC_MAX_SERVICE_NAME_LEN] = {0};
+static uint32_t _subscriber_count = 0;
+
+static amc_memory_pressure_level_t _current_level = AMC_MEMORY_PRESSURE_NONE;
+
+amc_memory_pressure_level_t memory_pressure_current_level(void) {
+    return _current_level;
+}
+
+void memory_pressure_subscribe(const char* service_name) {
+    spinlock_acquire(&_subscribers_lock);
+    // Drop subscribers that have since died to make room
+    for (int32_t i = _subscriber_count - 1; i >= 0; i--) {
+        if (!amc_service_is_active(_subscribers[i])) {
+            _subscriber_count -= 1;
+            strncpy(_subscribers[i], _subscribers[_subscriber_count], AMC_MAX_SERVICE_NAME_LEN);
+        }
+    }
+    for (uint32_t i = 0; i < _subscriber_count; i++) {
+        if (!strncmp(_subscribers[i], service_name, AMC_MAX_SERVICE_NAME_LEN)) {
+            spinlock_release(&_subscribers_lock);
+            return;
+        }
+    }
+    if (_subscriber_count == MEMORY_PRESSURE_MAX_SUBSCRIBERS) {
+        spinlock_release(&_subscribers_lock);
+        printf("Dropping memory pressure subscription from %s: too many subscribers\n", service_name);
+        return;
+    }
+    strncpy(_subscribers[_subscriber_count++], service_name, AMC_MAX_SERVICE_NAME_LEN);
+    spinlock_release(&_subscribers_lock);
+}
+
+static amc_memory_pressure_level_t _level_for_free_percent(amc_memory_pressure_level_t current_level, uint32_t free_percent) {
+    // Find the deepest level whose watermark we're under
+    amc_memory_pressure_level_t level = AMC_MEMORY_PRESSURE_NONE;
+    for (uint32_t i = AMC_MEMORY_PRESSURE_LOW; i <= AMC_MEMORY_PRESSURE_CRITICAL; i++) {
+        if (free_percent < _level_watermarks[i]) {
+            level = i;
+        }
+    }
+    // Stay at the current level until we're comfortably above its watermark
+    if (level < current_level && free_percent < _level_watermarks[current_level] + MEMORY_PRESSURE_HYSTERESIS_PERCENT) {
+        return current_level;
+    }
+    return level;
+}
+
+static void _publish(amc_memory_pressure_level_t level, uintptr_t free_frames, uintptr_t total_frames) {
+    uintptr_t target_free_frames = (total_frames * _level_watermarks[AMC_MEMORY_PRESSURE_LOW]) / 100;
+    uint64_t bytes_to_reclaim = 0;
+    if (level != AMC_MEMORY_PRESSURE_NONE && free_frames < target_free_frames) {
+        bytes_to_reclaim = (uint64_t)(target_free_frames - free_frames) * PAGE_SIZE;
+    }
+    amc_memory_pressure_event_t msg = {
+        .event = AMC_MEMORY_PRESSURE_EVENT,
+        .level = level,
+        .free_frames = free_frames,
+        .total_frames = total_frames,
+        .bytes_to_reclaim = bytes_to_reclaim,
+    };
+
+    // Sending may allocate and take AMC's locks, so work from a copy of the subscriber list
+    char subscribers[MEMORY_PRESSURE_MAX_SUBSCRIBERS][AMC_MAX_SERVICE_NAME_LEN];
+    spinlock_acquire(&_subscribers_lock);
+    uint32_t subscriber_count = _subscriber_count;
+    memcpy(subscribers, _subscribers, sizeof(subscribers[0]) * subscriber_count);
+    spinlock_release(&_subscribers_lock);
+
+    for (uint32_t i = 0; i < subscriber_count; i++) {
+        if (amc_service_is_active(subscribers[i])) {
+            amc_message_send__from_core(subscribers[i], &msg, sizeof(msg));
+        }
+    }
+}
+
+static void _sleep(uint32_t ms) {
+    uint32_t msg[2] = {AMC_SLEEP_UNTIL_TIMESTAMP, ms};
+    amc_message_send(AXLE_CORE_SERVICE_NAME, &msg, sizeof(msg));
+}
+
+void memory_pressure_monitor_task(void) {
+    amc_register_service(MEMORY_PRESSURE_SERVICE_NAME);
+
+    uint32_t ms_since_last_event = 0;
+    while (true) {
+        uintptr_t total_frames = pmm_total_frame_count();
+        uintptr_t free_frames = pmm_free_frame_count();
+        uint32_t free_percent = total_frames ? (free_frames * 100) / total_frames : 100;
+
+        amc_memory_pressure_level_t level = _level_for_free_percent(_current_level, free_percent);
+        bool should_remind = level != AMC_MEMORY_PRESSURE_NONE && ms_since_last_event >= MEMORY_PRESSURE_REMINDER_INTERVAL_MS;
+        if (level != _current_level || should_remind) {
+            if (level != _current_level) {
+                printf("Memory pressure level %d -> %d (%d of %d frames free)\n", _current_level, level, free_frames, total_frames);
+            }
+            _current_level = level;
+            _publish(level, free_frames, total_frames);
+            ms_since_last_event = 0;
+        }
+
+        _sleep(MEMORY_PRESSURE_SAMPLE_INTERVAL_MS);
+        ms_since_last_event += MEMORY_PRESSURE_SAMPLE_INTERVAL_MS;
+    }
+}
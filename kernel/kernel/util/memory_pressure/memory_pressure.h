@@ -0,0 +1,23 @@
+#ifndef MEMORY_PRESSURE_H
+#define MEMORY_PRESSURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <kernel/util/amc/core_commands.h>
+
+// Watches the PMM's free-frame count and tells subscribed services when physical memory runs low,
+// so that they can trim their caches before allocations start failing.
+// The PMM can't send AMC messages itself (it sits underneath the heap that AMC allocates from),
+// so a kernel task samples the free-frame count periodically and publishes level changes.
+
+#define MEMORY_PRESSURE_SERVICE_NAME "com.axle.memory_pressure"
+
+// Entry point of the kernel task that samples the PMM and publishes events
+void memory_pressure_monitor_task(void);
+
+// Registers the service to receive AMC_MEMORY_PRESSURE_EVENT messages
+void memory_pressure_subscribe(const char* service_name);
+
+amc_memory_pressure_level_t memory_pressure_current_level(void);
+
+#endif
@@ -0,0 +1,216 @@
+#include "profiler.h"
+
+#include <std/kheap.h>
+#include <std/math.h>
+#include <std/memory.h>
+#include <std/printf.h>
+#include <std/string.h>
+
+#include <kernel/assert.h>
+#include <kernel/boot_info.h>
+#include <kernel/smp.h>
+#include <kernel/vmm/vmm.h>
+#include <kernel/interrupts/interrupts.h>
+#include <kernel/drivers/pit/pit.h>
+#include <kernel/multitasking/tasks/task_small.h>
+#include <kernel/util/elf/elf_image.h>
+#include <kernel/util/spinlock/spinlock.h>
+
+#define PROFILER_SAMPLES_PER_CPU 512
+
+uintptr_t idt_allocate_vector(void);
+void local_apic_send_fixed_ipi(uint8_t int_vector, uintptr_t apic_id);
+
+// Single-producer, single-consumer ring
+// Only the owning core writes samples, from interrupt context, and readers hold the read lock
+typedef struct profiler_cpu_buffer {
+    profiler_sample_t samples[PROFILER_SAMPLES_PER_CPU];
+    uint64_t write_count;
+    uint64_t read_count;
+    uint64_t dropped_count;
+} profiler_cpu_buffer_t;
+
+static profiler_cpu_buffer_t* _cpu_buffers[MAX_PROCESSORS] = {0};
+static uintptr_t _core_apic_ids[MAX_PROCESSORS] = {0};
+static uint8_t _sample_int_vector = 0;
+
+static bool _sampling_active = false;
+static uint32_t _ticks_per_sample = 1;
+// Only touched by the BSP's PIT handler
+static uint32_t _ticks_since_sample = 0;
+
+static spinlock_t _read_lock = {.name = "[Profiler read lock]"};
+
+static bool _walk_stays_in_mode(uintptr_t addr, bool user_mode) {
+    // Don't follow a chain of frames from user space into the kernel, or vice versa
+    return user_mode ? addr < USER_MODE_STACK_TOP : addr >= KERNEL_MEMORY_BASE;
+}
+
+static void _record_sample(register_state_t* regs) {
+    uintptr_t core = cpu_id();
+    profiler_cpu_buffer_t* buffer = core < MAX_PROCESSORS ? _cpu_buffers[core] : NULL;
+    if (!buffer) {
+        return;
+    }
+    uint64_t read_count = __atomic_load_n(&buffer->read_count, __ATOMIC_ACQUIRE);
+    if (buffer->write_count - read_count >= PROFILER_SAMPLES_PER_CPU) {
+        // Keep the samples that are already waiting, so that the profile has no holes in the middle
+        buffer->dropped_count += 1;
+        return;
+    }
+
+    profiler_sample_t* sample = &buffer->samples[buffer->write_count % PROFILER_SAMPLES_PER_CPU];
+    sample->timestamp_ms = ms_since_boot();
+    sample->pid = getpid();
+    sample->cpu = core;
+    sample->user_mode = (regs->cs & 0x3) == 0x3;
+    sample->frames[0] = regs->return_rip;
+    sample->frame_count = 1;
+
+    // Follow the frame pointer chain. Frames are only read once the page tables say
+    // they're mapped, which is safe to check from interrupt context.
+    vas_state_t* vas = vas_get_active_state();
+    uintptr_t rbp = regs->rbp;
+    while (sample->frame_count < PROFILER_MAX_FRAMES) {
+        if (!rbp || (rbp & 0x7) || !_walk_stays_in_mode(rbp, sample->user_mode)) {
+            break;
+        }
+        // Each frame holds the caller's frame pointer, followed by the return address
+        if (!vas_is_page_mapped(vas, rbp) || !vas_is_page_mapped(vas, rbp + sizeof(uintptr_t))) {
+            break;
+        }
+        uintptr_t* frame = (uintptr_t*)rbp;
+        if (!frame[1]) {
+            break;
+        }
+        sample->frames[sample->frame_count++] = frame[1];
+        // Callers' frames are always further up the stack
+        if (frame[0] <= rbp) {
+            break;
+        }
+        rbp = frame[0];
+    }
+
+    __atomic_store_n(&buffer->write_count, buffer->write_count + 1, __ATOMIC_RELEASE);
+}
+
+static int _handle_sample_ipi(register_state_t* regs) {
+    _record_sample(regs);
+    apic_signal_end_of_interrupt(regs->int_no);
+    return 0;
+}
+
+void profiler_handle_timer_tick(register_state_t* regs) {
+    if (!__atomic_load_n(&_sampling_active, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    _ticks_since_sample += 1;
+    if (_ticks_since_sample < _ticks_per_sample) {
+        return;
+    }
+    _ticks_since_sample = 0;
+
+    _record_sample(regs);
+    // Ask every other core to sample whatever it's running
+    uintptr_t current_core = cpu_id();
+    for (uintptr_t i = 0; i < MAX_PROCESSORS; i++) {
+        if (i != current_core && _cpu_buffers[i]) {
+            local_apic_send_fixed_ipi(_sample_int_vector, _core_apic_ids[i]);
+        }
+    }
+}
+
+void profiler_register_current_core(void) {
+    uintptr_t core = cpu_id();
+    assert(core < MAX_PROCESSORS, "Processor ID exceeds per-core profiler bookkeeping");
+    _core_apic_ids[core] = cpu_private_info()->apic_id;
+    // Publish the buffer last, as it marks the core as ready to be sampled
+    profiler_cpu_buffer_t* buffer = kcalloc_tagged(1, sizeof(profiler_cpu_buffer_t), KHEAP_TAG_DIAGNOSTICS);
+    __atomic_store_n(&_cpu_buffers[core], buffer, __ATOMIC_RELEASE);
+}
+
+void profiler_init(void) {
+    _sample_int_vector = idt_allocate_vector();
+    interrupt_setup_callback(_sample_int_vector, _handle_sample_ipi);
+    printf("[Profiler] Sample IPI vector %d\n", _sample_int_vector);
+    profiler_register_current_core();
+}
+
+int profiler_start(uint32_t sample_interval_ms) {
+    uint32_t ms_per_tick = max(boot_info_get()->ms_per_pit_tick, 1);
+    _ticks_per_sample = max(sample_interval_ms / ms_per_tick, 1);
+    _ticks_since_sample = 0;
+    __atomic_store_n(&_sampling_active, true, __ATOMIC_RELEASE);
+    printf("[Profiler] Sampling every %d ms\n", _ticks_per_sample * ms_per_tick);
+    return 0;
+}
+
+int profiler_stop(void) {
+    __atomic_store_n(&_sampling_active, false, __ATOMIC_RELEASE);
+    printf("[Profiler] Stopped sampling\n");
+    return 0;
+}
+
+int profiler_read_samples(profiler_sample_t* out, uint32_t max_samples, uint64_t* out_dropped_count) {
+    uint32_t read_count = 0;
+    uint64_t dropped_count = 0;
+
+    spinlock_acquire(&_read_lock);
+    for (uintptr_t i = 0; i < MAX_PROCESSORS && read_count < max_samples; i++) {
+        profiler_cpu_buffer_t* buffer = __atomic_load_n(&_cpu_buffers[i], __ATOMIC_ACQUIRE);
+        if (!buffer) {
+            continue;
+        }
+        uint64_t write_count = __atomic_load_n(&buffer->write_count, __ATOMIC_ACQUIRE);
+        uint64_t read_position = buffer->read_count;
+        while (read_position < write_count && read_count < max_samples) {
+            memcpy(&out[read_count++], &buffer->samples[read_position % PROFILER_SAMPLES_PER_CPU], sizeof(profiler_sample_t));
+            read_position += 1;
+        }
+        // Hands the slots back to the core
+        __atomic_store_n(&buffer->read_count, read_position, __ATOMIC_RELEASE);
+        dropped_count += __atomic_exchange_n(&buffer->dropped_count, 0, __ATOMIC_RELAXED);
+    }
+    spinlock_release(&_read_lock);
+
+    if (out_dropped_count) {
+        *out_dropped_count = dropped_count;
+    }
+    return read_count;
+}
+
+static int _copy_symbol(const char* symbol, char* out, uint32_t out_size) {
+    if (!symbol) {
+        return -1;
+    }
+    strncpy(out, symbol, out_size - 1);
+    out[out_size - 1] = '\0';
+    return strlen(out);
+}
+
+static void _retain_task_elf_image(task_small_t* task, void* ctx) {
+    if (!task || !task->elf_image) {
+        return;
+    }
+    elf_image_retain(task->elf_image);
+    *(elf_image_t**)ctx = task->elf_image;
+}
+
+int profiler_symbolize(int32_t pid, uint64_t addr, char* out, uint32_t out_size) {
+    if (!out_size) {
+        return -1;
+    }
+    if (addr >= VAS_KERNEL_CODE_BASE) {
+        return _copy_symbol(elf_sym_lookup(&boot_info_get()->kernel_elf_symbol_table, addr), out, out_size);
+    }
+
+    // The image must be retained before the task list is unlocked, as the task could exit right after
+    elf_image_t* image = NULL;
+    tasking_with_task_with_pid(pid, _retain_task_elf_image, &image);
+    if (!image) {
+        return -1;
+    }
+    int ret = _copy_symbol(elf_sym_lookup(&image->symbol_table, addr), out, out_size);
+    elf_image_release(image);
+    return ret;
+}
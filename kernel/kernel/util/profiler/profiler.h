@@ -0,0 +1,53 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Sampling CPU profiler.
+// While sampling is active, every core records what it was running at a fixed interval:
+// the interrupted instruction pointer, the PID, and a shallow stack found by following frame pointers.
+// The BSP samples from the PIT tick, and asks every other core to sample itself with an IPI,
+// so this doesn't rely on a hardware PMU.
+
+#define PROFILER_MAX_FRAMES 16
+
+typedef struct profiler_sample {
+    uint64_t timestamp_ms;
+    int32_t pid;
+    uint32_t cpu;
+    // Whether the interrupted code was running in user mode
+    uint32_t user_mode;
+    uint32_t frame_count;
+    // Innermost frame first. frames[0] is the interrupted instruction pointer.
+    uint64_t frames[PROFILER_MAX_FRAMES];
+} profiler_sample_t;
+
+// Begins sampling every core at the provided interval, which is rounded to the PIT tick
+int profiler_start(uint32_t sample_interval_ms);
+int profiler_stop(void);
+
+// Copies up to max_samples of the oldest unread samples
+// Returns the number of samples copied, and optionally the number of samples discarded
+// since the last read because a core's buffer was full
+int profiler_read_samples(profiler_sample_t* out, uint32_t max_samples, uint64_t* out_dropped_count);
+
+// Writes the name of the function containing addr to out, looked up in the kernel's symbol table
+// or the symbol table of the program running as pid
+// Returns the length of the name, or -1 if the address couldn't be symbolized
+int profiler_symbolize(int32_t pid, uint64_t addr, char* out, uint32_t out_size);
+
+// ############
+// Called internally from kernel mode
+// ############
+
+struct register_state_x86_64;
+
+// Must be called on the BSP once its APIC is set up
+void profiler_init(void);
+void profiler_register_current_core(void);
+
+// Invoked on the BSP for every PIT tick
+void profiler_handle_timer_tick(struct register_state_x86_64* regs);
+
+#endif
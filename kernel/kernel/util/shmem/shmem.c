@@ -0,0 +1,257 @@
+#include "shmem.h"
+
+#include <std/kheap.h>
+#include <std/math.h>
+#include <std/memory.h>
+#include <std/printf.h>
+
+#include <kernel/assert.h>
+#include <kernel/pmm/pmm.h>
+#include <kernel/util/spinlock/spinlock.h>
+
+// Shared memory is mapped above this address in each address space
+#define SHMEM_MAP_BASE 0x7f0000000000
+
+typedef struct shmem_mapping {
+    vas_state_t* vas;
+    uint64_t base;
+    struct shmem_mapping* next;
+} shmem_mapping_t;
+
+typedef struct shmem_object {
+    uint32_t handle;
+    uint64_t page_count;
+    uint64_t max_page_count;
+    // max_page_count entries, of which the first page_count are allocated
+    uint64_t* frames;
+    // Number of mappings
+    uint32_t reference_count;
+    shmem_mapping_t* mappings;
+    struct shmem_object* next;
+} shmem_object_t;
+
+// Protects the object list, and every object's state
+static spinlock_t _shmem_lock = {.name = "[Shared memory lock]"};
+static shmem_object_t* _shmem_objects = NULL;
+// Handles are never reused, so a stale handle can't refer to a newer object
+static uint32_t _next_handle = 1;
+
+static uint64_t _page_count_for_size(uint64_t size) {
+    return (size + (PAGE_SIZE - 1)) / PAGE_SIZE;
+}
+
+// The following helpers must be called with the shared memory lock held
+
+static shmem_object_t* _object_with_handle(uint32_t handle) {
+    for (shmem_object_t* object = _shmem_objects; object != NULL; object = object->next) {
+        if (object->handle == handle) {
+            return object;
+        }
+    }
+    return NULL;
+}
+
+static shmem_mapping_t* _mapping_in_vas(shmem_object_t* object, vas_state_t* vas) {
+    for (shmem_mapping_t* mapping = object->mappings; mapping != NULL; mapping = mapping->next) {
+        if (mapping->vas == vas) {
+            return mapping;
+        }
+    }
+    return NULL;
+}
+
+// Looks up an object and checks that the address space is allowed to operate on it
+static shmem_object_t* _object_held_by(uint32_t handle, vas_state_t* vas) {
+    shmem_object_t* object = _object_with_handle(handle);
+    if (!object || !_mapping_in_vas(object, vas)) {
+        printf("[Shmem] Address space 0x%p doesn't hold shared memory object %d\n", vas, handle);
+        return NULL;
+    }
+    return object;
+}
+
+static void _alloc_frames(shmem_object_t* object, uint64_t first_page, uint64_t page_count) {
+    for (uint64_t i = first_page; i < first_page + page_count; i++) {
+        object->frames[i] = pmm_alloc();
+        // Frames come straight from the PMM, so scrub whatever the previous owner left behind
+        memset((void*)PMA_TO_VMA(object->frames[i]), 0, PAGE_SIZE);
+    }
+}
+
+static void _free_frames(shmem_object_t* object, uint64_t first_page, uint64_t page_count) {
+    for (uint64_t i = first_page; i < first_page + page_count; i++) {
+        pmm_free(object->frames[i]);
+        object->frames[i] = 0;
+    }
+}
+
+static shmem_mapping_t* _map_into_vas(shmem_object_t* object, vas_state_t* vas) {
+    shmem_mapping_t* mapping = kcalloc_tagged(1, sizeof(shmem_mapping_t), KHEAP_TAG_AMC);
+    mapping->vas = vas;
+    // Reserve the address space for the maximum size up front, so the object can grow in place
+    mapping->base = vas_reserve_range(vas, SHMEM_MAP_BASE, object->max_page_count * PAGE_SIZE);
+    vas_map_frames(vas, mapping->base, object->page_count, object->frames, VAS_RANGE_ACCESS_LEVEL_READ_WRITE, VAS_RANGE_PRIVILEGE_LEVEL_USER);
+
+    mapping->next = object->mappings;
+    object->mappings = mapping;
+    object->reference_count += 1;
+    return mapping;
+}
+
+static void _object_destroy(shmem_object_t* object) {
+    printf("[Shmem] Freeing shared memory object %d (%d pages)\n", object->handle, object->page_count);
+    _free_frames(object, 0, object->page_count);
+
+    shmem_object_t** link = &_shmem_objects;
+    while (*link != object) {
+        link = &(*link)->next;
+    }
+    *link = object->next;
+
+    kfree(object->frames);
+    kfree(object);
+}
+
+static void _unmap_from_vas(shmem_object_t* object, shmem_mapping_t* mapping) {
+    vas_unmap_frames(mapping->vas, mapping->base, object->page_count);
+    vas_delete_range(mapping->vas, mapping->base, object->max_page_count * PAGE_SIZE);
+
+    shmem_mapping_t** link = &object->mappings;
+    while (*link != mapping) {
+        link = &(*link)->next;
+    }
+    *link = mapping->next;
+    kfree(mapping);
+
+    object->reference_count -= 1;
+    if (object->reference_count == 0) {
+        _object_destroy(object);
+    }
+}
+
+/*
+ * Public interface
+ */
+
+uint32_t shmem_create(vas_state_t* vas, uint64_t size, uint64_t max_size, uint64_t* out_base) {
+    // Bounding the sizes first also keeps the page counts below from overflowing
+    if (size > SHMEM_MAX_SIZE || max_size > SHMEM_MAX_SIZE) {
+        printf("[Shmem] Refusing to create a shared memory object of size 0x%p (max 0x%p)\n", max(size, max_size), SHMEM_MAX_SIZE);
+        return 0;
+    }
+    uint64_t page_count = _page_count_for_size(size);
+    uint64_t max_page_count = max(page_count, _page_count_for_size(max_size));
+    if (page_count == 0) {
+        printf("[Shmem] Refusing to create an empty shared memory object\n");
+        return 0;
+    }
+
+    shmem_object_t* object = kcalloc_tagged(1, sizeof(shmem_object_t), KHEAP_TAG_AMC);
+    object->page_count = page_count;
+    object->max_page_count = max_page_count;
+    object->frames = kcalloc_tagged(max_page_count, sizeof(uint64_t), KHEAP_TAG_AMC);
+    _alloc_frames(object, 0, page_count);
+
+    spinlock_acquire(&_shmem_lock);
+    object->handle = _next_handle++;
+    object->next = _shmem_objects;
+    _shmem_objects = object;
+    *out_base = _map_into_vas(object, vas)->base;
+    uint32_t handle = object->handle;
+    spinlock_release(&_shmem_lock);
+
+    return handle;
+}
+
+bool shmem_share(uint32_t handle, vas_state_t* holder, vas_state_t* vas, uint64_t* out_base) {
+    spinlock_acquire(&_shmem_lock);
+    shmem_object_t* object = _object_held_by(handle, holder);
+    if (!object) {
+        spinlock_release(&_shmem_lock);
+        return false;
+    }
+
+    shmem_mapping_t* mapping = _mapping_in_vas(object, vas);
+    if (!mapping) {
+        mapping = _map_into_vas(object, vas);
+    }
+    *out_base = mapping->base;
+    spinlock_release(&_shmem_lock);
+    return true;
+}
+
+bool shmem_resize(uint32_t handle, vas_state_t* holder, uint64_t new_size) {
+    if (new_size > SHMEM_MAX_SIZE) {
+        printf("[Shmem] Can't resize object %d to 0x%p bytes (max 0x%p)\n", handle, new_size, SHMEM_MAX_SIZE);
+        return false;
+    }
+    uint64_t new_page_count = _page_count_for_size(new_size);
+
+    spinlock_acquire(&_shmem_lock);
+    shmem_object_t* object = _object_held_by(handle, holder);
+    if (!object) {
+        spinlock_release(&_shmem_lock);
+        return false;
+    }
+    if (new_page_count == 0 || new_page_count > object->max_page_count) {
+        printf("[Shmem] Can't resize object %d to %d pages (max %d)\n", handle, new_page_count, object->max_page_count);
+        spinlock_release(&_shmem_lock);
+        return false;
+    }
+
+    uint64_t old_page_count = object->page_count;
+    if (new_page_count > old_page_count) {
+        // Grow: extend every mapping into its reserved tail
+        uint64_t added_page_count = new_page_count - old_page_count;
+        _alloc_frames(object, old_page_count, added_page_count);
+        for (shmem_mapping_t* mapping = object->mappings; mapping != NULL; mapping = mapping->next) {
+            vas_map_frames(
+                mapping->vas,
+                mapping->base + (old_page_count * PAGE_SIZE),
+                added_page_count,
+                &object->frames[old_page_count],
+                VAS_RANGE_ACCESS_LEVEL_READ_WRITE,
+                VAS_RANGE_PRIVILEGE_LEVEL_USER
+            );
+        }
+    }
+    else if (new_page_count < old_page_count) {
+        // Shrink: unmap the tail everywhere before the object gives up its own references
+        uint64_t removed_page_count = old_page_count - new_page_count;
+        for (shmem_mapping_t* mapping = object->mappings; mapping != NULL; mapping = mapping->next) {
+            vas_unmap_frames(mapping->vas, mapping->base + (new_page_count * PAGE_SIZE), removed_page_count);
+        }
+        _free_frames(object, new_page_count, removed_page_count);
+    }
+    object->page_count = new_page_count;
+
+    spinlock_release(&_shmem_lock);
+    return true;
+}
+
+bool shmem_unmap(uint32_t handle, vas_state_t* vas) {
+    spinlock_acquire(&_shmem_lock);
+    shmem_object_t* object = _object_held_by(handle, vas);
+    if (!object) {
+        spinlock_release(&_shmem_lock);
+        return false;
+    }
+    _unmap_from_vas(object, _mapping_in_vas(object, vas));
+    spinlock_release(&_shmem_lock);
+    return true;
+}
+
+void shmem_unmap_all(vas_state_t* vas) {
+    spinlock_acquire(&_shmem_lock);
+    shmem_object_t* object = _shmem_objects;
+    while (object != NULL) {
+        // Unmapping may free the object, so grab the next one first
+        shmem_object_t* next = object->next;
+        shmem_mapping_t* mapping = _mapping_in_vas(object, vas);
+        if (mapping) {
+            _unmap_from_vas(object, mapping);
+        }
+        object = next;
+    }
+    spinlock_release(&_shmem_lock);
+}
@@ -0,0 +1,38 @@
+#ifndef SHMEM_H
+#define SHMEM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <kernel/vmm/vmm.h>
+
+// Shared memory objects: reference-counted sets of physical frames that can be mapped into any number of
+// address spaces. The object holds a reference to each of its frames, and each mapping holds another,
+// so frames are returned to the PMM only once both the object and every mapping have let go of them.
+// An object's reference count is its number of mappings, and the object is freed along with its last mapping.
+//
+// Objects are identified by a handle. Operations other than creation are only permitted for address
+// spaces that currently map the object, which stops a service from reaching objects it was never given.
+
+// Largest size an object may be created with, or grow to. Room for a few 4K framebuffers.
+// Sizes come straight from userspace, and each mapping reserves the maximum size up front.
+#define SHMEM_MAX_SIZE (128ULL * 1024ULL * 1024ULL)
+
+// Creates an object of the given size, and maps it into the provided address space
+// The object can later grow in place up to max_size
+// Returns the new object's handle, or 0 on failure
+uint32_t shmem_create(vas_state_t* vas, uint64_t size, uint64_t max_size, uint64_t* out_base);
+
+// Maps an object held by `holder` into another address space
+bool shmem_share(uint32_t handle, vas_state_t* holder, vas_state_t* vas, uint64_t* out_base);
+
+// Grows or shrinks an object held by `holder`, in every address space that maps it
+bool shmem_resize(uint32_t handle, vas_state_t* holder, uint64_t new_size);
+
+// Drops the address space's mapping, freeing the object if this was its last mapping
+bool shmem_unmap(uint32_t handle, vas_state_t* vas);
+
+// Drops every mapping held by the address space, such as when its owner is torn down
+void shmem_unmap_all(vas_state_t* vas);
+
+#endif
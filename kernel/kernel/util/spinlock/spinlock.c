@@ -1,5 +1,6 @@
 #include <kernel/assert.h>
 #include <kernel/multitasking/tasks/task_small.h>
+#include <kernel/vmm/tlb.h>
 
 #include "spinlock.h"
 
@@ -137,6 +138,8 @@ void spinlock_acquire(spinlock_t* lock) {
         // Wait until the lock looks unlocked before retrying
         while (lock->flag == 1) {
 	        //asm volatile ("pause":::"memory");
+            // The holder may be waiting on us to invalidate our TLB, and interrupts are disabled
+            tlb_shootdown_poll();
         }
         //local_irq_disable();
     }
@@ -11,10 +11,7 @@ int stdout_write(task_small_t* task, int fd, const void* buf, int len) {
 	printk(b);
 	if (b[cnt-1] != '\n') printk("\n");
 
-	// Only forward to the logs viewer if it's active
-	if (amc_service_is_active("com.axle.logs_viewer")) {
-		amc_message_send__from_core("com.axle.logs_viewer", b, cnt);
-	}
+	// The logs viewer picks this up from the kernel log ring
 	task_inform_supervisor__process_write(b, cnt);
 
 	return len;
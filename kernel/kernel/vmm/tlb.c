@@ -0,0 +1,370 @@
+#include "tlb.h"
+#include <std/std.h>
+#include <std/printf.h>
+#include <kernel/assert.h>
+#include <kernel/smp.h>
+#include <kernel/util/spinlock/spinlock.h>
+
+// Beyond this many pages, flushing the whole TLB is cheaper than invalidating each page individually
+#define TLB_FLUSH_INVLPG_PAGE_LIMIT 32
+
+#define CR3_NO_FLUSH (1ULL << 63)
+#define CR4_PGE (1 << 7)
+#define CR4_PCIDE (1 << 17)
+
+#define CPUID_1_ECX_PCID (1 << 17)
+#define CPUID_1_EDX_PGE (1 << 13)
+
+#define PCID_BITMAP_WORDS (TLB_PCID_COUNT / 64)
+
+typedef struct tlb_shootdown_request {
+	// NULL when invalidating kernel mappings
+	vas_state_t* vas_state;
+	uint64_t vmem_start;
+	uint64_t page_count;
+} tlb_shootdown_request_t;
+
+static bool _global_pages_enabled = false;
+static bool _pcids_enabled = false;
+
+static spinlock_t _pcid_allocator_lock = {.name = "[PCID allocator lock]"};
+static uint64_t _allocated_pcids[PCID_BITMAP_WORDS] = {0};
+static uint32_t _next_pcid_hint = 1;
+
+// Set when a PCID's translations on a core may be out of date. Cleared when the core next loads the PCID.
+static uint64_t _stale_pcids[MAX_PROCESSORS][PCID_BITMAP_WORDS] = {0};
+static vas_state_t* _loaded_vas_states[MAX_PROCESSORS] = {0};
+static uintptr_t _core_apic_ids[MAX_PROCESSORS] = {0};
+static uint64_t _online_cores = 0;
+
+static uint8_t _shootdown_int_vector = 0;
+static spinlock_t _shootdown_lock = {.name = "[TLB shootdown lock]"};
+static tlb_shootdown_request_t _shootdown_request = {0};
+// Cores that have yet to service the current request
+static uint64_t _shootdown_pending_cores = 0;
+
+// Defined in Rust
+void local_apic_send_fixed_ipi(uint8_t int_vector, uintptr_t apic_id);
+uintptr_t idt_allocate_vector(void);
+
+/*
+ * Control-register utility functions
+ */
+
+static uintptr_t _get_cr4(void) {
+	uintptr_t cr4;
+	asm volatile("movq %%cr4, %0" : "=r"(cr4));
+	return cr4;
+}
+
+static void _set_cr4(uintptr_t cr4) {
+	asm volatile("movq %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+static uint64_t _get_cr3(void) {
+	uint64_t cr3;
+	asm volatile("movq %%cr3, %0" : "=r"(cr3));
+	return cr3;
+}
+
+static void _write_cr3(uint64_t cr3) {
+	asm volatile("movq %0, %%cr3" : : "r"(cr3) : "memory");
+}
+
+static uint64_t _irq_disable_save(void) {
+	uint64_t rflags;
+	asm volatile("pushfq; popq %0; cli" : "=r"(rflags) : : "memory");
+	return rflags;
+}
+
+static void _irq_restore(uint64_t rflags) {
+	// Interrupt enable flag
+	if (rflags & (1 << 9)) {
+		asm volatile("sti" : : : "memory");
+	}
+}
+
+static uintptr_t _current_core_idx(void) {
+	uintptr_t idx = cpu_id();
+	assert(idx < MAX_PROCESSORS, "Processor ID exceeds per-core TLB bookkeeping");
+	return idx;
+}
+
+/*
+ * Local invalidation
+ */
+
+// Drops every cached translation on this core, including global pages and translations tagged with other PCIDs
+static void _flush_all_local(void) {
+	uintptr_t cr4 = _get_cr4();
+	if (cr4 & CR4_PGE) {
+		// Toggling PGE flushes everything
+		_set_cr4(cr4 & ~CR4_PGE);
+		_set_cr4(cr4);
+		return;
+	}
+	// Without global pages, PCIDs are never enabled and a CR3 reload is enough
+	_write_cr3(_get_cr3());
+}
+
+static uint64_t _cr3_for_vas(vas_state_t* vas_state) {
+	uint64_t cr3 = (uint64_t)vas_state->pml4_phys;
+	if (_pcids_enabled) {
+		cr3 |= vas_state->pcid;
+	}
+	return cr3;
+}
+
+static void _invalidate_local(vas_state_t* vas_state, uint64_t vmem_start, uint64_t page_count) {
+	bool is_kernel_range = vmem_start >= KERNEL_MEMORY_BASE;
+	if (page_count > TLB_FLUSH_INVLPG_PAGE_LIMIT) {
+		if (is_kernel_range) {
+			_flush_all_local();
+		}
+		else {
+			// Reloading without the no-flush bit drops the loaded PCID's non-global translations
+			_write_cr3(_cr3_for_vas(vas_state));
+		}
+		return;
+	}
+	// invlpg drops the page's global translation, and its translation within the loaded PCID
+	for (uint64_t i = 0; i < page_count; i++) {
+		invlpg((void*)(vmem_start + (i * PAGE_SIZE)));
+	}
+}
+
+static void _mark_pcid_stale(uintptr_t core_idx, uint16_t pcid) {
+	__atomic_fetch_or(&_stale_pcids[core_idx][pcid / 64], 1ULL << (pcid % 64), __ATOMIC_SEQ_CST);
+}
+
+static bool _test_and_clear_pcid_stale(uintptr_t core_idx, uint16_t pcid) {
+	uint64_t bit = 1ULL << (pcid % 64);
+	return __atomic_fetch_and(&_stale_pcids[core_idx][pcid / 64], ~bit, __ATOMIC_SEQ_CST) & bit;
+}
+
+/*
+ * Shootdowns
+ */
+
+static void _service_shootdown(uintptr_t core_idx) {
+	uint64_t core_bit = 1ULL << core_idx;
+	if (!(__atomic_load_n(&_shootdown_pending_cores, __ATOMIC_SEQ_CST) & core_bit)) {
+		// Already serviced by polling, or the IPI arrived late
+		return;
+	}
+
+	// The initiator won't touch the request until every target has acknowledged it
+	tlb_shootdown_request_t* request = &_shootdown_request;
+	if (!request->vas_state || _loaded_vas_states[core_idx] == request->vas_state) {
+		_invalidate_local(request->vas_state, request->vmem_start, request->page_count);
+	}
+	// Otherwise, the VAS has been switched out since the request was made.
+	// The initiator marked its PCID stale, so it'll be flushed when it's next loaded.
+
+	__atomic_fetch_and(&_shootdown_pending_cores, ~core_bit, __ATOMIC_SEQ_CST);
+}
+
+static int _handle_shootdown_ipi(register_state_t* regs) {
+	_service_shootdown(_current_core_idx());
+	apic_signal_end_of_interrupt(regs->int_no);
+	return 0;
+}
+
+void tlb_shootdown_poll(void) {
+	// Cheap check for the common case
+	if (!__atomic_load_n(&_shootdown_pending_cores, __ATOMIC_RELAXED)) {
+		return;
+	}
+	_service_shootdown(_current_core_idx());
+}
+
+static void _send_shootdown(uint64_t target_cores, vas_state_t* vas_state, uint64_t vmem_start, uint64_t page_count) {
+	spinlock_acquire(&_shootdown_lock);
+
+	_shootdown_request.vas_state = vas_state;
+	_shootdown_request.vmem_start = vmem_start;
+	_shootdown_request.page_count = page_count;
+	__atomic_store_n(&_shootdown_pending_cores, target_cores, __ATOMIC_SEQ_CST);
+
+	for (uintptr_t i = 0; i < MAX_PROCESSORS; i++) {
+		if (target_cores & (1ULL << i)) {
+			local_apic_send_fixed_ipi(_shootdown_int_vector, _core_apic_ids[i]);
+		}
+	}
+
+	// Wait for every target to acknowledge
+	// A target might be spinning on a lock we hold with interrupts disabled, but it'll
+	// service the request from its spin loop instead
+	while (__atomic_load_n(&_shootdown_pending_cores, __ATOMIC_SEQ_CST) != 0) {
+		asm volatile("pause" : : : "memory");
+	}
+
+	spinlock_release(&_shootdown_lock);
+}
+
+void tlb_invalidate_range(vas_state_t* vas_state, uint64_t vmem_start, uint64_t page_count) {
+	bool is_kernel_range = vmem_start >= KERNEL_MEMORY_BASE;
+	uint64_t rflags = _irq_disable_save();
+	uintptr_t current_core = _current_core_idx();
+
+	uint64_t target_cores = 0;
+	uint64_t online_cores = __atomic_load_n(&_online_cores, __ATOMIC_SEQ_CST);
+	for (uintptr_t i = 0; i < MAX_PROCESSORS; i++) {
+		if (i == current_core || !(online_cores & (1ULL << i))) {
+			continue;
+		}
+		if (is_kernel_range) {
+			// Kernel mappings may be cached by any core
+			target_cores |= (1ULL << i);
+			continue;
+		}
+
+		// Cores that don't have the VAS loaded are handled lazily, by flushing its PCID when it's next loaded
+		// The stale bit is set before checking the loaded VAS, and the loading core sets its loaded VAS
+		// before consuming the stale bit, so at least one side always observes the other
+		if (__atomic_load_n(&_loaded_vas_states[i], __ATOMIC_SEQ_CST) != vas_state) {
+			_mark_pcid_stale(i, vas_state->pcid);
+		}
+		if (__atomic_load_n(&_loaded_vas_states[i], __ATOMIC_SEQ_CST) == vas_state) {
+			target_cores |= (1ULL << i);
+		}
+	}
+
+	if (is_kernel_range || _loaded_vas_states[current_core] == vas_state) {
+		_invalidate_local(vas_state, vmem_start, page_count);
+	}
+	else {
+		_mark_pcid_stale(current_core, vas_state->pcid);
+	}
+
+	if (target_cores) {
+		_send_shootdown(target_cores, is_kernel_range ? NULL : vas_state, vmem_start, page_count);
+	}
+	_irq_restore(rflags);
+}
+
+void tlb_invalidate_address_space(vas_state_t* vas_state) {
+	// Any page count above the invlpg limit flushes the whole PCID
+	tlb_invalidate_range(vas_state, 0, TLB_FLUSH_INVLPG_PAGE_LIMIT + 1);
+}
+
+/*
+ * Address space loading
+ */
+
+void tlb_load_address_space(vas_state_t* vas_state) {
+	// A shootdown must not observe the new VAS as loaded while the old CR3 is still active
+	uint64_t rflags = _irq_disable_save();
+	uintptr_t core_idx = _current_core_idx();
+	__atomic_store_n(&_loaded_vas_states[core_idx], vas_state, __ATOMIC_SEQ_CST);
+
+	uint64_t cr3 = _cr3_for_vas(vas_state);
+	if (_pcids_enabled && vas_state->pcid != TLB_PCID_SHARED) {
+		// Retain the PCID's translations, unless they've been invalidated since it was last loaded here
+		if (!_test_and_clear_pcid_stale(core_idx, vas_state->pcid)) {
+			cr3 |= CR3_NO_FLUSH;
+		}
+	}
+	_write_cr3(cr3);
+	_irq_restore(rflags);
+}
+
+/*
+ * PCID allocation
+ */
+
+uint16_t tlb_pcid_alloc(void) {
+	if (!_pcids_enabled) {
+		return TLB_PCID_SHARED;
+	}
+
+	spinlock_acquire(&_pcid_allocator_lock);
+	for (uint32_t i = 0; i < TLB_PCID_COUNT; i++) {
+		uint32_t pcid = (_next_pcid_hint + i) % TLB_PCID_COUNT;
+		if (pcid == TLB_PCID_SHARED || (_allocated_pcids[pcid / 64] & (1ULL << (pcid % 64)))) {
+			continue;
+		}
+		_allocated_pcids[pcid / 64] |= (1ULL << (pcid % 64));
+		_next_pcid_hint = pcid + 1;
+		spinlock_release(&_pcid_allocator_lock);
+		return pcid;
+	}
+	spinlock_release(&_pcid_allocator_lock);
+
+	// Out of PCIDs. The shared PCID works for any VAS, it just won't retain translations.
+	return TLB_PCID_SHARED;
+}
+
+void tlb_pcid_free(uint16_t pcid) {
+	if (pcid == TLB_PCID_SHARED) {
+		return;
+	}
+
+	// Translations tagged with the PCID may linger on any core, and must not leak into its next owner
+	for (uintptr_t i = 0; i < MAX_PROCESSORS; i++) {
+		_mark_pcid_stale(i, pcid);
+	}
+
+	spinlock_acquire(&_pcid_allocator_lock);
+	_allocated_pcids[pcid / 64] &= ~(1ULL << (pcid % 64));
+	spinlock_release(&_pcid_allocator_lock);
+}
+
+bool tlb_address_is_global(uint64_t vmem_addr) {
+	// Each core maps its own private data at the same address, so it can't be global
+	return _global_pages_enabled && vmem_addr >= KERNEL_MEMORY_BASE && VMA_PML4E_IDX(vmem_addr) != VMA_PML4E_IDX(CPU_CORE_DATA_BASE);
+}
+
+/*
+ * Initialization
+ */
+
+static void _enable_on_current_core(void) {
+	uintptr_t cr4 = _get_cr4();
+	if (_global_pages_enabled) {
+		cr4 |= CR4_PGE;
+	}
+	if (_pcids_enabled) {
+		// PCIDE can only be enabled while PCID 0 is loaded, which is always the case before the first tagged load
+		cr4 |= CR4_PCIDE;
+	}
+	_set_cr4(cr4);
+}
+
+void tlb_init(void) {
+	uint32_t eax, ebx, ecx, edx;
+	asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+
+	_global_pages_enabled = (edx & CPUID_1_EDX_PGE) != 0;
+	// Kernel mappings are only invalidated across PCIDs when they're global, so PCIDs depend on global pages
+	_pcids_enabled = _global_pages_enabled && (ecx & CPUID_1_ECX_PCID) != 0;
+	printf("[TLB] Global pages %s, PCIDs %s\n", _global_pages_enabled ? "enabled" : "unsupported", _pcids_enabled ? "enabled" : "unsupported");
+
+	_enable_on_current_core();
+}
+
+static void _register_current_core(void) {
+	uintptr_t core_idx = _current_core_idx();
+	_core_apic_ids[core_idx] = cpu_private_info()->apic_id;
+	_loaded_vas_states[core_idx] = vas_get_active_state();
+	__atomic_fetch_or(&_online_cores, 1ULL << core_idx, __ATOMIC_SEQ_CST);
+
+	// Invalidations that raced with coming online, or that were recorded against the early-boot
+	// placeholder core index, may have been missed
+	_flush_all_local();
+}
+
+void tlb_register_current_core(void) {
+	// The AP bootstrap loaded its VAS directly, so PCID 0 is still loaded
+	_enable_on_current_core();
+	_register_current_core();
+}
+
+void tlb_init_shootdown(void) {
+	_shootdown_int_vector = idt_allocate_vector();
+	interrupt_setup_callback(_shootdown_int_vector, _handle_shootdown_ipi);
+	printf("[TLB] Shootdown IPI vector %d\n", _shootdown_int_vector);
+
+	// The BSP enabled PCIDs in tlb_init(), so it just needs to come online
+	_register_current_core();
+}
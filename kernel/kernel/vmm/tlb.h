@@ -0,0 +1,41 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/vmm/vmm.h>
+
+// Address spaces are tagged with a process-context identifier (PCID) so that their
+// translations survive context switches. PCID 0 is never handed out to a single VAS:
+// it's shared by every VAS that couldn't be given its own, and is flushed on every load.
+#define TLB_PCID_COUNT 4096
+#define TLB_PCID_SHARED 0
+
+// Detects PCID and global-page support and enables them on the BSP
+// Must run before the first PCID-tagged CR3 load
+void tlb_init(void);
+// Sets up the shootdown IPI. Requires the local APIC and the BSP's private info to be set up.
+void tlb_init_shootdown(void);
+// Enables PCIDs on an AP and starts delivering shootdowns to it
+void tlb_register_current_core(void);
+
+uint16_t tlb_pcid_alloc(void);
+void tlb_pcid_free(uint16_t pcid);
+
+// Loads the VAS on the current core, retaining its cached translations unless they've been invalidated
+void tlb_load_address_space(vas_state_t* vas_state);
+
+// Invalidates cached translations for pages in the VAS on every core that may hold them
+// Kernel mappings are shared by every VAS, and are invalidated everywhere regardless of the provided VAS
+void tlb_invalidate_range(vas_state_t* vas_state, uint64_t vmem_start, uint64_t page_count);
+void tlb_invalidate_address_space(vas_state_t* vas_state);
+
+// Services any shootdown that's waiting on the current core
+// Invoked by code that spins with interrupts disabled, so that it can't deadlock against an initiator
+void tlb_shootdown_poll(void);
+
+// Whether kernel mappings at this address can be marked global
+bool tlb_address_is_global(uint64_t vmem_addr);
+
+#endif
@@ -0,0 +1,368 @@
+#include "vas_range_tree.h"
+#include <stddef.h>
+#include <kernel/pmm/pmm.h>
+#include <kernel/vmm/vmm.h>
+#include <kernel/assert.h>
+#include <std/math.h>
+
+typedef struct vas_range_node_frame {
+	// Physical address of the next frame in the pool
+	uintptr_t next_frame;
+	vas_range_node_t nodes[];
+} vas_range_node_frame_t;
+
+#define VAS_RANGE_NODES_PER_FRAME ((PAGE_SIZE - sizeof(vas_range_node_frame_t)) / sizeof(vas_range_node_t))
+
+/*
+ * Node pool
+ */
+
+static vas_range_node_t* _node_alloc(vas_range_tree_t* tree, uint64_t start, uint64_t size) {
+	if (!tree->free_nodes) {
+		// Carve a fresh frame into nodes
+		uintptr_t frame_phys = pmm_alloc();
+		vas_range_node_frame_t* frame = (vas_range_node_frame_t*)PMA_TO_VMA(frame_phys);
+		frame->next_frame = tree->node_frames;
+		tree->node_frames = frame_phys;
+		for (uint32_t i = 0; i < VAS_RANGE_NODES_PER_FRAME; i++) {
+			// Free nodes are linked through their left pointer
+			frame->nodes[i].left = tree->free_nodes;
+			tree->free_nodes = &frame->nodes[i];
+		}
+	}
+
+	vas_range_node_t* node = tree->free_nodes;
+	tree->free_nodes = node->left;
+
+	node->range.start = start;
+	node->range.size = size;
+	node->left = NULL;
+	node->right = NULL;
+	node->height = 1;
+	node->subtree_min_start = start;
+	node->subtree_max_start = start;
+	node->subtree_max_end = start + size;
+	node->subtree_max_gap = 0;
+	return node;
+}
+
+static void _node_free(vas_range_tree_t* tree, vas_range_node_t* node) {
+	node->right = NULL;
+	node->left = tree->free_nodes;
+	tree->free_nodes = node;
+}
+
+/*
+ * AVL maintenance
+ */
+
+static inline uint64_t _range_end(const vas_range_node_t* node) {
+	return node->range.start + node->range.size;
+}
+
+static inline int32_t _height(const vas_range_node_t* node) {
+	return node ? node->height : 0;
+}
+
+static void _update(vas_range_node_t* node) {
+	vas_range_node_t* left = node->left;
+	vas_range_node_t* right = node->right;
+
+	node->height = 1 + max(_height(left), _height(right));
+	node->subtree_min_start = left ? left->subtree_min_start : node->range.start;
+	node->subtree_max_start = right ? right->subtree_max_start : node->range.start;
+	node->subtree_max_end = right ? right->subtree_max_end : _range_end(node);
+
+	// Ranges are disjoint and non-adjacent, so these differences never underflow
+	uint64_t max_gap = 0;
+	if (left) {
+		max_gap = max(left->subtree_max_gap, node->range.start - left->subtree_max_end);
+	}
+	if (right) {
+		max_gap = max(max_gap, right->subtree_max_gap);
+		max_gap = max(max_gap, right->subtree_min_start - _range_end(node));
+	}
+	node->subtree_max_gap = max_gap;
+}
+
+static vas_range_node_t* _rotate_right(vas_range_node_t* node) {
+	vas_range_node_t* new_root = node->left;
+	node->left = new_root->right;
+	new_root->right = node;
+	_update(node);
+	_update(new_root);
+	return new_root;
+}
+
+static vas_range_node_t* _rotate_left(vas_range_node_t* node) {
+	vas_range_node_t* new_root = node->right;
+	node->right = new_root->left;
+	new_root->left = node;
+	_update(node);
+	_update(new_root);
+	return new_root;
+}
+
+static vas_range_node_t* _rebalance(vas_range_node_t* node) {
+	_update(node);
+	int32_t balance = _height(node->left) - _height(node->right);
+	if (balance > 1) {
+		if (_height(node->left->left) < _height(node->left->right)) {
+			node->left = _rotate_left(node->left);
+		}
+		return _rotate_right(node);
+	}
+	if (balance < -1) {
+		if (_height(node->right->right) < _height(node->right->left)) {
+			node->right = _rotate_right(node->right);
+		}
+		return _rotate_left(node);
+	}
+	return node;
+}
+
+static vas_range_node_t* _insert_node(vas_range_node_t* root, vas_range_node_t* node) {
+	if (!root) {
+		return node;
+	}
+	if (node->range.start < root->range.start) {
+		root->left = _insert_node(root->left, node);
+	}
+	else {
+		root->right = _insert_node(root->right, node);
+	}
+	return _rebalance(root);
+}
+
+static vas_range_node_t* _detach_min(vas_range_node_t* root, vas_range_node_t** out_min) {
+	if (!root->left) {
+		*out_min = root;
+		return root->right;
+	}
+	root->left = _detach_min(root->left, out_min);
+	return _rebalance(root);
+}
+
+static vas_range_node_t* _delete_node(vas_range_tree_t* tree, vas_range_node_t* root, uint64_t start) {
+	assert(root != NULL, "Failed to find range to delete");
+	if (start < root->range.start) {
+		root->left = _delete_node(tree, root->left, start);
+		return _rebalance(root);
+	}
+	if (start > root->range.start) {
+		root->right = _delete_node(tree, root->right, start);
+		return _rebalance(root);
+	}
+
+	vas_range_node_t* left = root->left;
+	vas_range_node_t* right = root->right;
+	_node_free(tree, root);
+	if (!right) {
+		return left;
+	}
+
+	// Replace the deleted node with its in-order successor
+	vas_range_node_t* successor = NULL;
+	right = _detach_min(right, &successor);
+	successor->left = left;
+	successor->right = right;
+	return _rebalance(successor);
+}
+
+/*
+ * Queries
+ */
+
+static vas_range_node_t* _find_containing(vas_range_node_t* node, uint64_t addr) {
+	while (node) {
+		if (addr < node->range.start) {
+			node = node->left;
+		}
+		else if (addr >= _range_end(node)) {
+			node = node->right;
+		}
+		else {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+// Finds any range that overlaps or abuts [start, end)
+static vas_range_node_t* _find_touching(vas_range_node_t* node, uint64_t start, uint64_t end) {
+	while (node) {
+		if (_range_end(node) < start) {
+			node = node->right;
+		}
+		else if (node->range.start > end) {
+			node = node->left;
+		}
+		else {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+// Finds the first range starting at or above the address
+static vas_range_node_t* _lower_bound(vas_range_node_t* node, uint64_t addr) {
+	vas_range_node_t* best = NULL;
+	while (node) {
+		if (node->range.start >= addr) {
+			best = node;
+			node = node->left;
+		}
+		else {
+			node = node->right;
+		}
+	}
+	return best;
+}
+
+// In-order search for the first range starting above `from` that's preceded by a gap larger than `size`.
+// prev_end tracks the end of the last range visited. Subtrees that can't contain a candidate are skipped
+// using their cached bounds, so this visits O(log n) nodes.
+static bool _find_gap_after(vas_range_node_t* node, uint64_t from, uint64_t size, uint64_t* prev_end, uint64_t* out) {
+	if (!node) {
+		return false;
+	}
+	if (node->subtree_max_start <= from) {
+		// Every range in this subtree is at or before the search start
+		*prev_end = node->subtree_max_end;
+		return false;
+	}
+	if (node->subtree_min_start > from) {
+		// Every gap in this subtree is a candidate, so only descend if one of them fits
+		bool leading_gap_fits = node->subtree_min_start - *prev_end > size;
+		if (!leading_gap_fits && node->subtree_max_gap <= size) {
+			*prev_end = node->subtree_max_end;
+			return false;
+		}
+	}
+
+	if (_find_gap_after(node->left, from, size, prev_end, out)) {
+		return true;
+	}
+	if (node->range.start > from && node->range.start - *prev_end > size) {
+		*out = *prev_end;
+		return true;
+	}
+	*prev_end = _range_end(node);
+	return _find_gap_after(node->right, from, size, prev_end, out);
+}
+
+static void _foreach(vas_range_node_t* node, vas_range_tree_callback_t callback, void* ctx) {
+	if (!node) {
+		return;
+	}
+	_foreach(node->left, callback, ctx);
+	callback(&node->range, ctx);
+	_foreach(node->right, callback, ctx);
+}
+
+/*
+ * Public interface
+ */
+
+void vas_range_tree_insert(vas_range_tree_t* tree, uint64_t start, uint64_t size) {
+	uint64_t end = start + size;
+	// Absorb any ranges that overlap or abut the new one
+	vas_range_node_t* touching = NULL;
+	while ((touching = _find_touching(tree->root, start, end)) != NULL) {
+		start = min(start, touching->range.start);
+		end = max(end, _range_end(touching));
+		tree->root = _delete_node(tree, tree->root, touching->range.start);
+		tree->count -= 1;
+	}
+
+	tree->root = _insert_node(tree->root, _node_alloc(tree, start, end - start));
+	tree->count += 1;
+}
+
+bool vas_range_tree_remove(vas_range_tree_t* tree, uint64_t start, uint64_t size) {
+	vas_range_node_t* containing = _find_containing(tree->root, start);
+	if (!containing || start + size > _range_end(containing)) {
+		return false;
+	}
+
+	vas_range_t original = containing->range;
+	tree->root = _delete_node(tree, tree->root, original.start);
+	tree->count -= 1;
+
+	// Re-insert whatever's left on either side of the removed region
+	uint64_t left_size = start - original.start;
+	uint64_t right_size = (original.start + original.size) - (start + size);
+	if (left_size > 0) {
+		tree->root = _insert_node(tree->root, _node_alloc(tree, original.start, left_size));
+		tree->count += 1;
+	}
+	if (right_size > 0) {
+		tree->root = _insert_node(tree->root, _node_alloc(tree, start + size, right_size));
+		tree->count += 1;
+	}
+	return true;
+}
+
+const vas_range_t* vas_range_tree_find(vas_range_tree_t* tree, uint64_t addr) {
+	vas_range_node_t* node = _find_containing(tree->root, addr);
+	return node ? &node->range : NULL;
+}
+
+uint64_t vas_range_tree_find_gap(vas_range_tree_t* tree, uint64_t min_address, uint64_t size) {
+	uint64_t candidate = min_address;
+	vas_range_node_t* containing = _find_containing(tree->root, candidate);
+	if (containing) {
+		candidate = _range_end(containing);
+	}
+
+	// Note that a range starting exactly at the end of the candidate region counts as a collision
+	vas_range_node_t* next = _lower_bound(tree->root, candidate);
+	if (!next || next->range.start - candidate > size) {
+		return candidate;
+	}
+
+	uint64_t prev_end = candidate;
+	uint64_t gap_start = 0;
+	if (_find_gap_after(tree->root, next->range.start, size, &prev_end, &gap_start)) {
+		return gap_start;
+	}
+	// No gap between existing ranges is large enough, so go after all of them
+	return tree->root->subtree_max_end;
+}
+
+void vas_range_tree_foreach(vas_range_tree_t* tree, vas_range_tree_callback_t callback, void* ctx) {
+	_foreach(tree->root, callback, ctx);
+}
+
+typedef struct copy_ranges_ctx {
+	vas_range_t* out;
+	uint32_t max_count;
+	uint32_t copied_count;
+} copy_ranges_ctx_t;
+
+static void _copy_range(const vas_range_t* range, void* ctx) {
+	copy_ranges_ctx_t* copy_ctx = (copy_ranges_ctx_t*)ctx;
+	if (copy_ctx->copied_count < copy_ctx->max_count) {
+		copy_ctx->out[copy_ctx->copied_count++] = *range;
+	}
+}
+
+uint32_t vas_range_tree_copy_ranges(vas_range_tree_t* tree, vas_range_t* out, uint32_t max_count) {
+	copy_ranges_ctx_t ctx = {.out = out, .max_count = max_count, .copied_count = 0};
+	_foreach(tree->root, _copy_range, &ctx);
+	return ctx.copied_count;
+}
+
+void vas_range_tree_destroy(vas_range_tree_t* tree) {
+	uintptr_t frame_phys = tree->node_frames;
+	while (frame_phys) {
+		vas_range_node_frame_t* frame = (vas_range_node_frame_t*)PMA_TO_VMA(frame_phys);
+		uintptr_t next_frame = frame->next_frame;
+		pmm_free(frame_phys);
+		frame_phys = next_frame;
+	}
+	tree->root = NULL;
+	tree->count = 0;
+	tree->free_nodes = NULL;
+	tree->node_frames = 0;
+}
@@ -0,0 +1,56 @@
+#ifndef VAS_RANGE_TREE_H
+#define VAS_RANGE_TREE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct vas_range {
+	uint64_t start;
+	uint64_t size;
+} vas_range_t;
+
+// AVL tree node, keyed by range start
+// Each node caches the bounds of its subtree and the largest gap between two consecutive
+// ranges within it, which allows first-fit searches to skip whole subtrees
+typedef struct vas_range_node {
+	vas_range_t range;
+	struct vas_range_node* left;
+	struct vas_range_node* right;
+	int32_t height;
+	uint64_t subtree_min_start;
+	uint64_t subtree_max_start;
+	uint64_t subtree_max_end;
+	uint64_t subtree_max_gap;
+} vas_range_node_t;
+
+// Sorted set of disjoint ranges. Overlapping or adjacent ranges are merged on insertion.
+// Nodes are carved out of PMM frames rather than the kernel heap, as the kernel heap itself
+// allocates from the kernel VAS. A zero-initialized tree is empty and ready to use.
+typedef struct vas_range_tree {
+	vas_range_node_t* root;
+	uint32_t count;
+	vas_range_node_t* free_nodes;
+	// Physical address of the most recently allocated node frame
+	uintptr_t node_frames;
+} vas_range_tree_t;
+
+typedef void (*vas_range_tree_callback_t)(const vas_range_t* range, void* ctx);
+
+void vas_range_tree_insert(vas_range_tree_t* tree, uint64_t start, uint64_t size);
+// Removes a region that must lie entirely within one range, splitting the range if necessary
+bool vas_range_tree_remove(vas_range_tree_t* tree, uint64_t start, uint64_t size);
+
+// Returns the range containing the address, or NULL
+const vas_range_t* vas_range_tree_find(vas_range_tree_t* tree, uint64_t addr);
+// Returns the lowest address >= min_address that's followed by a free region of the provided size
+uint64_t vas_range_tree_find_gap(vas_range_tree_t* tree, uint64_t min_address, uint64_t size);
+
+// Invokes the callback for each range, in address order
+void vas_range_tree_foreach(vas_range_tree_t* tree, vas_range_tree_callback_t callback, void* ctx);
+// Copies up to max_count ranges, in address order, and returns the number copied
+uint32_t vas_range_tree_copy_ranges(vas_range_tree_t* tree, vas_range_t* out, uint32_t max_count);
+
+// Frees every range and the frames backing the tree's nodes
+void vas_range_tree_destroy(vas_range_tree_t* tree);
+
+#endif
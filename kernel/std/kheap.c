@@ -1,10 +1,13 @@
 #include "kheap.h"
 #include <std/std.h>
 #include <std/printf.h>
+#include <std/math.h>
+#include <std/memory.h>
 
 #include <kernel/util/spinlock/spinlock.h>
 #include <kernel/boot_info.h>
 #include <kernel/vmm/vmm.h>
+#include <kernel/elf.h>
 
 /**  Durand's Amazing Super Duper Memory functions.  */
 
@@ -21,6 +24,13 @@
 #define USE_CASE4
 #define USE_CASE5
 
+// Comment this out to stop attributing allocations to the code that requested them,
+// which costs a hash table update per allocation and free
+#define KHEAP_TRACK_ALLOCATION_SITES
+#define KHEAP_SITE_TABLE_SIZE 512
+#define KHEAP_DUMP_MAX_SITES 32
+#define KHEAP_DUMP_MAX_MAJORS 16
+
 
 /** This macro will conveniently align our pointer upwards */
 #define ALIGN( ptr )													\
@@ -93,6 +103,8 @@ struct	liballoc_minor
 	unsigned int magic;					///< A magic number to idenfity correctness.
 	unsigned int size; 					///< The size of the memory allocated. Could be 1 byte or more.
 	unsigned int req_size;				///< The size of memory requested.
+	uintptr_t site;						///< The address the allocation was requested from.
+	unsigned int tag;					///< The subsystem the allocation is accounted to.
 };
 
 
@@ -272,6 +284,212 @@ void liballoc_dump()
 
 
 
+// ***********   ALLOCATION ACCOUNTING  *******************************
+
+static kheap_tag_stats_t _kheap_tag_stats[KHEAP_TAG_COUNT] = {0};
+
+typedef struct kheap_site_stats {
+	uintptr_t site;
+	kheap_tag_t tag;
+	uint64_t live_bytes;
+	uint64_t live_allocations;
+	uint64_t total_allocations;
+} kheap_site_stats_t;
+
+#ifdef KHEAP_TRACK_ALLOCATION_SITES
+static kheap_site_stats_t _kheap_site_stats[KHEAP_SITE_TABLE_SIZE] = {0};
+// Accounts for every site that didn't fit in the table
+static kheap_site_stats_t _kheap_overflow_site_stats = {0};
+#endif
+
+static const char* _kheap_tag_names[KHEAP_TAG_COUNT] = {
+	[KHEAP_TAG_UNTAGGED] = "untagged",
+	[KHEAP_TAG_AMC] = "amc",
+	[KHEAP_TAG_VMM] = "vmm",
+	[KHEAP_TAG_TASKING] = "tasking",
+	[KHEAP_TAG_ELF] = "elf",
+	[KHEAP_TAG_DIAGNOSTICS] = "diagnostics",
+};
+
+const char* kheap_tag_name(kheap_tag_t tag) {
+	if (tag >= KHEAP_TAG_COUNT) {
+		return "invalid";
+	}
+	return _kheap_tag_names[tag];
+}
+
+// The following helpers must be called with the heap lock held
+
+#ifdef KHEAP_TRACK_ALLOCATION_SITES
+static kheap_site_stats_t* _kheap_stats_for_site(uintptr_t site) {
+	// Return addresses are at least byte-granular, so mix in the high bits
+	uint64_t hash = (site ^ (site >> 9)) * 0x9E3779B97F4A7C15ULL;
+	for (uint32_t i = 0; i < KHEAP_SITE_TABLE_SIZE; i++) {
+		kheap_site_stats_t* entry = &_kheap_site_stats[(hash + i) % KHEAP_SITE_TABLE_SIZE];
+		if (entry->site == site) {
+			return entry;
+		}
+		if (!entry->site) {
+			entry->site = site;
+			return entry;
+		}
+	}
+	return &_kheap_overflow_site_stats;
+}
+#endif
+
+static void _kheap_account_alloc(struct liballoc_minor* min, uintptr_t site, kheap_tag_t tag) {
+	if (tag >= KHEAP_TAG_COUNT) {
+		tag = KHEAP_TAG_UNTAGGED;
+	}
+	min->site = site;
+	min->tag = tag;
+
+	kheap_tag_stats_t* tag_stats = &_kheap_tag_stats[tag];
+	tag_stats->live_bytes += min->req_size;
+	tag_stats->live_allocations += 1;
+	tag_stats->total_allocations += 1;
+	tag_stats->peak_live_bytes = max(tag_stats->peak_live_bytes, tag_stats->live_bytes);
+
+#ifdef KHEAP_TRACK_ALLOCATION_SITES
+	kheap_site_stats_t* site_stats = _kheap_stats_for_site(site);
+	site_stats->tag = tag;
+	site_stats->live_bytes += min->req_size;
+	site_stats->live_allocations += 1;
+	site_stats->total_allocations += 1;
+#endif
+}
+
+static void _kheap_account_free(struct liballoc_minor* min) {
+	kheap_tag_stats_t* tag_stats = &_kheap_tag_stats[min->tag];
+	tag_stats->live_bytes -= min->req_size;
+	tag_stats->live_allocations -= 1;
+
+#ifdef KHEAP_TRACK_ALLOCATION_SITES
+	kheap_site_stats_t* site_stats = _kheap_stats_for_site(min->site);
+	site_stats->live_bytes -= min->req_size;
+	site_stats->live_allocations -= 1;
+#endif
+}
+
+static void* _liballoc_malloc(size_t req_size);
+
+static void* _kheap_alloc(size_t size, uintptr_t site, kheap_tag_t tag) {
+	void* p = _liballoc_malloc(size);
+	if (p == NULL) {
+		return NULL;
+	}
+
+	void* ptr = p;
+	UNALIGN(ptr);
+	struct liballoc_minor* min = (struct liballoc_minor*)((uintptr_t)ptr - sizeof(struct liballoc_minor));
+
+	liballoc_lock();
+	_kheap_account_alloc(min, site, tag);
+	liballoc_unlock();
+	return p;
+}
+
+void kheap_get_tag_stats(kheap_tag_t tag, kheap_tag_stats_t* out) {
+	liballoc_lock();
+	*out = _kheap_tag_stats[tag < KHEAP_TAG_COUNT ? tag : KHEAP_TAG_UNTAGGED];
+	liballoc_unlock();
+}
+
+typedef struct kheap_major_stats {
+	uint64_t size;
+	uint64_t usage;
+	uint64_t largest_free_gap;
+} kheap_major_stats_t;
+
+// Must be called with the heap lock held
+static void _kheap_major_stats(struct liballoc_major* maj, kheap_major_stats_t* out) {
+	out->size = maj->size;
+	out->usage = maj->usage;
+	out->largest_free_gap = 0;
+
+	uintptr_t gap_start = (uintptr_t)maj + sizeof(struct liballoc_major);
+	for (struct liballoc_minor* min = maj->first; min != NULL; min = min->next) {
+		out->largest_free_gap = max(out->largest_free_gap, (uintptr_t)min - gap_start);
+		gap_start = (uintptr_t)min + sizeof(struct liballoc_minor) + min->size;
+	}
+	out->largest_free_gap = max(out->largest_free_gap, ((uintptr_t)maj + maj->size) - gap_start);
+}
+
+void kheap_dump_allocation_stats(uint32_t top_site_count) {
+	kheap_tag_stats_t tag_stats[KHEAP_TAG_COUNT];
+	kheap_site_stats_t top_sites[KHEAP_DUMP_MAX_SITES] = {0};
+	kheap_major_stats_t majors[KHEAP_DUMP_MAX_MAJORS] = {0};
+	uint32_t major_count = 0;
+	uint64_t heap_size = 0;
+	uint64_t heap_usage = 0;
+	uint64_t largest_free_gap = 0;
+	top_site_count = min(top_site_count, KHEAP_DUMP_MAX_SITES);
+
+	// Take a snapshot, so nothing is printed with the heap lock held
+	liballoc_lock();
+	memcpy(tag_stats, _kheap_tag_stats, sizeof(tag_stats));
+
+#ifdef KHEAP_TRACK_ALLOCATION_SITES
+	// Insertion sort the sites with the most live bytes into the top list
+	for (uint32_t i = 0; i < KHEAP_SITE_TABLE_SIZE + 1; i++) {
+		kheap_site_stats_t* site = i < KHEAP_SITE_TABLE_SIZE ? &_kheap_site_stats[i] : &_kheap_overflow_site_stats;
+		if (!site->live_bytes) {
+			continue;
+		}
+		for (uint32_t j = 0; j < top_site_count; j++) {
+			if (site->live_bytes > top_sites[j].live_bytes) {
+				memmove(&top_sites[j + 1], &top_sites[j], (top_site_count - j - 1) * sizeof(kheap_site_stats_t));
+				top_sites[j] = *site;
+				break;
+			}
+		}
+	}
+#endif
+
+	for (struct liballoc_major* maj = l_memRoot; maj != NULL; maj = maj->next) {
+		kheap_major_stats_t stats;
+		_kheap_major_stats(maj, &stats);
+		if (major_count < KHEAP_DUMP_MAX_MAJORS) {
+			majors[major_count] = stats;
+		}
+		major_count += 1;
+		heap_size += stats.size;
+		heap_usage += stats.usage;
+		largest_free_gap = max(largest_free_gap, stats.largest_free_gap);
+	}
+	liballoc_unlock();
+
+	printf("[Kernel heap] %d bytes in use in %d bytes of major blocks\n", l_inuse, heap_size);
+	for (uint32_t i = 0; i < KHEAP_TAG_COUNT; i++) {
+		kheap_tag_stats_t* stats = &tag_stats[i];
+		printf("\t%s: %d live bytes in %d allocations (peak %d bytes, %d allocations total)\n", kheap_tag_name(i), stats->live_bytes, stats->live_allocations, stats->peak_live_bytes, stats->total_allocations);
+	}
+
+#ifdef KHEAP_TRACK_ALLOCATION_SITES
+	printf("[Kernel heap] Top %d allocation sites by live bytes:\n", top_site_count);
+	for (uint32_t i = 0; i < top_site_count && top_sites[i].live_bytes; i++) {
+		kheap_site_stats_t* site = &top_sites[i];
+		const char* symbol = site->site ? elf_sym_lookup(&boot_info_get()->kernel_elf_symbol_table, site->site) : NULL;
+		printf("\t0x%p (%s, %s): %d live bytes in %d allocations, %d allocations total\n", site->site, symbol ? symbol : "?", kheap_tag_name(site->tag), site->live_bytes, site->live_allocations, site->total_allocations);
+	}
+#endif
+
+	// Fragmentation is the share of free memory that can't be handed out as one allocation
+	uint64_t free_bytes = heap_size - heap_usage;
+	uint64_t fragmentation_percent = free_bytes ? 100 - ((largest_free_gap * 100) / free_bytes) : 0;
+	printf("[Kernel heap] %d major blocks, %d free bytes, largest free gap %d bytes, %d%% fragmented\n", major_count, free_bytes, largest_free_gap, fragmentation_percent);
+	for (uint32_t i = 0; i < min(major_count, KHEAP_DUMP_MAX_MAJORS); i++) {
+		kheap_major_stats_t* maj = &majors[i];
+		printf("\tMajor %d: %d / %d bytes used (%d%%), largest free gap %d bytes\n", i, maj->usage, maj->size, (maj->usage * 100) / maj->size, maj->largest_free_gap);
+	}
+	if (major_count > KHEAP_DUMP_MAX_MAJORS) {
+		printf("\t... and %d more major blocks\n", major_count - KHEAP_DUMP_MAX_MAJORS);
+	}
+}
+
+
+
 // ***************************************************************
 
 struct liballoc_major *allocate_new_page( unsigned int size )
@@ -330,7 +548,7 @@ struct liballoc_major *allocate_new_page( unsigned int size )
 	
 
 
-void *PREFIX(malloc)(size_t req_size)
+static void* _liballoc_malloc(size_t req_size)
 {
 	int startedBet = 0;
 	unsigned long long bestSize = 0;
@@ -358,7 +576,7 @@ void *PREFIX(malloc)(size_t req_size)
 							__builtin_return_address(0) );
 		FLUSH();
 		liballoc_unlock();
-		return PREFIX(malloc)(1);
+		return _liballoc_malloc(1);
 	}
 	
 
@@ -747,6 +965,7 @@ void PREFIX(free)(void *ptr)
 
 		maj = min->block;
 
+		_kheap_account_free(min);
 		l_inuse -= min->size;
 
 		maj->usage -= (min->size + sizeof( struct liballoc_minor ));
@@ -797,20 +1016,41 @@ void PREFIX(free)(void *ptr)
 
 
 
-void* PREFIX(calloc)(size_t nobj, size_t size)
+void *PREFIX(malloc)(size_t size)
+{
+	return _kheap_alloc(size, (uintptr_t)__builtin_return_address(0), KHEAP_TAG_UNTAGGED);
+}
+
+void* kmalloc_tagged(size_t size, kheap_tag_t tag)
+{
+	return _kheap_alloc(size, (uintptr_t)__builtin_return_address(0), tag);
+}
+
+static void* _kheap_calloc(size_t nobj, size_t size, uintptr_t site, kheap_tag_t tag)
 {
        int real_size;
        void *p;
 
        real_size = nobj * size;
        
-       p = PREFIX(malloc)( real_size );
+       p = _kheap_alloc( real_size, site, tag );
+       if ( p == NULL ) return NULL;
 
        liballoc_memset( p, 0, real_size );
 
        return p;
 }
 
+void* PREFIX(calloc)(size_t nobj, size_t size)
+{
+	return _kheap_calloc(nobj, size, (uintptr_t)__builtin_return_address(0), KHEAP_TAG_UNTAGGED);
+}
+
+void* kcalloc_tagged(size_t nobj, size_t size, kheap_tag_t tag)
+{
+	return _kheap_calloc(nobj, size, (uintptr_t)__builtin_return_address(0), tag);
+}
+
 
 
 void*   PREFIX(realloc)(void *p, size_t size)
@@ -827,7 +1067,7 @@ void*   PREFIX(realloc)(void *p, size_t size)
 	}
 
 	// In the case of a NULL pointer, return a simple malloc.
-	if ( p == NULL ) return PREFIX(malloc)( size );
+	if ( p == NULL ) return _kheap_alloc( size, (uintptr_t)__builtin_return_address(0), KHEAP_TAG_UNTAGGED );
 
 	// Unalign the pointer if required.
 	ptr = p;
@@ -880,15 +1120,21 @@ void*   PREFIX(realloc)(void *p, size_t size)
 
 		if ( real_size >= size ) 
 		{
+			_kheap_account_free(min);
 			min->req_size = size;
+			_kheap_account_alloc(min, min->site, min->tag);
 			liballoc_unlock();
 			return p;
 		}
 
+		// The new allocation stays attributed to whoever made the original one
+		uintptr_t site = min->site;
+		kheap_tag_t tag = min->tag;
+
 	liballoc_unlock();
 
 	// If we got here then we're reallocating to a block bigger than us.
-	ptr = PREFIX(malloc)( size );					// We need to allocate new memory
+	ptr = _kheap_alloc( size, site, tag );					// We need to allocate new memory
 	liballoc_memcpy( ptr, p, real_size );
 	PREFIX(free)( p );
 
@@ -71,6 +71,40 @@ extern void     PREFIX(free)(void *);					///< The standard function.
 
 uint32_t kheap_allocated_memory(void);
 
+/*
+ * Allocation accounting
+ * Every allocation is attributed to the address it was requested from, and to a subsystem tag.
+ * Subsystems opt in to tagging by allocating through the _tagged variants.
+ */
+
+typedef enum kheap_tag {
+	KHEAP_TAG_UNTAGGED = 0,
+	KHEAP_TAG_AMC,
+	KHEAP_TAG_VMM,
+	KHEAP_TAG_TASKING,
+	KHEAP_TAG_ELF,
+	KHEAP_TAG_DIAGNOSTICS,
+	KHEAP_TAG_COUNT
+} kheap_tag_t;
+
+typedef struct kheap_tag_stats {
+	// Bytes requested by allocations that haven't been freed yet
+	uint64_t live_bytes;
+	uint64_t peak_live_bytes;
+	uint64_t live_allocations;
+	uint64_t total_allocations;
+} kheap_tag_stats_t;
+
+void* kmalloc_tagged(size_t size, kheap_tag_t tag);
+void* kcalloc_tagged(size_t count, size_t size, kheap_tag_t tag);
+
+const char* kheap_tag_name(kheap_tag_t tag);
+void kheap_get_tag_stats(kheap_tag_t tag, kheap_tag_stats_t* out);
+
+// Prints the accounting for each tag, the top allocation sites by live bytes,
+// and how well the heap's major blocks are utilized
+void kheap_dump_allocation_stats(uint32_t top_site_count);
+
 #ifdef __cplusplus
 }
 #endif
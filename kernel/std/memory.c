@@ -1,69 +1,237 @@
 #include "memory.h"
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <std/kheap.h>
 
-int memcmp(const void* aptr, const void* bptr, size_t size) {
-	const unsigned char* a = (const unsigned char*) aptr;
-	const unsigned char* b = (const unsigned char*) bptr;
-	for (size_t i = 0; i < size; i++) {
-		if (a[i] < b[i]) {
-			return -1;
-		}
-		else if (b[i] > a[i]) {
-			return 1;
-		}
+// The string instructions are used for anything that isn't tiny.
+// The kernel is built without SSE, so the only wider-than-64-bit moves available are
+// the microcoded fast-string paths.
+// ERMS: "Enhanced REP MOVSB/STOSB" - byte-granular string ops are at least as fast as qword ones,
+// once past a startup cost.
+// FSRM: "Fast short REP MOV" - the startup cost is gone, so rep movsb is the best choice at every size.
+#define CPUID_LEAF7_EBX_ERMS (1 << 9)
+#define CPUID_LEAF7_EDX_FSRM (1 << 4)
+
+// Below this, rep movsb/stosb on ERMS-only CPUs loses to an aligned rep movsq/stosq
+#define MEMORY_ERMS_THRESHOLD 256
+// Sizes below this are handled with a few overlapping scalar moves
+#define MEMORY_SMALL_THRESHOLD 16
+
+typedef uint64_t __attribute__((may_alias, aligned(1))) unaligned_u64_t;
+typedef uint32_t __attribute__((may_alias, aligned(1))) unaligned_u32_t;
+typedef uint16_t __attribute__((may_alias, aligned(1))) unaligned_u16_t;
+
+static bool _cpu_has_erms = false;
+static bool _cpu_has_fsrm = false;
+
+void memory_detect_cpu_features(void) {
+	uint32_t max_leaf, ebx, ecx, edx;
+	asm volatile("cpuid" : "=a"(max_leaf), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0));
+	if (max_leaf < 7) {
+		return;
 	}
-	return 0;
+	uint32_t eax;
+	asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+	_cpu_has_erms = (ebx & CPUID_LEAF7_EBX_ERMS) != 0;
+	_cpu_has_fsrm = (edx & CPUID_LEAF7_EDX_FSRM) != 0;
 }
 
-void* memset(void* bufptr, int value, size_t size) {
-	//how many 32b chunks we can write
-	uint32_t num_dwords = size / 4;
-	//leftover bytes that couldn't be set in a larger chunk
-	uint32_t num_bytes = size % 4;
-	//write in 32b chunks
-	uint32_t* dest32 = (uint32_t*)bufptr;
-	uint8_t* dest8 = ((uint8_t*)bufptr) + (num_dwords * 4);
+void memory_get_cpu_features(bool* out_erms, bool* out_fsrm) {
+	*out_erms = _cpu_has_erms;
+	*out_fsrm = _cpu_has_fsrm;
+}
+
+static inline bool _should_use_rep_byte_ops(size_t size) {
+	return _cpu_has_fsrm || (_cpu_has_erms && size >= MEMORY_ERMS_THRESHOLD);
+}
+
+static inline void _rep_movsb(uint8_t* dst, const uint8_t* src, size_t count) {
+	asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(count) : : "memory");
+}
+
+static inline void _rep_movsq(uint8_t* dst, const uint8_t* src, size_t qword_count) {
+	asm volatile("rep movsq" : "+D"(dst), "+S"(src), "+c"(qword_count) : : "memory");
+}
+
+static inline void _rep_stosb(uint8_t* dst, uint8_t value, size_t count) {
+	asm volatile("rep stosb" : "+D"(dst), "+c"(count) : "a"(value) : "memory");
+}
+
+static inline void _rep_stosq(uint8_t* dst, uint64_t value, size_t qword_count) {
+	asm volatile("rep stosq" : "+D"(dst), "+c"(qword_count) : "a"(value) : "memory");
+}
+
+// Copies fewer than MEMORY_SMALL_THRESHOLD bytes.
+// Every load happens before any store, so this is also safe for overlapping buffers.
+static inline void _copy_small(uint8_t* dst, const uint8_t* src, size_t size) {
+	if (size >= 8) {
+		uint64_t head = *(const unaligned_u64_t*)src;
+		uint64_t tail = *(const unaligned_u64_t*)(src + size - 8);
+		*(unaligned_u64_t*)dst = head;
+		*(unaligned_u64_t*)(dst + size - 8) = tail;
+	}
+	else if (size >= 4) {
+		uint32_t head = *(const unaligned_u32_t*)src;
+		uint32_t tail = *(const unaligned_u32_t*)(src + size - 4);
+		*(unaligned_u32_t*)dst = head;
+		*(unaligned_u32_t*)(dst + size - 4) = tail;
+	}
+	else if (size >= 2) {
+		uint16_t head = *(const unaligned_u16_t*)src;
+		uint16_t tail = *(const unaligned_u16_t*)(src + size - 2);
+		*(unaligned_u16_t*)dst = head;
+		*(unaligned_u16_t*)(dst + size - 2) = tail;
+	}
+	else if (size == 1) {
+		*dst = *src;
+	}
+}
+
+// Copies forwards, so this is also safe for overlapping buffers when dst < src
+static void _copy_forwards(uint8_t* dst, const uint8_t* src, size_t size) {
+	if (size < MEMORY_SMALL_THRESHOLD) {
+		_copy_small(dst, src, size);
+		return;
+	}
+	if (_should_use_rep_byte_ops(size)) {
+		_rep_movsb(dst, src, size);
+		return;
+	}
+
+	// Align the destination so that the qword stores don't split cache lines
+	size_t head = (-(uintptr_t)dst) & 7;
+	_rep_movsb(dst, src, head);
+	dst += head;
+	src += head;
+	size -= head;
+
+	_rep_movsq(dst, src, size / 8);
+	dst += size & ~7;
+	src += size & ~7;
+
+	_rep_movsb(dst, src, size & 7);
+}
+
+// Copies backwards, for overlapping buffers where dst > src
+static void _copy_backwards(uint8_t* dst, const uint8_t* src, size_t size) {
+	if (size < MEMORY_SMALL_THRESHOLD) {
+		_copy_small(dst, src, size);
+		return;
+	}
+
+	// The fast-string microcode only applies to forward copies, so always use qwords here.
+	// Align the end of the destination first.
+	// This is a single asm block as DF must be clear again before any function call.
+	uint8_t* dst_last = dst + size - 1;
+	const uint8_t* src_last = src + size - 1;
+	size_t tail = (uintptr_t)(dst + size) & 7;
+	size_t qword_count = (size - tail) / 8;
+	size_t head = (size - tail) & 7;
+	asm volatile(
+		"std\n"
+		"rep movsb\n"
+		// Point at the start of the last qword
+		"sub $7, %%rdi\n"
+		"sub $7, %%rsi\n"
+		"mov %[qword_count], %%rcx\n"
+		"rep movsq\n"
+		// Point at the last byte of the head
+		"add $7, %%rdi\n"
+		"add $7, %%rsi\n"
+		"mov %[head], %%rcx\n"
+		"rep movsb\n"
+		"cld\n"
+		: "+D"(dst_last), "+S"(src_last), "+c"(tail)
+		: [qword_count] "r"(qword_count), [head] "r"(head)
+		: "memory"
+	);
+}
 
-	uint32_t val32 = value | (value << 8) | (value << 16) | (value << 24);
+void* memcpy(void* restrict dstptr, const void* restrict srcptr, size_t size) {
+	_copy_forwards((uint8_t*)dstptr, (const uint8_t*)srcptr, size);
+	return dstptr;
+}
+
+void* memmove(void* dstptr, const void* srcptr, size_t size) {
+	uint8_t* dst = (uint8_t*)dstptr;
+	const uint8_t* src = (const uint8_t*)srcptr;
+	if (dst == src || size == 0) {
+		return dstptr;
+	}
+	// Forward copies are safe unless the destination starts within the source
+	if (dst < src || dst >= src + size) {
+		_copy_forwards(dst, src, size);
+	}
+	else {
+		_copy_backwards(dst, src, size);
+	}
+	return dstptr;
+}
+
+void* memset(void* bufptr, int value, size_t size) {
+	uint8_t* dst = (uint8_t*)bufptr;
 	uint8_t val8 = (uint8_t)value;
+	uint64_t val64 = val8 * 0x0101010101010101ULL;
 
-	//write 4 byte chunks
-	for (uint32_t i = 0; i < num_dwords; i++) {
-		dest32[i] = val32;
+	if (size < MEMORY_SMALL_THRESHOLD) {
+		if (size >= 8) {
+			*(unaligned_u64_t*)dst = val64;
+			*(unaligned_u64_t*)(dst + size - 8) = val64;
+		}
+		else if (size >= 4) {
+			*(unaligned_u32_t*)dst = (uint32_t)val64;
+			*(unaligned_u32_t*)(dst + size - 4) = (uint32_t)val64;
+		}
+		else {
+			for (size_t i = 0; i < size; i++) {
+				dst[i] = val8;
+			}
+		}
+		return bufptr;
 	}
-	//write leftover bytes
-	for (uint32_t i = 0; i < num_bytes; i++) {
-		dest8[i] = val8;
+
+	if (_should_use_rep_byte_ops(size)) {
+		_rep_stosb(dst, val8, size);
+		return bufptr;
 	}
+
+	size_t head = (-(uintptr_t)dst) & 7;
+	_rep_stosb(dst, val8, head);
+	dst += head;
+	size -= head;
+
+	_rep_stosq(dst, val64, size / 8);
+	dst += size & ~7;
+
+	_rep_stosb(dst, val8, size & 7);
 	return bufptr;
 }
 
-/*
-void* memcpy(void* dstptr, const void* srcptr, size_t size) {
-	//how many 32b chunks we can write
-	uint32_t num_dwords = size / 4;
-	//leftover bytes that couldn't be written in larger chunk
-	uint32_t num_bytes = size % 4;
-	//write in 32b chunks
-	uint32_t* dest32 = (uint32_t*)dstptr;
-	uint32_t* src32 = (uint32_t*)srcptr;
-	//find where we need to start writing byte-wise
-	uint8_t* dest8 = ((uint8_t*)dstptr) + (num_dwords * 4);
-	uint8_t* src8 = ((uint8_t*)srcptr) + (num_dwords * 4);
+int memcmp(const void* aptr, const void* bptr, size_t size) {
+	const uint8_t* a = (const uint8_t*)aptr;
+	const uint8_t* b = (const uint8_t*)bptr;
 
-	//write large chunks
-	for (uint32_t i = 0; i < num_dwords; i++) {
-		dest32[i] = src32[i];
+	// Compare a qword at a time until there's a mismatch
+	while (size >= 8) {
+		uint64_t a64 = *(const unaligned_u64_t*)a;
+		uint64_t b64 = *(const unaligned_u64_t*)b;
+		if (a64 != b64) {
+			// Little-endian, so the lowest differing bit is in the first differing byte
+			size_t byte_idx = __builtin_ctzll(a64 ^ b64) / 8;
+			return (int)a[byte_idx] - (int)b[byte_idx];
+		}
+		a += 8;
+		b += 8;
+		size -= 8;
 	}
-	//write leftover bytes
-	for (uint32_t i = 0; i < num_bytes; i++) {
-		dest8[i] = src8[i];
+	for (size_t i = 0; i < size; i++) {
+		if (a[i] != b[i]) {
+			return (int)a[i] - (int)b[i];
+		}
 	}
-	return dstptr;
+	return 0;
 }
-*/
 
 void memadd(void* dstptr, void* srcptr, size_t size) {
 	//how many 32b chunks we can write
@@ -113,64 +281,3 @@ void* realloc(void* ptr, size_t size) {
 	kfree(ptr);
 	return newptr;
 }
-
-void *memcpy(void *restrict s1, const void *restrict s2, size_t n) {
-    // Check for bad usage of memcpy
-    if(!n) {
-		return s1;
-	}
-    
-	char *p1 = (char*)s1;
-    const char *p2 = (const char*)s2;
-
-    // calculate the distance to the nearest natural boundary
-    size_t offset = (sizeof(size_t) - ((size_t)p1 % sizeof(size_t))) % sizeof(size_t);
-
-    size_t unused;
-    // see if it's even worth aligning
-    if(n <= sizeof(size_t)) {
-        asm volatile("rep movsb;":"=c"(unused):"D"(p1), "S"(p2), "c"(n));
-        return s1;
-    }
-
-    n -= offset;
-
-    // align p1 on a natural boundary
-    asm volatile("rep movsb;":"=D"(p1), "=S"(p2), "=c"(unused):"D"(p1), "S"(p2), "c"(offset));
-
-    // move in size_t size'd blocks
-    asm volatile("rep movsl;":"=D"(p1), "=S"(p2), "=c"(unused):"D"(p1), "S"(p2), "c"(n >> 2));
-
-    // clean up the remaining bytes
-    asm volatile("rep movsb;":"=c"(unused):"D"(p1), "S"(p2), "c"(n % sizeof(size_t)));
-
-    return s1;
-}
-
-void* memmove(void* dest, const void* src, size_t count) {
-    uint8_t* from = (uint8_t*)src;
-    uint8_t* to = (uint8_t*)dest;
-
-    if (from == to || count == 0) {
-        return dest;
-    }
-
-    if (to > from && to - from < (int)count) {
-        // `to` overlaps with `from` (and `from` is first)
-        // Copy in reverse, to avoid overwriting `from`
-        for (int i = count - 1; i >= 0; i--) {
-            to[i] = from[i];
-        }
-        return dest;
-    }
-    if (from > to && from - to < (int)count) {
-        // `to` overlaps with `from` (and `to` is first)
-        // Copy forwards, to avoid overwriting `from`
-        for(size_t i = 0; i < count; i++) {
-            to[i] = from[i];
-        }
-        return dest;
-    }
-    memcpy(dest, src, count);
-    return dest;
-}
@@ -3,6 +3,7 @@
 
 #include "std_base.h"
 #include <stddef.h>
+#include <stdbool.h>
 
 __BEGIN_DECLS
 
@@ -13,7 +14,11 @@ STDAPI void memadd(void*, void*, size_t);
 STDAPI void* calloc(size_t num, size_t size);
 STDAPI void* realloc(void* ptr, size_t size);
 STDAPI void* memcpy(void* __restrict, const void* __restrict, size_t);
-void* memmove(void* dest, const void* src, size_t count);
+
+// Selects the fastest string instructions supported by the CPU
+// The primitives are usable before this is called, but may be slower
+void memory_detect_cpu_features(void);
+void memory_get_cpu_features(bool* out_erms, bool* out_fsrm);
 
 __END_DECLS
 
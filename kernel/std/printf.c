@@ -275,7 +275,7 @@ typedef enum {
     PRINT_DESTINATION_SERIAL,
 } print_destination;
 
-static int print_common(print_destination dest, const char* fmt, va_list va) {
+static int print_common(print_destination dest, log_severity_t severity, const char* fmt, va_list va) {
     if (dest != PRINT_DESTINATION_TEXT_MODE && dest != PRINT_DESTINATION_SERIAL) {
         assert(0, "print_common called with bad args");
         return -1;
@@ -292,7 +292,7 @@ static int print_common(print_destination dest, const char* fmt, va_list va) {
     switch (dest) {
         case PRINT_DESTINATION_SERIAL:
         default:
-            serial_puts(buf);
+            serial_puts_with_severity(buf, severity);
             break;
     }
 
@@ -302,7 +302,7 @@ static int print_common(print_destination dest, const char* fmt, va_list va) {
 int printf(const char* format, ...) {
     va_list arg_list;
     va_start(arg_list, format);
-    int ret = print_common(PRINT_DESTINATION_SERIAL, format, arg_list);
+    int ret = print_common(PRINT_DESTINATION_SERIAL, LOG_SEVERITY_INFO, format, arg_list);
     va_end(arg_list);
     return ret;
 }
@@ -310,21 +310,17 @@ int printf(const char* format, ...) {
 int printk(const char* format, ...) {
     va_list arg_list;
     va_start(arg_list, format);
-    int ret = print_common(PRINT_DESTINATION_SERIAL, format, arg_list);
+    int ret = print_common(PRINT_DESTINATION_SERIAL, LOG_SEVERITY_INFO, format, arg_list);
     va_end(arg_list);
     return ret;
 
 }
 
-static int print_annotated_common(print_destination dest, const char* prefix, const char* suffix, const char* format, va_list va) {
-    return 0;
-    int total_len = 0;
-
-    total_len += print_common(dest, prefix, NULL);
-    total_len += print_common(dest, format, va);
-    total_len += print_common(dest, suffix, NULL);
-
-    return total_len;
+static int print_annotated_common(print_destination dest, log_severity_t severity, const char* prefix, const char* suffix, const char* format, va_list va) {
+    // Format the whole line up-front so that it's recorded as a single log entry
+    char annotated_format[256];
+    snprintf(annotated_format, sizeof(annotated_format), "%s%s%s", prefix, format, suffix);
+    return print_common(dest, severity, annotated_format, va);
 }
 
 // TODO(PT): Drop printf() or printk() as the variants now do the same thing
@@ -332,7 +328,7 @@ int printf_dbg(const char* format, ...) {
     return 0;
     va_list va;
     va_start(va, format);
-    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, "[debug ", "]\n", format, va);
+    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, LOG_SEVERITY_INFO, "[debug ", "]\n", format, va);
     va_end(va);
     return ret;
 }
@@ -341,7 +337,7 @@ int printk_dbg(const char* format, ...) {
     return 0;
     va_list va;
     va_start(va, format);
-    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, "[debug ", "]\n", format, va);
+    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, LOG_SEVERITY_INFO, "[debug ", "]\n", format, va);
     va_end(va);
     return ret;
 }
@@ -350,7 +346,7 @@ int printf_info(const char* format, ...) {
     return 0;
     va_list va;
     va_start(va, format);
-    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, "[info ", "]\n", format, va);
+    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, LOG_SEVERITY_INFO, "[info ", "]\n", format, va);
     va_end(va);
     return ret;
 }
@@ -359,25 +355,23 @@ int printk_info(const char* format, ...) {
     return 0;
     va_list va;
     va_start(va, format);
-    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, "[info ", "]\n", format, va);
+    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, LOG_SEVERITY_INFO, "[info ", "]\n", format, va);
     va_end(va);
     return ret;
 }
 
 int printf_err(const char* format, ...) {
-    return 0;
     va_list va;
     va_start(va, format);
-    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, "[error ", "]\n", format, va);
+    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, LOG_SEVERITY_ERROR, "[error ", "]\n", format, va);
     va_end(va);
     return ret;
 }
 
 int printk_err(const char* format, ...) {
-    return 0;
     va_list va;
     va_start(va, format);
-    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, "[error ", "]\n", format, va);
+    int ret = print_annotated_common(PRINT_DESTINATION_SERIAL, LOG_SEVERITY_ERROR, "[error ", "]\n", format, va);
     va_end(va);
     return ret;
 }
@@ -0,0 +1,263 @@
+#include "slab.h"
+#include <std/kheap.h>
+#include <std/printf.h>
+
+#include <kernel/assert.h>
+#include <kernel/smp.h>
+#include <kernel/pmm/pmm.h>
+#include <kernel/vmm/vmm.h>
+#include <kernel/util/spinlock/spinlock.h>
+
+#define SLAB_OBJECT_ALIGNMENT 16
+#define SLAB_MAGAZINE_CAPACITY 30
+
+typedef struct slab_magazine {
+	struct slab_magazine* next;
+	uint32_t count;
+	void* objects[SLAB_MAGAZINE_CAPACITY];
+} slab_magazine_t;
+
+typedef struct slab_cpu_cache {
+	slab_magazine_t* loaded;
+	slab_magazine_t* previous;
+	// Counters are kept per-CPU so that the fast paths don't write to shared state
+	uint64_t allocations;
+	uint64_t frees;
+	uint64_t depot_visits;
+	// Keep each CPU's cache on its own cache line
+	uint8_t padding[24];
+} slab_cpu_cache_t;
+
+struct slab_cache {
+	const char* name;
+	uint32_t object_size;
+	uint32_t objects_per_slab;
+	slab_constructor_t constructor;
+
+	// Protects everything below
+	spinlock_t depot_lock;
+	slab_magazine_t* full_magazines;
+	slab_magazine_t* empty_magazines;
+	uint64_t slab_count;
+
+	struct slab_cache* next;
+	slab_cpu_cache_t cpu_caches[MAX_PROCESSORS];
+};
+
+static spinlock_t _slab_caches_lock = {.name = "[Slab caches lock]"};
+static slab_cache_t* _slab_caches = NULL;
+
+// Magazines are shared by every cache, and are never returned to the PMM
+static spinlock_t _magazine_pool_lock = {.name = "[Slab magazine pool lock]"};
+static slab_magazine_t* _free_magazines = NULL;
+
+static uint64_t _irq_disable_save(void) {
+	uint64_t rflags;
+	asm volatile("pushfq; popq %0; cli" : "=r"(rflags) : : "memory");
+	return rflags;
+}
+
+static void _irq_restore(uint64_t rflags) {
+	// Interrupt enable flag
+	if (rflags & (1 << 9)) {
+		asm volatile("sti" : : : "memory");
+	}
+}
+
+/*
+ * Magazines
+ */
+
+static slab_magazine_t* _magazine_alloc(void) {
+	spinlock_acquire(&_magazine_pool_lock);
+	if (!_free_magazines) {
+		slab_magazine_t* magazines = (slab_magazine_t*)PMA_TO_VMA(pmm_alloc());
+		for (uint32_t i = 0; i < PAGE_SIZE / sizeof(slab_magazine_t); i++) {
+			magazines[i].next = _free_magazines;
+			_free_magazines = &magazines[i];
+		}
+	}
+	slab_magazine_t* magazine = _free_magazines;
+	_free_magazines = magazine->next;
+	spinlock_release(&_magazine_pool_lock);
+
+	magazine->next = NULL;
+	magazine->count = 0;
+	return magazine;
+}
+
+// The following helpers must be called with the cache's depot lock held
+
+static void _depot_push(slab_magazine_t** list, slab_magazine_t* magazine) {
+	magazine->next = *list;
+	*list = magazine;
+}
+
+static slab_magazine_t* _depot_pop(slab_magazine_t** list) {
+	slab_magazine_t* magazine = *list;
+	if (magazine) {
+		*list = magazine->next;
+		magazine->next = NULL;
+	}
+	return magazine;
+}
+
+static slab_magazine_t* _depot_take_empty_magazine(slab_cache_t* cache) {
+	slab_magazine_t* magazine = _depot_pop(&cache->empty_magazines);
+	return magazine ? magazine : _magazine_alloc();
+}
+
+static void _slab_grow(slab_cache_t* cache) {
+	uint8_t* slab = (uint8_t*)PMA_TO_VMA(pmm_alloc());
+	cache->slab_count += 1;
+
+	slab_magazine_t* magazine = NULL;
+	for (uint32_t i = 0; i < cache->objects_per_slab; i++) {
+		void* object = slab + (i * cache->object_size);
+		if (cache->constructor) {
+			cache->constructor(object);
+		}
+
+		if (!magazine) {
+			magazine = _depot_take_empty_magazine(cache);
+		}
+		magazine->objects[magazine->count++] = object;
+		if (magazine->count == SLAB_MAGAZINE_CAPACITY) {
+			_depot_push(&cache->full_magazines, magazine);
+			magazine = NULL;
+		}
+	}
+	// Partially-filled magazines are treated as full, as they can satisfy allocations
+	if (magazine) {
+		_depot_push(&cache->full_magazines, magazine);
+	}
+}
+
+/*
+ * Public interface
+ */
+
+slab_cache_t* slab_cache_create(const char* name, uint32_t object_size, slab_constructor_t constructor) {
+	object_size = (object_size + (SLAB_OBJECT_ALIGNMENT - 1)) & ~(SLAB_OBJECT_ALIGNMENT - 1);
+	assert(object_size <= PAGE_SIZE, "Slab objects must fit within a page");
+
+	slab_cache_t* cache = kcalloc(1, sizeof(slab_cache_t));
+	cache->name = name;
+	cache->object_size = object_size;
+	cache->objects_per_slab = PAGE_SIZE / object_size;
+	cache->constructor = constructor;
+	cache->depot_lock.name = "[Slab depot lock]";
+
+	spinlock_acquire(&_slab_caches_lock);
+	cache->next = _slab_caches;
+	_slab_caches = cache;
+	spinlock_release(&_slab_caches_lock);
+	return cache;
+}
+
+static void* _slab_alloc_slow(slab_cache_t* cache, slab_cpu_cache_t* cpu_cache) {
+	spinlock_acquire(&cache->depot_lock);
+	if (!cache->full_magazines) {
+		_slab_grow(cache);
+	}
+	// Both of the CPU's magazines are empty. Swap the older one for a full one from the depot.
+	if (cpu_cache->previous) {
+		_depot_push(&cache->empty_magazines, cpu_cache->previous);
+	}
+	cpu_cache->previous = cpu_cache->loaded;
+	cpu_cache->loaded = _depot_pop(&cache->full_magazines);
+	spinlock_release(&cache->depot_lock);
+
+	cpu_cache->depot_visits += 1;
+	return cpu_cache->loaded->objects[--cpu_cache->loaded->count];
+}
+
+void* slab_alloc(slab_cache_t* cache) {
+	uint64_t rflags = _irq_disable_save();
+	slab_cpu_cache_t* cpu_cache = &cache->cpu_caches[cpu_id()];
+	cpu_cache->allocations += 1;
+
+	void* object = NULL;
+	if (cpu_cache->loaded && cpu_cache->loaded->count > 0) {
+		object = cpu_cache->loaded->objects[--cpu_cache->loaded->count];
+	}
+	else if (cpu_cache->previous && cpu_cache->previous->count > 0) {
+		slab_magazine_t* loaded = cpu_cache->loaded;
+		cpu_cache->loaded = cpu_cache->previous;
+		cpu_cache->previous = loaded;
+		object = cpu_cache->loaded->objects[--cpu_cache->loaded->count];
+	}
+	else {
+		object = _slab_alloc_slow(cache, cpu_cache);
+	}
+
+	_irq_restore(rflags);
+	return object;
+}
+
+static void _slab_free_slow(slab_cache_t* cache, slab_cpu_cache_t* cpu_cache, void* object) {
+	spinlock_acquire(&cache->depot_lock);
+	// Both of the CPU's magazines are full. Hand the older one to the depot and start an empty one.
+	if (cpu_cache->previous) {
+		_depot_push(&cache->full_magazines, cpu_cache->previous);
+	}
+	cpu_cache->previous = cpu_cache->loaded;
+	cpu_cache->loaded = _depot_take_empty_magazine(cache);
+	spinlock_release(&cache->depot_lock);
+
+	cpu_cache->depot_visits += 1;
+	cpu_cache->loaded->objects[cpu_cache->loaded->count++] = object;
+}
+
+void slab_free(slab_cache_t* cache, void* object) {
+	if (!object) {
+		return;
+	}
+
+	uint64_t rflags = _irq_disable_save();
+	slab_cpu_cache_t* cpu_cache = &cache->cpu_caches[cpu_id()];
+	cpu_cache->frees += 1;
+
+	if (cpu_cache->loaded && cpu_cache->loaded->count < SLAB_MAGAZINE_CAPACITY) {
+		cpu_cache->loaded->objects[cpu_cache->loaded->count++] = object;
+	}
+	else if (cpu_cache->previous && cpu_cache->previous->count < SLAB_MAGAZINE_CAPACITY) {
+		slab_magazine_t* loaded = cpu_cache->loaded;
+		cpu_cache->loaded = cpu_cache->previous;
+		cpu_cache->previous = loaded;
+		cpu_cache->loaded->objects[cpu_cache->loaded->count++] = object;
+	}
+	else {
+		_slab_free_slow(cache, cpu_cache, object);
+	}
+
+	_irq_restore(rflags);
+}
+
+void slab_cache_get_stats(slab_cache_t* cache, slab_cache_stats_t* out) {
+	out->name = cache->name;
+	out->object_size = cache->object_size;
+	out->allocations = 0;
+	out->frees = 0;
+	out->depot_visits = 0;
+	// The per-CPU counters are read without synchronization, so this is only a snapshot
+	for (uint32_t i = 0; i < MAX_PROCESSORS; i++) {
+		slab_cpu_cache_t* cpu_cache = &cache->cpu_caches[i];
+		out->allocations += cpu_cache->allocations;
+		out->frees += cpu_cache->frees;
+		out->depot_visits += cpu_cache->depot_visits;
+	}
+	out->slab_count = cache->slab_count;
+	out->objects_in_use = out->allocations - out->frees;
+}
+
+void slab_caches_dump(void) {
+	spinlock_acquire(&_slab_caches_lock);
+	printf("[Slab caches]\n");
+	for (slab_cache_t* cache = _slab_caches; cache != NULL; cache = cache->next) {
+		slab_cache_stats_t stats = {0};
+		slab_cache_get_stats(cache, &stats);
+		printf("\t%s (%d bytes): %d in use, %d allocs, %d frees, %d depot visits, %d slabs\n", stats.name, stats.object_size, stats.objects_in_use, stats.allocations, stats.frees, stats.depot_visits, stats.slab_count);
+	}
+	spinlock_release(&_slab_caches_lock);
+}
@@ -0,0 +1,39 @@
+#ifndef STD_SLAB_H
+#define STD_SLAB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fixed-size object caches for hot kernel objects, layered as in Bonwick's magazine allocator:
+// each CPU holds two magazines of free objects that it can allocate from and free to with
+// interrupts disabled but without taking any lock. Only when both magazines are exhausted
+// (or full) does a CPU visit the cache's depot of magazines, which is protected by a spinlock.
+// Slabs are carved from PMM frames, so caches never contend with the kernel heap.
+// Anything that isn't a fixed-size hot object should keep using kmalloc().
+
+// Objects are constructed once, when their slab is carved.
+// Callers must return objects to the cache in their constructed state.
+typedef void (*slab_constructor_t)(void* object);
+
+typedef struct slab_cache slab_cache_t;
+
+typedef struct slab_cache_stats {
+	const char* name;
+	uint32_t object_size;
+	uint64_t allocations;
+	uint64_t frees;
+	// Allocations and frees that had to visit the depot
+	uint64_t depot_visits;
+	uint64_t slab_count;
+	uint64_t objects_in_use;
+} slab_cache_stats_t;
+
+slab_cache_t* slab_cache_create(const char* name, uint32_t object_size, slab_constructor_t constructor);
+
+void* slab_alloc(slab_cache_t* cache);
+void slab_free(slab_cache_t* cache, void* object);
+
+void slab_cache_get_stats(slab_cache_t* cache, slab_cache_stats_t* out);
+void slab_caches_dump(void);
+
+#endif
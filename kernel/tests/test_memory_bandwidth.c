@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <std/printf.h>
+#include <std/memory.h>
+#include <std/kheap.h>
+#include <kernel/assert.h>
+#include <kernel/drivers/pit/pit.h>
+
+#include "test_memory_bandwidth.h"
+
+// How long to run each primitive at each size
+#define BENCHMARK_DURATION_MS 100
+
+typedef enum memory_primitive {
+    MEMORY_PRIMITIVE_MEMCPY = 0,
+    MEMORY_PRIMITIVE_MEMMOVE,
+    MEMORY_PRIMITIVE_MEMSET,
+    MEMORY_PRIMITIVE_MEMCMP,
+    MEMORY_PRIMITIVE_COUNT
+} memory_primitive_t;
+
+static const char* _primitive_names[MEMORY_PRIMITIVE_COUNT] = {"memcpy", "memmove", "memset", "memcmp"};
+
+static const uint32_t _size_classes[] = {16, 64, 256, 1024, 4096, 65536, 1024 * 1024};
+
+static void _run_primitive(memory_primitive_t primitive, uint8_t* a, uint8_t* b, uint32_t size) {
+    switch (primitive) {
+        case MEMORY_PRIMITIVE_MEMCPY:
+            memcpy(a, b, size);
+            break;
+        case MEMORY_PRIMITIVE_MEMMOVE:
+            // Overlapping, with the destination after the source, to exercise the backwards path
+            memmove(a + 8, a, size);
+            break;
+        case MEMORY_PRIMITIVE_MEMSET:
+            memset(a, 0x5a, size);
+            break;
+        case MEMORY_PRIMITIVE_MEMCMP:
+            // Identical buffers, so the whole range is compared
+            assert(memcmp(a, b, size) == 0, "memcmp benchmark buffers differed");
+            break;
+        default:
+            assert(false, "Unknown memory primitive");
+    }
+}
+
+static void _benchmark_primitive(memory_primitive_t primitive, uint8_t* a, uint8_t* b, uint32_t size) {
+    // memcmp needs matching buffers to run to completion
+    memset(a, 0xa5, size + 16);
+    memset(b, 0xa5, size + 16);
+
+    uint64_t bytes = 0;
+    uint32_t start = ms_since_boot();
+    uint32_t elapsed = 0;
+    do {
+        // Batch iterations so that reading the clock doesn't dominate small sizes
+        for (uint32_t i = 0; i < 64; i++) {
+            _run_primitive(primitive, a, b, size);
+        }
+        bytes += size * 64;
+        elapsed = ms_since_boot() - start;
+    } while (elapsed < BENCHMARK_DURATION_MS);
+
+    // No floating point in the kernel, so report hundredths of a GB/s
+    uint64_t centi_gb_per_sec = (bytes * 100) / ((uint64_t)elapsed * 1000000);
+    printf("\t%s\t%d bytes:\t%d.%02d GB/s\n", _primitive_names[primitive], size, centi_gb_per_sec / 100, centi_gb_per_sec % 100);
+}
+
+void test_memory_bandwidth(void) {
+    printf_info("Benchmarking memory primitives...");
+    bool erms = false;
+    bool fsrm = false;
+    memory_get_cpu_features(&erms, &fsrm);
+    printf("\tERMS: %d, FSRM: %d\n", erms, fsrm);
+
+    uint32_t max_size = _size_classes[(sizeof(_size_classes) / sizeof(_size_classes[0])) - 1];
+    // Leave room for the misalignment and the overlapping memmove
+    uint8_t* a_buf = kmalloc(max_size + 32);
+    uint8_t* b_buf = kmalloc(max_size + 32);
+    // Misalign the buffers so that the head and tail handling is exercised
+    uint8_t* a = a_buf + 1;
+    uint8_t* b = b_buf + 3;
+
+    for (uint32_t i = 0; i < sizeof(_size_classes) / sizeof(_size_classes[0]); i++) {
+        for (uint32_t primitive = 0; primitive < MEMORY_PRIMITIVE_COUNT; primitive++) {
+            _benchmark_primitive(primitive, a, b, _size_classes[i]);
+        }
+    }
+
+    kfree(a_buf);
+    kfree(b_buf);
+}
@@ -0,0 +1,7 @@
+#ifndef TEST_MEMORY_BANDWIDTH_H
+#define TEST_MEMORY_BANDWIDTH_H
+
+// Reports the throughput of the kernel's memory primitives at a range of sizes
+void test_memory_bandwidth(void);
+
+#endif
@@ -0,0 +1,65 @@
+#include <stdint.h>
+#include <std/printf.h>
+#include <kernel/assert.h>
+#include <kernel/smp.h>
+#include <kernel/pmm/pmm.h>
+#include <kernel/vmm/vmm.h>
+
+#include "test_vas_cow.h"
+
+// Somewhere in user space that's clear of the program image
+#define TEST_VAS_COW_BASE 0x7c0000000000
+#define TEST_VAS_COW_MARKER 0xc0ffee
+
+void test_vas_cow(void) {
+    printf_info("Testing copy-on-write address space clones...");
+    vas_state_t* parent = vas_clone(cpu_private_info()->base_vas);
+
+    // A private page, which each clone gets its own copy of on the first write
+    uint64_t private_page = vas_alloc_range(parent, TEST_VAS_COW_BASE, PAGE_SIZE, VAS_RANGE_ACCESS_LEVEL_READ_WRITE, VAS_RANGE_PRIVILEGE_LEVEL_USER);
+    uint64_t private_frame = vas_get_phys_frame(parent, private_page);
+    *(uint64_t*)PMA_TO_VMA(private_frame) = TEST_VAS_COW_MARKER;
+
+    // A shared memory page, which clones keep writing to
+    uint64_t shared_frame = pmm_alloc();
+    uint64_t shared_page = vas_reserve_range(parent, TEST_VAS_COW_BASE, PAGE_SIZE);
+    vas_map_frames(parent, shared_page, 1, &shared_frame, VAS_RANGE_ACCESS_LEVEL_READ_WRITE, VAS_RANGE_PRIVILEGE_LEVEL_USER);
+    // The mapping now holds the only reference
+    pmm_free(shared_frame);
+
+    // A physical mapping, which the PMM doesn't reference count
+    uint64_t physical_frame = pmm_alloc();
+    uint64_t physical_page = vas_map_range(parent, TEST_VAS_COW_BASE, PAGE_SIZE, physical_frame, VAS_RANGE_ACCESS_LEVEL_READ_WRITE, VAS_RANGE_PRIVILEGE_LEVEL_USER);
+
+    vas_state_t* child = vas_clone__cow(parent);
+
+    // Every page starts out backed by the parent's frames
+    assert(vas_get_phys_frame(child, private_page) == private_frame, "Private page wasn't shared");
+    assert(pmm_frame_reference_count(private_frame) == 2, "Private frame wasn't retained");
+    assert(vas_get_phys_frame(child, shared_page) == shared_frame, "Shared page wasn't shared");
+    assert(pmm_frame_reference_count(shared_frame) == 2, "Shared frame wasn't retained");
+    assert(vas_get_phys_frame(child, physical_page) == physical_frame, "Physical page wasn't shared");
+    assert(pmm_frame_reference_count(physical_frame) == 1, "Physical frame was retained");
+
+    // Only the private page is copy-on-write
+    assert(!vas_resolve_copy_on_write(child, shared_page), "Shared page was copy-on-write");
+    assert(!vas_resolve_copy_on_write(child, physical_page), "Physical page was copy-on-write");
+
+    // The child's write gives it a private copy, and leaves the parent's frame alone
+    assert(vas_resolve_copy_on_write(child, private_page), "Private page wasn't copy-on-write");
+    uint64_t child_private_frame = vas_get_phys_frame(child, private_page);
+    assert(child_private_frame != private_frame, "Child wrote to the parent's frame");
+    assert(*(uint64_t*)PMA_TO_VMA(child_private_frame) == TEST_VAS_COW_MARKER, "Private page wasn't copied");
+    assert(pmm_frame_reference_count(private_frame) == 1, "Parent's frame is still referenced by the child");
+
+    // The parent is now the last owner, so its write re-enables the frame in place
+    assert(vas_resolve_copy_on_write(parent, private_page), "Parent's page wasn't copy-on-write");
+    assert(vas_get_phys_frame(parent, private_page) == private_frame, "Last owner's frame was copied");
+    assert(!vas_resolve_copy_on_write(parent, private_page), "Last owner's page is still copy-on-write");
+
+    vas_teardown(child);
+    vas_teardown(parent);
+    // Tearing down the address spaces doesn't free physical mappings
+    pmm_free(physical_frame);
+    printf_info("Copy-on-write test passed");
+}
@@ -0,0 +1,7 @@
+#ifndef TEST_VAS_COW_H
+#define TEST_VAS_COW_H
+
+// Clones an address space copy-on-write, and checks which pages get copied on the first write
+void test_vas_cow(void);
+
+#endif
@@ -88,7 +88,6 @@ typedef struct ata_driver_state {
 } ata_driver_state_t;
 
 typedef struct ata_cache_entry {
-	uint32_t valid;
 	uint32_t sector_lba;
 	uint8_t sector_data[ATA_SECTOR_SIZE];
 } ata_cache_entry_t;
@@ -96,7 +95,25 @@ typedef struct ata_cache_entry {
 #define ATA_CACHE_MAX_SECTOR_LBA 512
 
 static ata_driver_state_t* _state = NULL;
-static ata_cache_entry_t _g_cache[ATA_CACHE_MAX_SECTOR_LBA] = {0};
+// Entries are allocated when a sector is first read, so that they can be released under memory pressure
+static ata_cache_entry_t* _g_cache[ATA_CACHE_MAX_SECTOR_LBA] = {0};
+
+static void _cache_evict(uint32_t sector) {
+	free(_g_cache[sector]);
+	_g_cache[sector] = NULL;
+}
+
+static void _cache_shrink(amc_memory_pressure_level_t level, uint64_t bytes_to_reclaim, void* ctx) {
+	// The cache is cheap to refill from the disk, so drop all of it at any level of pressure
+	uint32_t evicted_count = 0;
+	for (uint32_t i = 0; i < ATA_CACHE_MAX_SECTOR_LBA; i++) {
+		if (_g_cache[i]) {
+			_cache_evict(i);
+			evicted_count += 1;
+		}
+	}
+	printf("[ATA] Evicted %d cached sectors under memory pressure\n", evicted_count);
+}
 
 static uint8_t ata_status(void) {
 	return inb(ATA_REG_R__STATUS);
@@ -222,8 +239,11 @@ static void _int_received(uint32_t int_no) {
 			// Copy to cache
 			if (response->sector < ATA_CACHE_MAX_SECTOR_LBA) {
 				//printf("[ATA] Placing contents of sector LBA %ld in read cache...\n", response->sector);
-				_g_cache[response->sector].valid = true;
-				memcpy(_g_cache[response->sector].sector_data, response->sector_data, response_size);
+				if (!_g_cache[response->sector]) {
+					_g_cache[response->sector] = calloc(1, sizeof(ata_cache_entry_t));
+					_g_cache[response->sector]->sector_lba = response->sector;
+				}
+				memcpy(_g_cache[response->sector]->sector_data, response->sector_data, ATA_SECTOR_SIZE);
 			}
 
 			amc_message_send(queued_operation->read.source_service, response, response_size);
@@ -256,7 +276,7 @@ static void _message_received(amc_message_t* msg) {
 		// TODO(PT): Hash map a LRU cache here, invalidating on writes
 		// In cache?
 		if (false && read_request->sector < ATA_CACHE_MAX_SECTOR_LBA) {
-			if (_g_cache[read_request->sector].valid) {
+			if (_g_cache[read_request->sector]) {
 				printf("\tATA responding from read cache!\n");
 				uint32_t response_size = sizeof(ata_read_sector_response_t) + ATA_SECTOR_SIZE;
 				ata_read_sector_response_t* response = calloc(1, response_size);
@@ -264,7 +284,7 @@ static void _message_received(amc_message_t* msg) {
 				response->drive_desc = read_request->drive_desc;
 				response->sector = read_request->sector;
 				response->sector_size = ATA_SECTOR_SIZE;
-				memcpy(response->sector_data, _g_cache[read_request->sector].sector_data, ATA_SECTOR_SIZE);
+				memcpy(response->sector_data, _g_cache[read_request->sector]->sector_data, ATA_SECTOR_SIZE);
 				amc_message_send(msg->source, response, response_size);
 				free(response);
 				return;
@@ -287,8 +307,8 @@ static void _message_received(amc_message_t* msg) {
 
 		// Writes invalidate cache entries
 		if (write_request->sector < ATA_CACHE_MAX_SECTOR_LBA) {
-			if (_g_cache[write_request->sector].valid) {
-				_g_cache[write_request->sector].valid = false;
+			if (_g_cache[write_request->sector]) {
+				_cache_evict(write_request->sector);
 				//printf("[ATA] Invalidating read cache for sector %ld due to write\n", write_request->sector);
 			}
 		}
@@ -317,6 +337,7 @@ int main(int argc, char** argv) {
 	gui_application_create();
 	gui_add_interrupt_handler(INT_VECTOR_APIC_14, _int_received);
 	gui_add_message_handler(_message_received);
+	amc_memory_pressure_register_shrink_callback(_cache_shrink, NULL);
 	gui_enter_event_loop();
 	
 	return 0;
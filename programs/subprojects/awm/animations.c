@@ -7,11 +7,15 @@
 
 array_t* _g_pending_animations = NULL;
 
+void _window_resize(user_window_t* window, Size new_size, bool inform_owner);
+
 float lerp(float a, float b, float f) {
     return a + f * (b - a);
 }
 
-static void _interpolate_window_frame(user_window_t* window, Rect from, Rect to, float percent, bool should_inform_window_of_new_size) {
+// Windows are composited from their scaled snapshot while they animate,
+// so only the frame changes here and the owner doesn't relayout for each step
+static void _interpolate_window_frame(user_window_t* window, Rect from, Rect to, float percent) {
 	// Don't let the window get too small
 	// TODO(PT): Pull this out into a MIN_WINDOW_SIZE?
 	to.size.width = max(to.size.width, 1);
@@ -29,7 +33,6 @@ static void _interpolate_window_frame(user_window_t* window, Rect from, Rect to,
 		)
 	);
 	window->frame = new_frame;
-	_window_resize(window, window->frame.size, should_inform_window_of_new_size);
 
 	Rect total_update_frame = rect_union(current_frame, new_frame);
 	// Only queueing redraws for the difference between the frames is more efficient,
@@ -48,8 +51,7 @@ static void _awm_animation_close_window_step(awm_animation_close_window_t* anim,
 		window, 
 		anim->original_frame,
 		anim->destination_frame,
-		percent,
-		false
+		percent
 	);
 }
 
@@ -87,7 +89,8 @@ awm_animation_close_window_t* awm_animation_close_window_init(uint32_t duration,
 		),
 		final_size
 	);
-	//window->should_scale_layer = true;
+	// The window is torn down once the animation finishes, so the snapshot is never ended
+	window_begin_scaled_snapshot(window);
 
 	return anim;
 }
@@ -97,18 +100,27 @@ awm_animation_close_window_t* awm_animation_close_window_init(uint32_t duration,
 static void _awm_animation_open_window_step(awm_animation_open_window_t* anim, float percent) {
 	user_window_t* window = anim->window;
 	//window->layer->alpha = percent;
+	if (!anim->has_laid_out_window) {
+		// Inform the window of its final size up-front, so it only lays out once while it animates in
+		// This is deferred to the first step as the window's decorations are configured after the animation is created
+		_window_resize(window, anim->destination_frame.size, true);
+		window_begin_scaled_snapshot(window);
+		anim->has_laid_out_window = true;
+	}
+	else {
+		// The owner is drawing its first frame while the window animates in, so pick up whatever it's drawn so far
+		window_refresh_scaled_snapshot(window);
+	}
 	_interpolate_window_frame(
 		window, 
 		anim->original_frame,
 		anim->destination_frame,
-		percent,
-		true
+		percent
 	);
 }
 
 static void _awm_animation_open_window_finish(awm_animation_open_window_t* anim) {
-	// Inform the window of its initial size
-	//_window_resize(anim->window, anim->window->frame.size, true);
+	window_end_scaled_snapshot(anim->window);
 
 	// Inform the window that the resize has ended
 	amc_msg_u32_1__send(anim->window->owner_service, AWM_WINDOW_RESIZE_ENDED);
@@ -154,12 +166,14 @@ static void _awm_animation_minimize_window_step(awm_animation_minimize_window_t*
 		window, 
 		anim->original_frame,
 		anim->destination_frame,
-		percent,
-		false
+		percent
 	);
 }
 
-static void _awm_animation_minimize_window_finish(awm_animation_minimize_window_t* anim) {}
+static void _awm_animation_minimize_window_finish(awm_animation_minimize_window_t* anim) {
+	// The window stays laid out at its unminimized size, so there's nothing to restore when it's unminimized
+	window_end_scaled_snapshot(anim->window);
+}
 
 awm_animation_minimize_window_t* awm_animation_minimize_window_init(uint32_t duration, user_window_t* window, Rect dest_frame, Rect original_frame) {
 	awm_animation_minimize_window_t* anim = calloc(1, sizeof(awm_animation_minimize_window_t));
@@ -172,6 +186,7 @@ awm_animation_minimize_window_t* awm_animation_minimize_window_init(uint32_t dur
 	anim->destination_frame = dest_frame;
 	anim->original_frame = original_frame;
 	window->frame = anim->original_frame;
+	window_begin_scaled_snapshot(window);
 
 	return anim;
 }
@@ -184,15 +199,12 @@ static void _awm_animation_unminimize_window_step(awm_animation_unminimize_windo
 		window, 
 		anim->original_frame,
 		anim->destination_frame,
-		percent,
-		false
+		percent
 	);
-
-	Rect r = window->content_view->frame;
-	Rect d = anim->destination_frame;
 }
 
 static void _awm_animation_unminimize_window_finish(awm_animation_unminimize_window_t* anim) {
+	window_end_scaled_snapshot(anim->window);
 	// Allow mouse control to pass to the unminimized window
     mouse_recompute_status();
 }
@@ -208,6 +220,7 @@ awm_animation_unminimize_window_t* awm_animation_unminimize_window_init(uint32_t
 	anim->destination_frame = dest_frame;
 	anim->original_frame = original_frame;
 	window->frame = anim->original_frame;
+	window_begin_scaled_snapshot(window);
 
 	return anim;
 }
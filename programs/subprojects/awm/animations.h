@@ -28,6 +28,7 @@ typedef struct awm_animation_open_window {
 	Rect original_frame;
     Rect destination_frame;
     user_window_t* window;
+	bool has_laid_out_window;
 } awm_animation_open_window_t;
 
 typedef struct awm_animation_snap_shortcut {
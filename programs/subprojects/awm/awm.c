@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -29,6 +30,7 @@
 #include "effects.h"
 #include "awm_internal.h"
 #include "animations.h"
+#include "frame_stats.h"
 #include "composite.h"
 
 typedef enum window_resize_edge {
@@ -138,6 +140,7 @@ static Point mouse_pos = {0};
 
 void _window_resize(user_window_t* window, Size new_size, bool inform_owner);
 void _write_window_title(user_window_t* window);
+static void _window_flush_deferred_resize(user_window_t* window);
 
 Screen _screen = {0};
 
@@ -178,6 +181,11 @@ static void handle_keystroke(amc_message_t* keystroke_msg) {
 			}
 		}
 
+		// Ctrl+Shift+F toggles the frame-time HUD
+		if (g_keyboard_state.is_control_held && g_keyboard_state.is_shift_held && (event->key == 'f' || event->key == 'F')) {
+			frame_stats_toggle_hud();
+		}
+
 		// Ctrl+W closes the topmost window
 		if (g_keyboard_state.is_control_held && event->key == 'w') {
 			//window_move_to_top(windows_get_bottom_window());
@@ -350,7 +358,6 @@ static void _mouse_reset_prospective_action_flags(mouse_interaction_state_t* sta
 				);
 				should_show_window_action_icons = rect_contains_point(window_action_icons, mouse_within_window);
 			}
-			// TODO(PT): Keep track of what we last drew and only redraw if this is a state change
 			window_redraw_title_bar(
 				state->active_window, 
 				is_mouse_within_title_bar, 
@@ -487,6 +494,8 @@ static void _end_mouse_drag(mouse_interaction_state_t* state, Point mouse_point)
 			}
 		}
 		if (state->is_resizing_top_window) {
+			// Make sure the window knows its final size before it's told that the resize has ended
+			_window_flush_deferred_resize(state->active_window);
 			// Inform the window that the resize has ended
 			amc_msg_u32_1__send(state->active_window->owner_service, AWM_WINDOW_RESIZE_ENDED);
 		}
@@ -589,8 +598,8 @@ static void _handle_mouse_dragged(mouse_interaction_state_t* state, Point mouse_
 		new_size.width = max(new_size.width, 200);
 		new_size.height = max(new_size.height, 200);
 		// Or too big...
-		new_size.width = min(new_size.width, state->active_window->layer->size.width);
-		new_size.height = min(new_size.height, state->active_window->layer->size.height);
+		new_size.width = min(new_size.width, screen_resolution().width);
+		new_size.height = min(new_size.height, screen_resolution().height);
 
 		// Don't let the window go off-screen
 		Rect new_frame = rect_make(state->active_window->frame.origin, new_size);
@@ -635,9 +644,8 @@ static void _handle_mouse_scroll(mouse_interaction_state_t* state, int32_t delta
 static void mouse_dispatch_events(uint8_t status_byte, Point mouse_point, int32_t delta_x, int32_t delta_y, int32_t delta_z) {
 	mouse_interaction_state_t* mouse_state = &g_mouse_state;
 
-	// Previous mouse position should be redrawn
-	compositor_queue_rect_to_redraw(rect_make(mouse_state->mouse_pos, size_make(14, 14)));
-	// TODO(PT): This should fetch the mouse size!
+	// The cursor is an overlay, so moving it doesn't damage anything beneath it
+	compositor_queue_cursor_update();
 
 	mouse_state->mouse_pos = mouse_point;
 
@@ -691,7 +699,11 @@ static bool handle_mouse_event(amc_message_t* mouse_event, incremental_mouse_sta
 	return !updated_state_byte;
 }
 
-Rect _draw_cursor(ca_layer* dest) {
+Rect cursor_frame(void) {
+	return rect_make(mouse_pos, size_make(AWM_CURSOR_SIZE, AWM_CURSOR_SIZE));
+}
+
+void _draw_cursor(ca_layer* dest, Point origin) {
 	mouse_interaction_state_t* mouse_state = &g_mouse_state;
 	Color mouse_color = color_green();
 	if (mouse_state->is_resizing_top_window) {
@@ -708,20 +720,33 @@ Rect _draw_cursor(ca_layer* dest) {
 	}
 
 	// Draw the new cursor
-	Size cursor_size = size_make(14, 14);
-	Rect new_mouse_rect = rect_make(mouse_pos, cursor_size);
+	Rect new_mouse_rect = rect_make(origin, size_make(AWM_CURSOR_SIZE, AWM_CURSOR_SIZE));
 	draw_rect(dest, new_mouse_rect, color_black(), THICKNESS_FILLED);
 	draw_rect(
 		dest, 
 		rect_make(
 			point_make(new_mouse_rect.origin.x + 2, new_mouse_rect.origin.y + 2), 
-			size_make(10, 10)
+			size_make(AWM_CURSOR_SIZE - 4, AWM_CURSOR_SIZE - 4)
 		), 
 		mouse_color, 
 		THICKNESS_FILLED
 	);
+}
+
+static void _window_send_size_to_owner(user_window_t* window) {
+	//printf("Informing %s of its new size %d %d\n", window->owner_service, window->content_view->frame.size.width, window->content_view->frame.size.height);
+	awm_window_resized_msg_t msg = {0};
+	msg.event = AWM_WINDOW_RESIZED;
+	msg.new_size = window->content_view->frame.size;
+	amc_message_send(window->owner_service, &msg, sizeof(msg));
+	window->is_awaiting_resize_commit = true;
+	window->has_deferred_resize = false;
+}
 
-	return new_mouse_rect;
+static void _window_flush_deferred_resize(user_window_t* window) {
+	if (window->has_deferred_resize && !window->remote_process_died) {
+		_window_send_size_to_owner(window);
+	}
 }
 
 void _window_resize(user_window_t* window, Size new_size, bool inform_window) {
@@ -758,15 +783,21 @@ void _window_resize(user_window_t* window, Size new_size, bool inform_window) {
 		);
 	}
 
+	// Back the new content rows with memory before anyone draws to or composites from them
+	window_ensure_framebuffer_rows(window, window->content_view->frame.size.height);
+
 	compositor_queue_rect_difference_to_redraw(original_frame, window->frame);
 	windows_invalidate_drawable_regions_in_rect(rect_union(original_frame, window->frame));
 
 	if (inform_window && !window->remote_process_died) {
-		//printf("Informing %s of its new size %d %d\n", window->owner_service, window->content_view->frame.size.width, window->content_view->frame.size.height);
-		awm_window_resized_msg_t msg = {0};
-		msg.event = AWM_WINDOW_RESIZED;
-		msg.new_size = window->content_view->frame.size;
-		amc_message_send(window->owner_service, &msg, sizeof(msg));
+		// Each resize makes the owner relayout and redraw everything, so only keep one in flight.
+		// Sizes that arrive in the meantime are coalesced, and the newest is sent once the owner commits.
+		if (window->is_awaiting_resize_commit) {
+			window->has_deferred_resize = true;
+		}
+		else {
+			_window_send_size_to_owner(window);
+		}
 	}
 }
 
@@ -782,6 +813,8 @@ static void _update_window_title(const char* owner_service, awm_window_title_msg
 		free((char*)window->title);
 	}
 	window->title = strndup(title_msg->title, title_msg->len);
+	// The title is baked into the cached decorations
+	window->title_bar_is_drawn = false;
 	_window_resize(window, window->frame.size, false);
 
 	// Inform the dock
@@ -935,7 +968,29 @@ static void handle_user_message(amc_message_t* user_message) {
 	}
 	else if (command == AWM_WINDOW_REDRAW_READY) {
 		user_window_t* window = window_with_service_name(source_service);
-		window_queue_fetch(window);
+		awm_window_redraw_ready_msg_t* redraw_msg = (awm_window_redraw_ready_msg_t*)user_message->body;
+		if (window) {
+			// The owner has caught up, so it can be sent the newest size if the window was resized in the meantime
+			window->is_awaiting_resize_commit = false;
+			_window_flush_deferred_resize(window);
+		}
+		// Older clients send a bare event, which means the whole first framebuffer was redrawn
+		if (window && user_message->len >= offsetof(awm_window_redraw_ready_msg_t, damage_rect_count)) {
+			window_present_framebuffer(window, redraw_msg->presented_framebuffer);
+		}
+		bool has_damage_rects = user_message->len >= offsetof(awm_window_redraw_ready_msg_t, damage_rects) && redraw_msg->damage_rect_count > 0;
+		if (has_damage_rects && window && !window->is_minimized) {
+			uint32_t rects_in_message = (user_message->len - offsetof(awm_window_redraw_ready_msg_t, damage_rects)) / sizeof(Rect);
+			uint32_t damage_rect_count = min(min(redraw_msg->damage_rect_count, rects_in_message), AWM_WINDOW_REDRAW_MAX_DAMAGE_RECTS);
+			window_queue_fetch_damage(window, redraw_msg->damage_rects, damage_rect_count);
+		}
+		else {
+			window_queue_fetch(window);
+		}
+		// Minimized windows aren't fetched, so their redraws never reach the screen
+		if (window && !window->is_minimized && !window->redraw_committed_at) {
+			window->redraw_committed_at = ms_since_boot();
+		}
 	}
 	else if (command == AWM_UPDATE_WINDOW_TITLE) {
 		awm_window_title_msg_t* title_msg =  (awm_window_title_msg_t*)user_message->body;
@@ -945,6 +1000,15 @@ static void handle_user_message(amc_message_t* user_message) {
 		_remove_and_teardown_window_for_service(source_service);
 		printf("Received AWM_CLOSE_WINDOW from %s\n", source_service);
 	}
+	else if (command == AWM_FRAME_STATS_HUD_TOGGLE) {
+		frame_stats_toggle_hud();
+	}
+	else if (command == AWM_FRAME_STATS_REQUEST) {
+		frame_stats_send_records(source_service);
+	}
+	else if (command == AWM_FRAME_LATENCY_REQUEST) {
+		compositor_send_latency_histograms(source_service);
+	}
 	else {
 		printf("Unknown message from %s: %d\n", source_service, command);
 	}
@@ -1012,7 +1076,8 @@ static void _awm_init(void) {
 
 	_set_screen_resolution(_screen.resolution);
 	_set_screen_bytes_per_pixel(_screen.bytes_per_pixel);
-	//_set_screen_pixels_per_scanline(_screen.pixels_per_scanline);
+	// Framebuffer rows may be padded beyond the visible width
+	_set_screen_pixels_per_scanline(framebuffer_info->pixels_per_scanline ?: framebuffer_info->width);
 
 	_screen.vmem = create_layer(screen_resolution());
 	printf("awm framebuffer: %d x %d, %d BPP @ %p\n", _screen.resolution.width, _screen.resolution.height, _screen.bits_per_pixel, _screen.pmem->raw);
@@ -1076,9 +1141,15 @@ static void _awm_process_amc_messages(bool should_block) {
 		}
 	}
 
+	bool has_begun_timing = false;
 	do {
 		// Wait until we've unblocked with at least one message available
 		amc_message_await_any(&msg);
+		// Don't count the time spent blocked waiting for the first message
+		if (!has_begun_timing) {
+			frame_stats_phase_begin(AWM_FRAME_PHASE_AMC);
+			has_begun_timing = true;
+		}
 
 		// Will automatically respond to watchdog pings
 		if (libamc_handle_message(msg)) {
@@ -1091,10 +1162,12 @@ static void _awm_process_amc_messages(bool should_block) {
 
 		// Process the message we just received
 		if (!strcmp(source_service, KB_DRIVER_SERVICE_NAME)) {
+			compositor_note_input_event();
 			handle_keystroke(msg);
 			continue;
 		}
 		else if (!strcmp(source_service, MOUSE_DRIVER_SERVICE_NAME)) {
+			compositor_note_input_event();
 			// Update the mouse position based on the data packet
 			bool changed_state = handle_mouse_event(msg, &incremental_mouse_update);
 			if (changed_state) {
@@ -1134,36 +1207,46 @@ static void _awm_process_amc_messages(bool should_block) {
 			handle_user_message(msg);
 		}
 	} while (amc_has_message());
+	frame_stats_phase_end(AWM_FRAME_PHASE_AMC);
 }
 
-typedef enum timers_state {
-	TIMERS_LATE = 0,
-	SLEPT_FOR_TIMERS = 1,
-	NO_TIMERS = 2
-} timers_state_t;
+typedef enum deadline_state {
+	DEADLINE_PASSED = 0,
+	SLEPT_UNTIL_DEADLINE = 1,
+	NO_DEADLINES = 2
+} deadline_state_t;
+
+// Sleeps until the next timer fires or the next frame is due, whichever comes first.
+// Wakes up early if a message arrives.
+static deadline_state_t _sleep_until_next_deadline(void) {
+	int32_t time_to_next_deadline = compositor_ms_until_next_frame();
+	if (_g_timers->size > 0) {
+		uint32_t next_fire_date = 0;
+		for (uint32_t i = 0; i < _g_timers->size; i++) {
+			awm_timer_t* t = array_lookup(_g_timers, i);
+			if (!next_fire_date || t->fires_after < next_fire_date) {
+				next_fire_date = t->fires_after;
+			}
+		}
+		int32_t time_to_next_fire = max((int32_t)(next_fire_date - ms_since_boot()), 0);
+		if (time_to_next_deadline < 0 || time_to_next_fire < time_to_next_deadline) {
+			time_to_next_deadline = time_to_next_fire;
+		}
+	}
 
-static timers_state_t _sleep_for_timers(void) {
-	if (_g_timers->size == 0) {
-		return NO_TIMERS;
+	if (time_to_next_deadline < 0) {
+		return NO_DEADLINES;
 	}
-	uint32_t next_fire_date = 0;
-	for (uint32_t i = 0; i < _g_timers->size; i++) {
-        awm_timer_t* t = array_lookup(_g_timers, i);
-		if (!next_fire_date || t->fires_after < next_fire_date) {
-			next_fire_date = t->fires_after;
-		}
-    }
-	int32_t time_to_next_fire = next_fire_date - ms_since_boot();
-	if (time_to_next_fire <= 0) {
-		return TIMERS_LATE;
+	if (time_to_next_deadline == 0) {
+		return DEADLINE_PASSED;
 	}
 
 	uint32_t b[2];
-    b[0] = AMC_SLEEP_UNTIL_TIMESTAMP_OR_MESSAGE;
-    b[1] = time_to_next_fire;
-    amc_message_send(AXLE_CORE_SERVICE_NAME, &b, sizeof(b));
+	b[0] = AMC_SLEEP_UNTIL_TIMESTAMP_OR_MESSAGE;
+	b[1] = time_to_next_deadline;
+	amc_message_send(AXLE_CORE_SERVICE_NAME, &b, sizeof(b));
 
-	return SLEPT_FOR_TIMERS;
+	return SLEPT_UNTIL_DEADLINE;
 }
 
 void awm_timer_start(uint32_t duration, awm_timer_cb_t timer_cb, void* invoke_ctx) {
@@ -1200,14 +1283,18 @@ static void _awm_enter_event_loop(void) {
 	// Draw the background onto the screen buffer to start off
 	Rect screen_frame = rect_make(point_zero(), screen_resolution());
 	blit_layer(_screen.vmem, _g_background, screen_frame, screen_frame);
-	blit_layer(_screen.pmem, _g_background, screen_frame, screen_frame);
-	//blit_layer__scanline(_screen.pmem, _screen.vmem, screen_frame, screen_frame, screen_pixels_per_scanline());
+	blit_layer__scanline(_screen.pmem, _screen.vmem, screen_frame, screen_frame, screen_pixels_per_scanline());
 
 	while (true) {
-		timers_state_t timers_state = _sleep_for_timers();
-		_awm_process_amc_messages(timers_state == NO_TIMERS);
+		// Block until there's a message if there's nothing to draw and no timers to fire
+		deadline_state_t deadline_state = _sleep_until_next_deadline();
+		_awm_process_amc_messages(deadline_state == NO_DEADLINES);
+		// Timers drive animations, so they're counted as event processing
+		frame_stats_phase_begin(AWM_FRAME_PHASE_AMC);
 		_dispatch_ready_timers();
-		compositor_render_frame();
+		frame_stats_phase_end(AWM_FRAME_PHASE_AMC);
+		// Everything that was damaged since the last frame is composited together once the frame is due
+		compositor_render_frame_if_due();
 	}
 }
 
@@ -1217,6 +1304,12 @@ bool amc_service_is_awm_dock(const char* service_name) {
 
 int main(int argc, char** argv) {
 	_awm_init();
+	// Allow the compositor's frame rate to be tuned to the display, i.e. `awm --target-frame-rate 120`
+	for (int i = 1; i < argc - 1; i++) {
+		if (!strcmp(argv[i], "--target-frame-rate")) {
+			compositor_set_target_frame_rate(atoi(argv[i + 1]));
+		}
+	}
 	_awm_enter_event_loop();
 	return 0;
 }
@@ -18,7 +18,12 @@ void awm_timer_start(uint32_t duration, awm_timer_cb_t timer_cb, void* invoke_ct
 
 ca_layer* video_memory_layer(void);
 ca_layer* physical_video_memory_layer(void);
-Rect _draw_cursor(ca_layer* dest);
+#define AWM_CURSOR_SIZE 14
+
+// The cursor's current frame on the screen
+Rect cursor_frame(void);
+// Draws the cursor with its top-left corner at origin
+void _draw_cursor(ca_layer* dest, Point origin);
 
 Color background_gradient_outer_color(void);
 Color background_gradient_inner_color(void);
@@ -4,6 +4,7 @@
 #include <kernel/amc.h>
 #include <libagx/lib/size.h>
 #include <libagx/lib/point.h>
+#include <libagx/lib/rect.h>
 #include <libagx/lib/color.h>
 
 #define AWM_SERVICE_NAME "com.axle.awm"
@@ -21,15 +22,32 @@ typedef struct awm_create_window_request {
     Size window_size;
 } awm_create_window_request_t;
 
+// Each window has a swap chain of framebuffers that awm composites from directly.
+// Clients that don't swap can keep drawing to and presenting the first framebuffer.
+#define AWM_WINDOW_FRAMEBUFFER_COUNT 2
+
 #define AWM_CREATE_WINDOW_RESPONSE 800
 typedef struct awm_create_window_response {
     uint32_t event; // AWM_CREATE_WINDOW_RESPONSE
     Size screen_resolution;
     int bytes_per_pixel;
+    // Same as framebuffers[0]
     void* framebuffer;
+    void* framebuffers[AWM_WINDOW_FRAMEBUFFER_COUNT];
 } awm_create_window_response_t;
 
+// Sent by a client once it's finished drawing a frame, to make that framebuffer the one awm composites from.
+// The presented framebuffer must contain the whole frame, not just the damaged regions.
+// Damage rects are in the coordinate space of the window's content view.
+// A message without any damage rects (including a bare event word) redraws the whole window.
 #define AWM_WINDOW_REDRAW_READY 801
+#define AWM_WINDOW_REDRAW_MAX_DAMAGE_RECTS 64
+typedef struct awm_window_redraw_ready_msg {
+    uint32_t event; // AWM_WINDOW_REDRAW_READY
+    uint32_t presented_framebuffer;
+    uint32_t damage_rect_count;
+    Rect damage_rects[AWM_WINDOW_REDRAW_MAX_DAMAGE_RECTS];
+} awm_window_redraw_ready_msg_t;
 
 #define AWM_MOUSE_ENTERED 802
 #define AWM_MOUSE_EXITED 803
@@ -103,4 +121,70 @@ typedef struct awm_desktop_traits_response {
 
 #define AWM_WINDOW_RESIZE_ENDED 816
 
+// Sent to a client once awm has stopped compositing from a framebuffer that was replaced by a newer frame
+// The client must not draw to a framebuffer it has presented until it's been released.
+#define AWM_WINDOW_FRAMEBUFFER_RELEASED 817
+typedef struct awm_window_framebuffer_released_msg {
+    uint32_t event; // AWM_WINDOW_FRAMEBUFFER_RELEASED
+    uint32_t framebuffer;
+} awm_window_framebuffer_released_msg_t;
+
+// Sent from anyone to awm to show or hide the frame-time HUD
+#define AWM_FRAME_STATS_HUD_TOGGLE 818
+
+// Sent from a profiling tool to awm to fetch timings for the most recent frames
+// The response only contains record_count records, which are ordered from oldest to newest
+#define AWM_FRAME_STATS_REQUEST 819
+#define AWM_FRAME_STATS_RESPONSE 819
+#define AWM_FRAME_STATS_RECORD_COUNT 256
+
+// The stages of awm's work that each frame's time is split between
+#define AWM_FRAME_PHASE_AMC 0
+#define AWM_FRAME_PHASE_FETCH 1
+#define AWM_FRAME_PHASE_OCCLUSION 2
+#define AWM_FRAME_PHASE_BLIT 3
+#define AWM_FRAME_PHASE_SCANOUT 4
+#define AWM_FRAME_PHASE_COUNT 5
+
+typedef struct awm_frame_record {
+    uint32_t frame_number;
+    // When the frame was presented, in ms since boot
+    uint32_t presented_at;
+    // Set if only the cursor was redrawn
+    uint32_t is_cursor_only;
+    // Time spent in each phase since the previous frame was presented, in microseconds
+    uint32_t phase_us[AWM_FRAME_PHASE_COUNT];
+    // Rects copied to the framebuffer, and the number of pixels they covered
+    uint32_t dirty_rect_count;
+    uint32_t pixels_touched;
+} awm_frame_record_t;
+
+typedef struct awm_frame_stats_response {
+    uint32_t event; // AWM_FRAME_STATS_RESPONSE
+    uint32_t record_count;
+    awm_frame_record_t records[AWM_FRAME_STATS_RECORD_COUNT];
+} awm_frame_stats_response_t;
+
+// Sent from a profiling tool to awm to fetch how long input and window redraws took to reach the screen
+// The histograms cover every frame since awm started
+#define AWM_FRAME_LATENCY_REQUEST 820
+#define AWM_FRAME_LATENCY_RESPONSE 820
+// Latencies are bucketed by powers of two: bucket 0 counts latencies under 1ms,
+// bucket i counts latencies in [2^(i-1), 2^i) ms, and the last bucket counts everything slower
+#define AWM_LATENCY_HISTOGRAM_BUCKET_COUNT 10
+
+typedef struct awm_latency_histogram {
+    uint32_t buckets[AWM_LATENCY_HISTOGRAM_BUCKET_COUNT];
+    uint32_t sample_count;
+    uint32_t max_ms;
+} awm_latency_histogram_t;
+
+typedef struct awm_frame_latency_response {
+    uint32_t event; // AWM_FRAME_LATENCY_RESPONSE
+    // From the oldest input event awaiting a frame, to that frame being presented
+    awm_latency_histogram_t input_to_present;
+    // From a window committing a redraw, to the frame containing it being presented
+    awm_latency_histogram_t commit_to_present;
+} awm_frame_latency_response_t;
+
 #endif
\ No newline at end of file
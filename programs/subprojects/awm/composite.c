@@ -1,16 +1,55 @@
+#include <stdio.h>
 #include <unistd.h>
 #include <stdint.h>
 
 #include <libutils/assert.h>
 #include <libutils/array.h>
+#include <libamc/libamc.h>
 
 #include <libagx/lib/shapes.h>
+#include <libagx/lib/region.h>
 
 #include "window.h"
 #include "awm_internal.h"
+#include "awm_messages.h"
 #include "composite.h"
+#include "frame_stats.h"
+#include "utils.h"
+#include "math.h"
 
-array_t* _g_screen_rects_to_update_this_cycle = NULL;
+// Printed periodically so the latency distribution can be tracked over a session
+// The histograms can also be fetched at any time with AWM_FRAME_LATENCY_REQUEST
+#define LATENCY_REPORT_INTERVAL_FRAMES 1024
+
+typedef struct latency_histogram {
+	const char* name;
+	awm_latency_histogram_t counts;
+} latency_histogram_t;
+
+static region_t _g_screen_region_to_update_this_cycle = {0};
+
+static uint32_t _g_frame_interval_ms = 1000 / AWM_DEFAULT_TARGET_FRAME_RATE;
+// Only frames that draw more than the cursor advance the frame deadline
+static uint32_t _g_last_frame_presented_at = 0;
+// Set when something other than the cursor has queued a redraw this frame
+static bool _g_frame_has_non_cursor_damage = false;
+static uint32_t _g_oldest_unpresented_input_at = 0;
+static uint32_t _g_frames_since_latency_report = 0;
+
+// The cursor is drawn straight into scanout on top of the composited frame, rather than into the frame itself
+static ca_layer* _g_cursor_overlay = NULL;
+// Where the cursor was last drawn in scanout, or an empty rect if it hasn't been drawn yet
+static Rect _g_cursor_frame_in_scanout = {0};
+static bool _g_cursor_needs_update = true;
+
+static latency_histogram_t _g_input_to_present_latencies = {.name = "input-to-present"};
+static latency_histogram_t _g_commit_to_present_latencies = {.name = "commit-to-present"};
+
+typedef enum frame_state {
+	FRAME_IDLE = 0,
+	FRAME_CURSOR_ONLY = 1,
+	FRAME_PENDING = 2
+} frame_state_t;
 
 /* Queue a composite for the provided rect over the entire desktop
     While compositing the frame, awm will determine what individual elements
@@ -18,37 +57,191 @@ array_t* _g_screen_rects_to_update_this_cycle = NULL;
 	These may include portions of windows, the desktop background, etc.
  */
 void compositor_queue_rect_to_redraw(Rect update_rect) {
-	if (update_rect.size.width == 0 || update_rect.size.height == 0) {
-		// TODO(PT): Investigate how this happens? Trigger by quickly resizing a window to flood events
-		//printf("Dropping update rect of zero height or width\n");
-		return;
-	}
-	if (_g_screen_rects_to_update_this_cycle->size + 1 >= _g_screen_rects_to_update_this_cycle->max_size) {
-		//printf("Dropping update rect because we've hit our max updates this cycle: (%d, %d), (%d, %d)\n", rect_min_x(update_rect), rect_min_y(update_rect), update_rect.size.width, update_rect.size.height);
-		return;
-	}
-	Rect* r = calloc(1, sizeof(Rect));
-	r->origin.x = update_rect.origin.x;
-	r->origin.y = update_rect.origin.y;
-	r->size.width = update_rect.size.width;
-	r->size.height = update_rect.size.height;
-	array_insert(_g_screen_rects_to_update_this_cycle, r);
+	// Overlapping updates are merged, so each pixel is only composited once per frame
+	region_union_rect(&_g_screen_region_to_update_this_cycle, update_rect);
+	_g_frame_has_non_cursor_damage = true;
+}
+
+void compositor_queue_cursor_update(void) {
+	_g_cursor_needs_update = true;
 }
 
 /* Queue composites for the area of the bg rectangle that's not obscured by the fg rectangle
  */
 void compositor_queue_rect_difference_to_redraw(Rect bg, Rect fg) {
-	array_t* delta = rect_diff(bg, fg);
-	for (int32_t i = delta->size - 1; i >= 0; i--) {
-		Rect* r = array_lookup(delta, i);
-		compositor_queue_rect_to_redraw(*r);
-		free(r);
+	Rect delta[4];
+	uint32_t delta_count = rect_subtract(bg, fg, delta);
+	for (uint32_t i = 0; i < delta_count; i++) {
+		compositor_queue_rect_to_redraw(delta[i]);
 	}
-	array_destroy(delta);
 }
 
 void compositor_init(void) {
-	_g_screen_rects_to_update_this_cycle = array_create(256);
+	frame_stats_init();
+	region_init(&_g_screen_region_to_update_this_cycle);
+	_g_cursor_overlay = create_layer(size_make(AWM_CURSOR_SIZE, AWM_CURSOR_SIZE));
+}
+
+void compositor_set_target_frame_rate(uint32_t frames_per_second) {
+	frames_per_second = max(frames_per_second, 1);
+	_g_frame_interval_ms = max(1000 / frames_per_second, 1);
+	printf("[awm] Compositing at up to %dHz (%dms per frame)\n", frames_per_second, _g_frame_interval_ms);
+}
+
+void compositor_note_input_event(void) {
+	if (!_g_oldest_unpresented_input_at) {
+		_g_oldest_unpresented_input_at = ms_since_boot();
+	}
+}
+
+static bool _views_have_queued_draws(void) {
+	if (windows_queued()->size > 0 || desktop_views_ready_to_composite_array()->size > 0) {
+		return true;
+	}
+
+	array_t* all_views = all_desktop_views();
+	bool has_extra_draws = false;
+	for (int32_t i = 0; i < all_views->size; i++) {
+		view_t* view = array_lookup(all_views, i);
+		if (!region_is_empty(&view->extra_draw_region)) {
+			has_extra_draws = true;
+			break;
+		}
+	}
+	array_destroy(all_views);
+	return has_extra_draws;
+}
+
+static frame_state_t _frame_state(void) {
+	if (_g_frame_has_non_cursor_damage || _views_have_queued_draws()) {
+		return FRAME_PENDING;
+	}
+	if (_g_cursor_needs_update) {
+		return FRAME_CURSOR_ONLY;
+	}
+	return FRAME_IDLE;
+}
+
+int32_t compositor_ms_until_next_frame(void) {
+	frame_state_t state = _frame_state();
+	if (state == FRAME_IDLE) {
+		return -1;
+	}
+	// Moving the cursor shouldn't wait for the next frame deadline
+	if (state == FRAME_CURSOR_ONLY) {
+		return 0;
+	}
+	int32_t ms_since_last_frame = ms_since_boot() - _g_last_frame_presented_at;
+	return max((int32_t)_g_frame_interval_ms - ms_since_last_frame, 0);
+}
+
+void compositor_render_frame_if_due(void) {
+	if (compositor_ms_until_next_frame() != 0) {
+		return;
+	}
+	compositor_render_frame();
+}
+
+static void _latency_histogram_record(latency_histogram_t* histogram, uint32_t latency_ms) {
+	awm_latency_histogram_t* counts = &histogram->counts;
+	uint32_t bucket = 0;
+	while (bucket < AWM_LATENCY_HISTOGRAM_BUCKET_COUNT - 1 && latency_ms >= (1 << bucket)) {
+		bucket += 1;
+	}
+	counts->buckets[bucket] += 1;
+	counts->sample_count += 1;
+	counts->max_ms = max(counts->max_ms, latency_ms);
+}
+
+static void _latency_histogram_print(const latency_histogram_t* histogram) {
+	const awm_latency_histogram_t* counts = &histogram->counts;
+	printf("[awm] %s latency over %d samples (max %dms):\n", histogram->name, counts->sample_count, counts->max_ms);
+	for (uint32_t i = 0; i < AWM_LATENCY_HISTOGRAM_BUCKET_COUNT; i++) {
+		if (i == 0) {
+			printf("\t<1ms: %d\n", counts->buckets[i]);
+		}
+		else if (i == AWM_LATENCY_HISTOGRAM_BUCKET_COUNT - 1) {
+			printf("\t>=%dms: %d\n", 1 << (i - 1), counts->buckets[i]);
+		}
+		else {
+			printf("\t%d-%dms: %d\n", 1 << (i - 1), (1 << i) - 1, counts->buckets[i]);
+		}
+	}
+}
+
+void compositor_send_latency_histograms(const char* service) {
+	awm_frame_latency_response_t response = {
+		.event = AWM_FRAME_LATENCY_RESPONSE,
+		.input_to_present = _g_input_to_present_latencies.counts,
+		.commit_to_present = _g_commit_to_present_latencies.counts,
+	};
+	amc_message_send(service, &response, sizeof(response));
+}
+
+static void _record_frame_presented(bool is_cursor_only_frame) {
+	uint32_t now = ms_since_boot();
+	if (_g_oldest_unpresented_input_at) {
+		_latency_histogram_record(&_g_input_to_present_latencies, now - _g_oldest_unpresented_input_at);
+		_g_oldest_unpresented_input_at = 0;
+	}
+	array_t* fetched_windows = windows_queued();
+	for (int32_t i = 0; i < fetched_windows->size; i++) {
+		user_window_t* window = array_lookup(fetched_windows, i);
+		if (window->redraw_committed_at) {
+			_latency_histogram_record(&_g_commit_to_present_latencies, now - window->redraw_committed_at);
+			window->redraw_committed_at = 0;
+		}
+	}
+
+	frame_stats_frame_presented(is_cursor_only_frame);
+
+	if (is_cursor_only_frame) {
+		return;
+	}
+	_g_last_frame_presented_at = now;
+	_g_frame_has_non_cursor_damage = false;
+
+	_g_frames_since_latency_report += 1;
+	if (_g_frames_since_latency_report >= LATENCY_REPORT_INTERVAL_FRAMES) {
+		_g_frames_since_latency_report = 0;
+		_latency_histogram_print(&_g_input_to_present_latencies);
+		_latency_histogram_print(&_g_commit_to_present_latencies);
+	}
+}
+
+// The composited frame never contains the cursor, so it doubles as the cursor's save-under.
+// The pixels beneath the cursor's old position are restored from it, and the overlay is rebuilt from it
+// whenever the windows beneath the cursor change.
+static void _cursor_overlay_present(void) {
+	ca_layer* video_memory = video_memory_layer();
+	ca_layer* physical_video_memory = physical_video_memory_layer();
+
+	// The cursor may hang off the bottom-right edges of the screen
+	Rect new_frame = cursor_frame();
+	Size screen_size = screen_resolution();
+	new_frame.size.width = min(new_frame.size.width, screen_size.width - rect_min_x(new_frame));
+	new_frame.size.height = min(new_frame.size.height, screen_size.height - rect_min_y(new_frame));
+
+	// Restore the pixels that the cursor has moved away from
+	Rect uncovered_rects[4];
+	uint32_t uncovered_rect_count = rect_subtract(_g_cursor_frame_in_scanout, new_frame, uncovered_rects);
+	for (uint32_t i = 0; i < uncovered_rect_count; i++) {
+		blit_layer__scanline(physical_video_memory, video_memory, uncovered_rects[i], uncovered_rects[i], screen_pixels_per_scanline());
+		frame_stats_note_scanout_rect(uncovered_rects[i]);
+	}
+
+	// Draw the cursor over a copy of the pixels beneath it, then stream the result out in one go
+	Rect overlay_frame = rect_make(point_zero(), new_frame.size);
+	blit_layer(_g_cursor_overlay, video_memory, overlay_frame, new_frame);
+	_draw_cursor(_g_cursor_overlay, point_zero());
+	blit_layer__scanline(physical_video_memory, _g_cursor_overlay, new_frame, overlay_frame, screen_pixels_per_scanline());
+	frame_stats_note_scanout_rect(new_frame);
+
+	_g_cursor_frame_in_scanout = new_frame;
+	_g_cursor_needs_update = false;
+
+	// The HUD sits on top of everything, including the cursor
+	frame_stats_present_hud();
 }
 
 void compositor_render_frame_simple(void) {
@@ -69,140 +262,125 @@ void compositor_render_frame_simple(void) {
 
 	for (int i = 0; i < all_views->size; i++) {
 		view_t* view = array_lookup(all_views, i);
-		blit_layer(
-			video_memory,
-			view->layer,
-			view->frame,
-			rect_make(point_zero(), view->frame.size)
-		);
+		view_draw_rect(video_memory, view, view->frame);
 	}
 
-	Rect mouse_rect = _draw_cursor(video_memory);
-
-	blit_layer(
+	blit_layer__scanline(
 		physical_video_memory,
 		video_memory,
 		rect_make(point_zero(), screen_resolution()),
-		rect_make(point_zero(), screen_resolution())
+		rect_make(point_zero(), screen_resolution()),
+		screen_pixels_per_scanline()
 	);
 
 	complete_queued_extra_draws(all_views, video_memory, physical_video_memory);
+	_cursor_overlay_present();
 	desktop_views_flush_queues();
 	array_destroy(all_views);
-	for (int32_t i = _g_screen_rects_to_update_this_cycle->size - 1; i >= 0; i--) {
-		Rect* r = array_lookup(_g_screen_rects_to_update_this_cycle, i);
-		array_remove(_g_screen_rects_to_update_this_cycle, i);
-		free(r);
-	}
+	region_clear(&_g_screen_region_to_update_this_cycle);
 }
 
 void compositor_render_frame(void) {
+	if (_frame_state() == FRAME_CURSOR_ONLY) {
+		// Nothing beneath the cursor has changed, so there's no need to composite anything
+		frame_stats_phase_begin(AWM_FRAME_PHASE_SCANOUT);
+		_cursor_overlay_present();
+		frame_stats_phase_end(AWM_FRAME_PHASE_SCANOUT);
+		_record_frame_presented(true);
+		return;
+	}
+
 	ca_layer* desktop_background = desktop_background_layer();
 	array_t* all_views = all_desktop_views();
 	ca_layer* video_memory = video_memory_layer();
 	ca_layer* physical_video_memory = physical_video_memory_layer();
 
 	// Fetch remote layers for windows that have asked for a redraw
+	frame_stats_phase_begin(AWM_FRAME_PHASE_FETCH);
 	windows_fetch_queued_windows();
+	frame_stats_phase_end(AWM_FRAME_PHASE_FETCH);
 
-	// Process rects that have been dirtied while processing other events
-	for (int32_t i = 0; i < _g_screen_rects_to_update_this_cycle->size; i++) {
-		Rect* rp = array_lookup(_g_screen_rects_to_update_this_cycle, i);
-		Rect r = *rp;
-
-		array_t* unobscured_region = array_create(256);
-		rect_add(unobscured_region, r);
-
-		// Handle the parts of the dirty region that are obscured by desktop views
-		for (int32_t j = 0; j < all_views->size; j++) {
-			view_t* view = array_lookup(all_views, j);
-			// We can't occlude using a view if the view uses transparency 
-			if (view->layer->alpha < 1.0) {
-				continue;
-			}
-			if (!rect_intersects(view->frame, r)) {
-				continue;
-			}
-
-			for (int32_t k = 0; k < view->drawable_rects->size; k++) {
-				Rect* visible_region_ptr = array_lookup(view->drawable_rects, k);
-				Rect visible_region = *visible_region_ptr;
-				if (rect_intersects(visible_region, r)) {
-
-					if (view->extra_draws_this_cycle->size >= view->extra_draws_this_cycle->max_size - 1) {
-						printf("*** Caught compositor exceeded size of extra_views_to_draw_this_cycle\n");
-						break;
-					}
-
-					if (rect_contains_rect(visible_region, r)) {
-						// The entire rect should be redrawn from this window
-						rect_add(view->extra_draws_this_cycle, r);
-						// And subtract the area of the rect from the region to update
-						unobscured_region = update_occlusions(unobscured_region, r);
-						break;
-					}
-					else {
-						// This view needs to redraw the intersection of its visible rect and the update rect
-						Rect intersection = rect_intersect(visible_region, r);
-						rect_add(view->extra_draws_this_cycle, intersection);
-						unobscured_region = update_occlusions(unobscured_region, intersection);
-					}
-
-					// If all the area of the region to update has been handled, 
-					// stop iterating windows early
-					if (!unobscured_region->size) {
-						break;
-					}
-				}
-			}
+	frame_stats_phase_begin(AWM_FRAME_PHASE_OCCLUSION);
+	// Process the region that has been dirtied while processing other events
+	// Each view redraws the part of the dirty region that it's visible in
+	region_t unobscured_region;
+	region_init(&unobscured_region);
+	region_copy(&unobscured_region, &_g_screen_region_to_update_this_cycle);
+	region_t view_dirty_region;
+	region_init(&view_dirty_region);
+	for (int32_t i = 0; i < all_views->size && !region_is_empty(&unobscured_region); i++) {
+		view_t* view = array_lookup(all_views, i);
+		// We can't occlude using a view if the view uses transparency 
+		if (view->layer->alpha < 1.0) {
+			continue;
+		}
+		// Fully occluded views can't contribute anything to the frame
+		if (region_is_empty(&view->drawable_region)) {
+			continue;
+		}
+		if (!region_intersects_rect(&unobscured_region, view->frame)) {
+			continue;
 		}
 
-		// Blit the regions that are not covered by windows with the desktop background layer
-		for (int32_t j = unobscured_region->size - 1; j >= 0; j--) {
-			Rect* bg_rect = array_lookup(unobscured_region, j);
-			blit_layer(
-				video_memory,
-				desktop_background,
-				*bg_rect,
-				*bg_rect
-			);
-			array_remove(unobscured_region, j);
-			free(bg_rect);
+		region_intersect(&view_dirty_region, &unobscured_region, &view->drawable_region);
+		if (region_is_empty(&view_dirty_region)) {
+			continue;
 		}
-		array_destroy(unobscured_region);
+		region_union(&view->extra_draw_region, &view->extra_draw_region, &view_dirty_region);
+		region_subtract(&unobscured_region, &unobscured_region, &view_dirty_region);
 	}
+	region_teardown(&view_dirty_region);
+	frame_stats_phase_end(AWM_FRAME_PHASE_OCCLUSION);
+
+	frame_stats_phase_begin(AWM_FRAME_PHASE_BLIT);
+	// Blit the regions that are not covered by windows with the desktop background layer
+	for (uint32_t i = 0; i < region_rect_count(&unobscured_region); i++) {
+		Rect bg_rect = region_rect_at(&unobscured_region, i);
+		blit_layer(
+			video_memory,
+			desktop_background,
+			bg_rect,
+			bg_rect
+		);
+	}
+	region_teardown(&unobscured_region);
 
 	array_t* desktop_views_to_composite = desktop_views_ready_to_composite_array();
 	draw_views_to_layer(desktop_views_to_composite, video_memory);
 	draw_queued_extra_draws(all_views, video_memory);
+	frame_stats_phase_end(AWM_FRAME_PHASE_BLIT);
 
-	Rect mouse_rect = _draw_cursor(video_memory);
-
+	frame_stats_phase_begin(AWM_FRAME_PHASE_SCANOUT);
 	// Blit everything we drew above to the memory-mapped framebuffer
-	for (int32_t i = _g_screen_rects_to_update_this_cycle->size - 1; i >= 0; i--) {
-		Rect* r = array_lookup(_g_screen_rects_to_update_this_cycle, i);
-		blit_layer(
+	// The framebuffer is write-combining, so each row is streamed out in whole cache lines
+	for (uint32_t i = 0; i < region_rect_count(&_g_screen_region_to_update_this_cycle); i++) {
+		Rect r = region_rect_at(&_g_screen_region_to_update_this_cycle, i);
+		blit_layer__scanline(
 			physical_video_memory,
 			video_memory,
-			*r,
-			*r
+			r,
+			r,
+			screen_pixels_per_scanline()
 		);
-		array_remove(_g_screen_rects_to_update_this_cycle, i);
-		free(r);
+		frame_stats_note_scanout_rect(r);
 	}
+	region_clear(&_g_screen_region_to_update_this_cycle);
 
 	complete_queued_extra_draws(all_views, video_memory, physical_video_memory);
 	
 	for (int32_t i = 0; i < desktop_views_to_composite->size; i++) {
 		view_t* view = array_lookup(desktop_views_to_composite, i);
-		for (int32_t j = 0; j < view->drawable_rects->size; j++) {
-			Rect* r_ptr = array_lookup(view->drawable_rects, j);
-			Rect r = *r_ptr;
-			blit_layer(physical_video_memory, video_memory, r, r);
+		for (uint32_t j = 0; j < region_rect_count(&view->drawable_region); j++) {
+			Rect r = region_rect_at(&view->drawable_region, j);
+			blit_layer__scanline(physical_video_memory, video_memory, r, r, screen_pixels_per_scanline());
+			frame_stats_note_scanout_rect(r);
 		}
 	}
-	blit_layer(physical_video_memory, video_memory, mouse_rect, mouse_rect);
 
+	// Scanout may have been overwritten beneath the cursor, and the pixels beneath it may have changed
+	_cursor_overlay_present();
+	frame_stats_phase_end(AWM_FRAME_PHASE_SCANOUT);
+	_record_frame_presented(false);
 	desktop_views_flush_queues();
 	array_destroy(all_views);
 }
@@ -1,11 +1,30 @@
 #ifndef COMPOSITE_H
 #define COMPOSITE_H
 
+#include <stdint.h>
 #include <libagx/lib/shapes.h>
 
+#define AWM_DEFAULT_TARGET_FRAME_RATE 60
+
 void compositor_init(void);
 void compositor_queue_rect_to_redraw(Rect update_rect);
 void compositor_queue_rect_difference_to_redraw(Rect bg, Rect fg);
 void compositor_render_frame(void);
 
-#endif
\ No newline at end of file
+// Frame pacing
+// Damage queued between frame deadlines is coalesced into a single composite.
+// Frames that only need to move the cursor bypass the deadline and are drawn immediately.
+void compositor_set_target_frame_rate(uint32_t frames_per_second);
+// The cursor is an overlay on top of the composited frame, so updating it doesn't need anything to be composited
+void compositor_queue_cursor_update(void);
+// Timestamp an input event, so the latency until it's visible on-screen can be recorded
+void compositor_note_input_event(void);
+// The number of ms until the next frame should be composited, or -1 if there's nothing to draw
+int32_t compositor_ms_until_next_frame(void);
+// Composites a frame if one is pending and its deadline has passed
+void compositor_render_frame_if_due(void);
+
+// Replies to an AWM_FRAME_LATENCY_REQUEST with the input-to-present and commit-to-present histograms
+void compositor_send_latency_histograms(const char* service);
+
+#endif
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <libutils/assert.h>
+#include <libamc/libamc.h>
+#include <libagx/lib/shapes.h>
+#include <libagx/font/font.h>
+
+#include "frame_stats.h"
+#include "composite.h"
+#include "awm_internal.h"
+#include "utils.h"
+#include "math.h"
+
+// Phases are short enough that nesting is never deeper than a few levels
+#define FRAME_STATS_MAX_PHASE_DEPTH 4
+// The TSC's rate isn't known up-front, so it's measured against the ms clock over this long
+#define FRAME_STATS_CALIBRATION_WINDOW_MS 1000
+
+#define HUD_FONT_WIDTH 8
+#define HUD_FONT_HEIGHT 12
+#define HUD_LINE_HEIGHT 14
+#define HUD_MARGIN 8
+#define HUD_COLUMN_COUNT 30
+#define HUD_LINE_COUNT 9
+
+typedef struct frame_stats_phase_frame {
+	uint32_t phase;
+	uint64_t started_at;
+} frame_stats_phase_frame_t;
+
+static awm_frame_record_t _g_records[AWM_FRAME_STATS_RECORD_COUNT] = {0};
+static uint32_t _g_record_count = 0;
+static uint32_t _g_next_record_idx = 0;
+static uint32_t _g_next_frame_number = 0;
+
+// The frame that's currently being built
+static uint64_t _g_phase_ticks[AWM_FRAME_PHASE_COUNT] = {0};
+static uint32_t _g_dirty_rect_count = 0;
+static uint32_t _g_pixels_touched = 0;
+
+static frame_stats_phase_frame_t _g_phase_stack[FRAME_STATS_MAX_PHASE_DEPTH] = {0};
+static uint32_t _g_phase_depth = 0;
+
+static uint32_t _g_calibration_started_at_ms = 0;
+static uint64_t _g_calibration_started_at_ticks = 0;
+static uint64_t _g_ticks_per_ms = 0;
+
+static bool _g_hud_is_visible = false;
+static ca_layer* _g_hud_layer = NULL;
+
+static const char* _g_phase_names[AWM_FRAME_PHASE_COUNT] = {
+	"amc",
+	"fetch",
+	"occlude",
+	"blit",
+	"scanout",
+};
+
+static uint64_t _ticks_now(void) {
+#if defined(__x86_64__)
+	// The ms clock is far too coarse to time individual phases
+	return __builtin_ia32_rdtsc();
+#else
+	return (uint64_t)ms_since_boot() * 1000;
+#endif
+}
+
+static uint32_t _ticks_to_us(uint64_t ticks) {
+	uint32_t elapsed_ms = ms_since_boot() - _g_calibration_started_at_ms;
+	if (elapsed_ms > 0 && (!_g_ticks_per_ms || elapsed_ms <= FRAME_STATS_CALIBRATION_WINDOW_MS)) {
+		_g_ticks_per_ms = (_ticks_now() - _g_calibration_started_at_ticks) / elapsed_ms;
+	}
+	if (!_g_ticks_per_ms) {
+		return 0;
+	}
+	return (ticks * 1000) / _g_ticks_per_ms;
+}
+
+static Rect _hud_frame(void) {
+	Size hud_size = size_make(
+		(HUD_COLUMN_COUNT * HUD_FONT_WIDTH) + (HUD_MARGIN * 2),
+		(HUD_LINE_COUNT * HUD_LINE_HEIGHT) + (HUD_MARGIN * 2)
+	);
+	Size screen_size = screen_resolution();
+	return rect_make(
+		point_make(screen_size.width - hud_size.width - HUD_MARGIN, HUD_MARGIN),
+		hud_size
+	);
+}
+
+void frame_stats_init(void) {
+	_g_calibration_started_at_ms = ms_since_boot();
+	_g_calibration_started_at_ticks = _ticks_now();
+	_g_hud_layer = create_layer(_hud_frame().size);
+}
+
+// Attributes the time since the innermost phase last resumed to that phase
+static void _phase_stack_accumulate(uint64_t now) {
+	if (!_g_phase_depth) {
+		return;
+	}
+	frame_stats_phase_frame_t* top = &_g_phase_stack[_g_phase_depth - 1];
+	_g_phase_ticks[top->phase] += now - top->started_at;
+	top->started_at = now;
+}
+
+void frame_stats_phase_begin(uint32_t phase) {
+	assert(phase < AWM_FRAME_PHASE_COUNT, "Invalid frame phase");
+	assert(_g_phase_depth < FRAME_STATS_MAX_PHASE_DEPTH, "Frame phases nested too deeply");
+	uint64_t now = _ticks_now();
+	// Pause the enclosing phase
+	_phase_stack_accumulate(now);
+	_g_phase_stack[_g_phase_depth].phase = phase;
+	_g_phase_stack[_g_phase_depth].started_at = now;
+	_g_phase_depth += 1;
+}
+
+void frame_stats_phase_end(uint32_t phase) {
+	assert(_g_phase_depth > 0 && _g_phase_stack[_g_phase_depth - 1].phase == phase, "Unbalanced frame phase");
+	uint64_t now = _ticks_now();
+	_phase_stack_accumulate(now);
+	_g_phase_depth -= 1;
+	// Resume the enclosing phase
+	if (_g_phase_depth) {
+		_g_phase_stack[_g_phase_depth - 1].started_at = now;
+	}
+}
+
+void frame_stats_note_scanout_rect(Rect r) {
+	_g_dirty_rect_count += 1;
+	_g_pixels_touched += r.size.width * r.size.height;
+}
+
+void frame_stats_frame_presented(bool is_cursor_only) {
+	// Phases that are still running carry over into the next frame
+	_phase_stack_accumulate(_ticks_now());
+
+	awm_frame_record_t* record = &_g_records[_g_next_record_idx];
+	record->frame_number = _g_next_frame_number++;
+	record->presented_at = ms_since_boot();
+	record->is_cursor_only = is_cursor_only;
+	for (uint32_t i = 0; i < AWM_FRAME_PHASE_COUNT; i++) {
+		record->phase_us[i] = _ticks_to_us(_g_phase_ticks[i]);
+		_g_phase_ticks[i] = 0;
+	}
+	record->dirty_rect_count = _g_dirty_rect_count;
+	record->pixels_touched = _g_pixels_touched;
+	_g_dirty_rect_count = 0;
+	_g_pixels_touched = 0;
+
+	_g_next_record_idx = (_g_next_record_idx + 1) % AWM_FRAME_STATS_RECORD_COUNT;
+	_g_record_count = min(_g_record_count + 1, AWM_FRAME_STATS_RECORD_COUNT);
+}
+
+static const awm_frame_record_t* _record_at(uint32_t idx_from_oldest) {
+	uint32_t oldest = (_g_next_record_idx + AWM_FRAME_STATS_RECORD_COUNT - _g_record_count) % AWM_FRAME_STATS_RECORD_COUNT;
+	return &_g_records[(oldest + idx_from_oldest) % AWM_FRAME_STATS_RECORD_COUNT];
+}
+
+void frame_stats_toggle_hud(void) {
+	_g_hud_is_visible = !_g_hud_is_visible;
+	// Either way, the HUD's area needs to be presented again
+	// If it's been hidden, this restores what's beneath it from the composited frame
+	compositor_queue_rect_to_redraw(_hud_frame());
+}
+
+static void _hud_draw_line(uint32_t line, const char* text) {
+	Point origin = point_make(HUD_MARGIN, HUD_MARGIN + (line * HUD_LINE_HEIGHT));
+	Size font_size = size_make(HUD_FONT_WIDTH, HUD_FONT_HEIGHT);
+	for (uint32_t i = 0; text[i] && i < HUD_COLUMN_COUNT; i++) {
+		draw_char(_g_hud_layer, text[i], origin.x + (i * HUD_FONT_WIDTH), origin.y, color_white(), font_size);
+	}
+}
+
+static void _hud_draw_stat_line(uint32_t line, const char* name, uint32_t last, uint64_t total, uint32_t max_value) {
+	char buf[HUD_COLUMN_COUNT + 1];
+	uint32_t average = _g_record_count ? total / _g_record_count : 0;
+	snprintf(buf, sizeof(buf), "%-8s%7d%7d%7d", name, last, average, max_value);
+	_hud_draw_line(line, buf);
+}
+
+static void _hud_render(void) {
+	draw_rect(_g_hud_layer, rect_make(point_zero(), _g_hud_layer->size), color_make(20, 20, 20), THICKNESS_FILLED);
+	if (!_g_record_count) {
+		_hud_draw_line(0, "awm: no frames yet");
+		return;
+	}
+
+	// Summarise the whole ring, alongside the newest frame
+	uint64_t phase_totals[AWM_FRAME_PHASE_COUNT] = {0};
+	uint32_t phase_maxes[AWM_FRAME_PHASE_COUNT] = {0};
+	uint64_t rect_total = 0;
+	uint32_t rect_max = 0;
+	uint64_t pixel_total = 0;
+	uint32_t pixel_max = 0;
+	for (uint32_t i = 0; i < _g_record_count; i++) {
+		const awm_frame_record_t* record = _record_at(i);
+		for (uint32_t j = 0; j < AWM_FRAME_PHASE_COUNT; j++) {
+			phase_totals[j] += record->phase_us[j];
+			phase_maxes[j] = max(phase_maxes[j], record->phase_us[j]);
+		}
+		rect_total += record->dirty_rect_count;
+		rect_max = max(rect_max, record->dirty_rect_count);
+		pixel_total += record->pixels_touched;
+		pixel_max = max(pixel_max, record->pixels_touched);
+	}
+
+	const awm_frame_record_t* newest = _record_at(_g_record_count - 1);
+	char buf[HUD_COLUMN_COUNT + 1];
+	snprintf(buf, sizeof(buf), "awm frame %d", newest->frame_number);
+	_hud_draw_line(0, buf);
+	snprintf(buf, sizeof(buf), "%-8s%7s%7s%7s", "us", "last", "avg", "max");
+	_hud_draw_line(1, buf);
+	for (uint32_t i = 0; i < AWM_FRAME_PHASE_COUNT; i++) {
+		_hud_draw_stat_line(2 + i, _g_phase_names[i], newest->phase_us[i], phase_totals[i], phase_maxes[i]);
+	}
+	_hud_draw_stat_line(2 + AWM_FRAME_PHASE_COUNT, "rects", newest->dirty_rect_count, rect_total, rect_max);
+	_hud_draw_stat_line(3 + AWM_FRAME_PHASE_COUNT, "pixels", newest->pixels_touched, pixel_total, pixel_max);
+}
+
+void frame_stats_present_hud(void) {
+	if (!_g_hud_is_visible) {
+		return;
+	}
+	// Drawing the HUD doesn't dirty anything, so it never causes another frame by itself
+	_hud_render();
+	Rect hud_frame = _hud_frame();
+	blit_layer__scanline(
+		physical_video_memory_layer(),
+		_g_hud_layer,
+		hud_frame,
+		rect_make(point_zero(), hud_frame.size),
+		screen_pixels_per_scanline()
+	);
+}
+
+void frame_stats_send_records(const char* service) {
+	awm_frame_stats_response_t* response = calloc(1, sizeof(awm_frame_stats_response_t));
+	response->event = AWM_FRAME_STATS_RESPONSE;
+	response->record_count = _g_record_count;
+	for (uint32_t i = 0; i < _g_record_count; i++) {
+		response->records[i] = *_record_at(i);
+	}
+	// Only send the records that have been filled in
+	uint32_t len = offsetof(awm_frame_stats_response_t, records) + (_g_record_count * sizeof(awm_frame_record_t));
+	amc_message_send(service, response, len);
+	free(response);
+}
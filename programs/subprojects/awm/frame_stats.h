@@ -0,0 +1,28 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <libagx/lib/shapes.h>
+
+#include "awm_messages.h"
+
+// Splits the time awm spends between frames into the phases in awm_messages.h,
+// and keeps a ring of records for the most recent frames.
+// Phases may nest, in which case time spent in the inner phase isn't counted towards the outer one.
+void frame_stats_init(void);
+void frame_stats_phase_begin(uint32_t phase);
+void frame_stats_phase_end(uint32_t phase);
+// Counts a rect that was copied to the framebuffer this frame
+void frame_stats_note_scanout_rect(Rect r);
+// Closes the current frame's record, and starts accumulating the next one
+void frame_stats_frame_presented(bool is_cursor_only);
+
+// The HUD is drawn straight to the framebuffer on top of everything else, including the cursor
+void frame_stats_toggle_hud(void);
+void frame_stats_present_hud(void);
+
+// Sends the recorded frames to the provided service, oldest first
+void frame_stats_send_records(const char* service);
+
+#endif
@@ -17,10 +17,6 @@ uint8_t screen_bytes_per_pixel(void);
 uint32_t screen_pixels_per_scanline(void);
 
 bool rect_contains_rect(Rect a, Rect b);
-array_t* rect_diff(Rect bg, Rect fg);
-
-void rect_add(array_t* arr, Rect r);
-array_t* update_occlusions(array_t* free_areas, Rect exclude_rect);
 
 image_t* load_image(const char* image_name);
 
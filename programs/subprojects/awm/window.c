@@ -14,6 +14,7 @@
 #include "utils.h"
 #include "math.h"
 #include "animations.h"
+#include "frame_stats.h"
 
 typedef struct desktop_shortcuts_state {
     array_t* shortcuts;
@@ -46,6 +47,16 @@ static desktop_shortcuts_state_t _g_desktop_shortcuts_state = {0};
 
 static view_t* _g_minimized_window_preview = NULL;
 
+// Decoration images are decoded into layers once, and title bars of any width are composed from them
+// The title bar is a 3-slice source stretched horizontally: the caps at either end are copied as-is,
+// and only the middle is stretched. Its height always matches the title bar, so rows are never scaled.
+#define TITLE_BAR_SLICE_CAP_WIDTH 8
+static ca_layer* _g_title_bar_slices = NULL;
+static ca_layer* _g_title_bar_x_filled_layer = NULL;
+static ca_layer* _g_title_bar_x_unfilled_layer = NULL;
+static ca_layer* _g_title_bar_minimize_filled_layer = NULL;
+static ca_layer* _g_title_bar_minimize_unfilled_layer = NULL;
+
 bool window_is_in_z_order(user_window_t* window) {
 	int32_t idx = array_index(windows_with_z_order, window);
     return idx >= 0;
@@ -171,13 +182,7 @@ void window_minimize_from_message(awm_dock_window_minimize_with_info_event_t* ev
         window->unminimized_snapshot = NULL;
     }
 
-	window->unminimized_snapshot = layer_snapshot(
-		window->layer, 
-		rect_make(
-			point_zero(),
-            window->unminimized_frame.size
-		)
-	);
+	window->unminimized_snapshot = window_snapshot(window);
 
     /*
     // Darken the preview
@@ -348,13 +353,26 @@ static void _window_fetch_framebuf(user_window_t* window) {
         return;
     }
 
-	window->has_done_first_draw = true;
-	blit_layer(
-		window->layer, 
-		window->content_view->layer, 
-		window->content_view->frame, 
-		rect_make(point_zero(), window->content_view->frame.size)
-	);
+	// The content view is composited straight from the owner's front framebuffer, so there's nothing to copy.
+	// A full redraw already queued a composite of the whole window.
+	if (window->pending_damage_is_full || !window->has_done_first_draw) {
+		window->has_done_first_draw = true;
+	}
+	else {
+		// Let the compositor figure out which parts of the damage are visible
+		Rect content_bounds = rect_make(point_zero(), window->content_view->frame.size);
+		for (uint32_t i = 0; i < window->pending_damage_count; i++) {
+			Rect damage = rect_intersect(window->pending_damage[i], content_bounds);
+			if (damage.size.width <= 0 || damage.size.height <= 0) {
+				continue;
+			}
+			damage.origin.x += window->frame.origin.x + window->content_view->frame.origin.x;
+			damage.origin.y += window->frame.origin.y + window->content_view->frame.origin.y;
+			compositor_queue_rect_to_redraw(damage);
+		}
+	}
+	window->pending_damage_count = 0;
+	window->pending_damage_is_full = false;
 }
 
 void window_queue_fetch(user_window_t* window) {
@@ -363,6 +381,7 @@ void window_queue_fetch(user_window_t* window) {
         return;
     }
 
+    window->pending_damage_is_full = true;
     if (array_index(windows_to_fetch_this_cycle, window) == -1) {
         //printf("Ready for redraw: %s\n", window->owner_service);
         array_insert(windows_to_fetch_this_cycle, window);
@@ -370,6 +389,118 @@ void window_queue_fetch(user_window_t* window) {
     desktop_view_queue_composite((view_t*)window);
 }
 
+void window_queue_fetch_damage(user_window_t* window, Rect* damage_rects, uint32_t damage_rect_count) {
+    if (!window) {
+        printf("window_queue_fetch_damage got NULL window, ignoring\n");
+        return;
+    }
+    if (window->pending_damage_is_full) {
+        // Already fetching the whole window this cycle
+        return;
+    }
+
+    for (uint32_t i = 0; i < damage_rect_count; i++) {
+        if (window->pending_damage_count == AWM_WINDOW_REDRAW_MAX_DAMAGE_RECTS) {
+            // Too much damage has piled up this cycle to be worth tracking individually
+            window_queue_fetch(window);
+            return;
+        }
+        window->pending_damage[window->pending_damage_count++] = damage_rects[i];
+    }
+    if (array_index(windows_to_fetch_this_cycle, window) == -1) {
+        array_insert(windows_to_fetch_this_cycle, window);
+    }
+}
+
+void window_present_framebuffer(user_window_t* window, uint32_t framebuffer_index) {
+    if (framebuffer_index >= AWM_WINDOW_FRAMEBUFFER_COUNT) {
+        printf("[AWM] %s presented invalid framebuffer %d\n", window->owner_service, framebuffer_index);
+        return;
+    }
+    if (framebuffer_index == window->front_framebuffer) {
+        // Single-buffered clients present the same framebuffer every time
+        return;
+    }
+
+    uint32_t previous_front_framebuffer = window->front_framebuffer;
+    window->front_framebuffer = framebuffer_index;
+    window->content_view->layer->raw = (uint8_t*)window->framebuffers[framebuffer_index];
+
+    // Compositing happens on this thread, so nothing can still be reading from the previous framebuffer
+    if (!window->remote_process_died) {
+        awm_window_framebuffer_released_msg_t msg = {
+            .event = AWM_WINDOW_FRAMEBUFFER_RELEASED,
+            .framebuffer = previous_front_framebuffer
+        };
+        amc_message_send(window->owner_service, &msg, sizeof(msg));
+    }
+}
+
+static Size _window_laid_out_size(user_window_t* window) {
+    // The frame may be mid-animation, so use the size that the decorations and content are laid out for
+    Rect content_frame = window->content_view->frame;
+    return size_make(
+        rect_max_x(content_frame) + WINDOW_BORDER_MARGIN,
+        rect_max_y(content_frame) + WINDOW_BORDER_MARGIN
+    );
+}
+
+static void _window_snapshot_into(user_window_t* window, ca_layer* snapshot) {
+    Rect content_frame = window->content_view->frame;
+    if (window->has_title_bar) {
+        blit_layer(
+            snapshot,
+            window->layer,
+            rect_make(point_zero(), size_make(snapshot->size.width, WINDOW_TITLE_BAR_HEIGHT)),
+            rect_make(point_zero(), size_make(snapshot->size.width, WINDOW_TITLE_BAR_HEIGHT))
+        );
+    }
+    blit_layer(
+        snapshot,
+        window->content_view->layer,
+        content_frame,
+        rect_make(point_zero(), content_frame.size)
+    );
+}
+
+ca_layer* window_snapshot(user_window_t* window) {
+    ca_layer* snapshot = create_layer(_window_laid_out_size(window));
+    _window_snapshot_into(window, snapshot);
+    return snapshot;
+}
+
+void window_begin_scaled_snapshot(user_window_t* window) {
+    // Overlapping animations share the snapshot
+    window->scaled_snapshot_users += 1;
+    if (window->scaled_snapshot) {
+        window_refresh_scaled_snapshot(window);
+        return;
+    }
+    window->scaled_snapshot = window_snapshot(window);
+}
+
+void window_refresh_scaled_snapshot(user_window_t* window) {
+    if (!window->scaled_snapshot) {
+        return;
+    }
+    Size laid_out_size = _window_laid_out_size(window);
+    if (laid_out_size.width != window->scaled_snapshot->size.width || laid_out_size.height != window->scaled_snapshot->size.height) {
+        layer_teardown(window->scaled_snapshot);
+        window->scaled_snapshot = create_layer(laid_out_size);
+    }
+    _window_snapshot_into(window, window->scaled_snapshot);
+}
+
+void window_end_scaled_snapshot(user_window_t* window) {
+    if (!window->scaled_snapshot_users || --window->scaled_snapshot_users > 0) {
+        return;
+    }
+    layer_teardown(window->scaled_snapshot);
+    window->scaled_snapshot = NULL;
+    // Redraw the window from its live content
+    compositor_queue_rect_to_redraw(window->frame);
+}
+
 void desktop_view_queue_composite(view_t* view) {
     if (array_index(views_to_composite_this_cycle, view) == -1) {
         array_insert(views_to_composite_this_cycle, view);
@@ -377,7 +508,7 @@ void desktop_view_queue_composite(view_t* view) {
 }
 
 void desktop_view_queue_extra_draw(view_t* view, Rect extra) {
-    rect_add(view->extra_draws_this_cycle, extra);
+    region_union_rect(&view->extra_draw_region, extra);
 }
 
 static void _write_window_title(user_window_t* window) {
@@ -403,6 +534,58 @@ static void _write_window_title(user_window_t* window) {
 	}
 }
 
+static ca_layer* _decode_image_to_layer(image_t* image, Size size) {
+	ca_layer* layer = create_layer(size);
+	image_render_to_layer(image, layer, rect_make(point_zero(), size));
+	return layer;
+}
+
+static ca_layer* _decode_icon_to_layer(image_t* image) {
+	if (!image) {
+		return NULL;
+	}
+	return _decode_image_to_layer(image, image->size);
+}
+
+static uint32_t _title_bar_slice_column(uint32_t x, uint32_t title_bar_width) {
+	uint32_t slices_width = _g_title_bar_slices->size.width;
+	uint32_t cap_width = min((uint32_t)TITLE_BAR_SLICE_CAP_WIDTH, title_bar_width / 2);
+	if (x < cap_width) {
+		return x;
+	}
+	if (x >= title_bar_width - cap_width) {
+		return slices_width - (title_bar_width - x);
+	}
+	// Stretch the middle of the source across the middle of the title bar
+	uint32_t source_middle_width = slices_width - (TITLE_BAR_SLICE_CAP_WIDTH * 2);
+	uint32_t middle_width = title_bar_width - (cap_width * 2);
+	return TITLE_BAR_SLICE_CAP_WIDTH + (((x - cap_width) * source_middle_width) / middle_width);
+}
+
+// Draws the part of the background of a title bar of the given width that lies within area
+static void _title_bar_draw_background(ca_layer* dest, uint32_t title_bar_width, Rect area) {
+	uint32_t bpp = screen_bytes_per_pixel();
+	uint32_t min_x = max(rect_min_x(area), 0);
+	uint32_t max_x = min(rect_max_x(area), dest->size.width);
+	uint32_t min_y = max(rect_min_y(area), 0);
+	uint32_t max_y = min(rect_max_y(area), min(_g_title_bar_slices->size.height, dest->size.height));
+	for (uint32_t y = min_y; y < max_y; y++) {
+		uint8_t* dest_row = dest->raw + (y * dest->size.width * bpp);
+		uint8_t* source_row = _g_title_bar_slices->raw + (y * _g_title_bar_slices->size.width * bpp);
+		for (uint32_t x = min_x; x < max_x; x++) {
+			memcpy(dest_row + (x * bpp), source_row + (_title_bar_slice_column(x, title_bar_width) * bpp), bpp);
+		}
+	}
+}
+
+static void _title_bar_draw_button(user_window_t* window, Rect button_frame, ca_layer* button_layer) {
+	// Buttons sit on top of the background, so restore it first
+	_title_bar_draw_background(window->layer, window->frame.size.width, button_frame);
+	if (button_layer) {
+		blit_layer(window->layer, button_layer, button_frame, rect_make(point_zero(), button_frame.size));
+	}
+}
+
 void window_redraw_title_bar(user_window_t* window, bool title_bar_active, bool close_button_active, bool minimize_button_active) {
     assert(window != NULL, "window_redraw_title_bar() got NULL window");
     if (!window->has_title_bar) {
@@ -410,22 +593,50 @@ void window_redraw_title_bar(user_window_t* window, bool title_bar_active, bool
         return;
     }
 
-	if (!_g_title_bar_image) {
+	if (!_g_title_bar_slices) {
 		//printf("No images yet...\n");
 		return;
 	}
 
+	// The decorations are frozen while the window is animating from its snapshot
+	if (window->scaled_snapshot) {
+		return;
+	}
+
 	Size title_bar_size = size_make(window->frame.size.width, WINDOW_TITLE_BAR_HEIGHT);
     Rect title_bar_frame = rect_make(
         point_zero(), 
         size_make(title_bar_size.width, WINDOW_TITLE_BAR_VISIBLE_HEIGHT)
     );
-    //printf("rendering with frame %d\n", title_bar_size.width);
-	image_render_to_layer(
-		_g_title_bar_image, 
-		window->layer, 
-        title_bar_frame
+
+	uint32_t icon_height = _g_title_bar_x_unfilled_layer ? _g_title_bar_x_unfilled_layer->size.height : 16;
+	Size icon_size = size_make(icon_height, icon_height);
+	window->close_button_frame = rect_make(point_make(icon_height * 1.5, 5), icon_size);
+	window->minimize_button_frame = rect_make(point_make(icon_height * 2.75, 5), icon_size);
+	ca_layer* close_button_layer = (close_button_active) ? _g_title_bar_x_filled_layer : _g_title_bar_x_unfilled_layer;
+	ca_layer* minimize_button_layer = (close_button_active) ? _g_title_bar_minimize_filled_layer : _g_title_bar_minimize_unfilled_layer;
+
+	bool needs_full_redraw = (
+		!window->title_bar_is_drawn ||
+		window->title_bar_drawn_width != title_bar_size.width ||
+		window->title_bar_drawn_active != title_bar_active
 	);
+	if (!needs_full_redraw) {
+		// Only redraw the buttons whose state changed, if any
+		if (window->close_button_drawn_active != close_button_active) {
+			_title_bar_draw_button(window, window->close_button_frame, close_button_layer);
+			compositor_queue_rect_to_redraw(rect_make(point_make(window->frame.origin.x + window->close_button_frame.origin.x, window->frame.origin.y + window->close_button_frame.origin.y), window->close_button_frame.size));
+		}
+		if (window->minimize_button_drawn_active != close_button_active) {
+			_title_bar_draw_button(window, window->minimize_button_frame, minimize_button_layer);
+			compositor_queue_rect_to_redraw(rect_make(point_make(window->frame.origin.x + window->minimize_button_frame.origin.x, window->frame.origin.y + window->minimize_button_frame.origin.y), window->minimize_button_frame.size));
+		}
+		window->close_button_drawn_active = close_button_active;
+		window->minimize_button_drawn_active = close_button_active;
+		return;
+	}
+
+	_title_bar_draw_background(window->layer, title_bar_size.width, title_bar_frame);
 
     // Draw a highlight border if necessary
     if (title_bar_active) {
@@ -438,34 +649,23 @@ void window_redraw_title_bar(user_window_t* window, bool title_bar_active, bool
         );
     }
 
-	image_t* x_image = (close_button_active) ? _g_title_bar_x_filled : _g_title_bar_x_unfilled;
-	uint32_t icon_height = x_image->size.height;
-	window->close_button_frame = rect_make(
-		point_make(icon_height * 1.5, 5), 
-		x_image->size
-	);
-	image_render_to_layer(
-		x_image, 
-		window->layer, 
-		window->close_button_frame
-	);
-
-	window->minimize_button_frame = rect_make(
-		point_make(icon_height * 2.75, 5), 
-		x_image->size
-	);
-	image_t* minimize_image = (close_button_active) ? _g_title_bar_minimize_filled : _g_title_bar_minimize_unfilled;
-	image_render_to_layer(
-		minimize_image, 
-		window->layer, 
-		window->minimize_button_frame
-	);
+	if (close_button_layer) {
+		blit_layer(window->layer, close_button_layer, window->close_button_frame, rect_make(point_zero(), icon_size));
+	}
+	if (minimize_button_layer) {
+		blit_layer(window->layer, minimize_button_layer, window->minimize_button_frame, rect_make(point_zero(), icon_size));
+	}
 
 	// Draw window title
 	_write_window_title(window);
 
+	window->title_bar_is_drawn = true;
+	window->title_bar_drawn_width = title_bar_size.width;
+	window->title_bar_drawn_active = title_bar_active;
+	window->close_button_drawn_active = close_button_active;
+	window->minimize_button_drawn_active = close_button_active;
+
     // Push the update
-    // TODO(PT): Only queue the button frames, and only do so if there was a state change
     compositor_queue_rect_to_redraw(rect_make(window->frame.origin, title_bar_size));
 }
 
@@ -837,6 +1037,20 @@ void windows_fetch_resource_images(void) {
 	_g_title_bar_minimize_filled = load_image("/images/titlebar_minimize_filled.bmp");
 	_g_title_bar_minimize_filled = load_image("/images/titlebar_minimize_filled.bmp");
 	_g_title_bar_minimize_unfilled = load_image("/images/titlebar_minimize_unfilled.bmp");
+
+	// Decode the decorations once up-front, rather than each time a title bar is drawn
+	if (_g_title_bar_image) {
+		// Ensure there's always a middle slice to stretch
+		_g_title_bar_slices = _decode_image_to_layer(
+			_g_title_bar_image,
+			size_make(max(_g_title_bar_image->size.width, TITLE_BAR_SLICE_CAP_WIDTH * 2 + 1), WINDOW_TITLE_BAR_VISIBLE_HEIGHT)
+		);
+	}
+	_g_title_bar_x_filled_layer = _decode_icon_to_layer(_g_title_bar_x_filled);
+	_g_title_bar_x_unfilled_layer = _decode_icon_to_layer(_g_title_bar_x_unfilled);
+	_g_title_bar_minimize_filled_layer = _decode_icon_to_layer(_g_title_bar_minimize_filled);
+	_g_title_bar_minimize_unfilled_layer = _decode_icon_to_layer(_g_title_bar_minimize_unfilled);
+
     for (int32_t i = 0; i < windows->size; i++) {
         user_window_t* w = array_lookup(windows, i);
         window_redraw_title_bar(w, false, false, false);
@@ -876,32 +1090,26 @@ user_window_t* window_create(const char* owner_service, uint32_t width, uint32_t
         array_insert(windows_without_z_order, window);
     }
 
-	window->drawable_rects = array_create(256);
-	window->extra_draws_this_cycle = array_create(512);
+	region_init(&window->drawable_region);
+	region_init(&window->extra_draw_region);
 
-	// Shared layer is size of the screen to allow window resizing
+	// The shared framebuffers have the stride of the screen to allow window resizing
+	// Address space is reserved for the whole screen, but memory is only committed for the rows in use
     Size res = screen_resolution();
-	uint32_t shmem_size = res.width * res.height * screen_bytes_per_pixel(); 
-
-    amc_shared_memory_create_cmd_t cmd = {
-        .event = AMC_SHARED_MEMORY_CREATE_REQUEST,
-        .buffer_size = shmem_size
-    };
-    snprintf(cmd.remote_service_name, sizeof(cmd.remote_service_name), "%s", owner_service);
-    
-    // Ask the kernel to set up a shared memory mapping we'll use for the framebuffer
-    amc_message_send(AXLE_CORE_SERVICE_NAME,  &cmd, sizeof(cmd));
-	amc_message_t* msg;
-    amc_message_await__u32_event(AXLE_CORE_SERVICE_NAME, AMC_SHARED_MEMORY_CREATE_RESPONSE, &msg);
-
-    amc_shared_memory_create_response_t* shmem_info = (amc_shared_memory_create_response_t*)&msg->body;
-    uintptr_t shmem_local = shmem_info->local_buffer_start;
-    uintptr_t shmem_remote = shmem_info->remote_buffer_start;
-
-    // Another message has been delivered, so the owner_service pointer is no longer valid
+	uint32_t bytes_per_row = res.width * screen_bytes_per_pixel();
+	uint32_t initial_rows = min(height, res.height);
+	uintptr_t remote_framebuffers[AWM_WINDOW_FRAMEBUFFER_COUNT] = {0};
+    // Waiting for core's responses will deliver other messages, after which the owner_service pointer is no longer valid
     // Re-set it to a copy we made so it can be safely used down below
-    owner_service = &cmd.remote_service_name;
-    printf("owner_service 0x%p cmd.remote_service_name 0x%p\n", owner_service, cmd.remote_service_name);
+    owner_service = req.remote_service;
+	for (uint32_t i = 0; i < AWM_WINDOW_FRAMEBUFFER_COUNT; i++) {
+		window->framebuffer_shmem[i] = amc_shmem_create(bytes_per_row * initial_rows, bytes_per_row * res.height, &window->framebuffers[i]);
+		assert(window->framebuffer_shmem[i] != 0, "Failed to create window framebuffer");
+		bool did_share = amc_shmem_share(window->framebuffer_shmem[i], owner_service, &remote_framebuffers[i]);
+		assert(did_share, "Failed to share window framebuffer");
+	}
+	window->framebuffer_committed_rows = initial_rows;
+	uint32_t shmem_size = bytes_per_row * res.height;
 
 	// Place the window in the center of the screen, minus the dock's height
 	Point origin = point_make(
@@ -909,14 +1117,16 @@ user_window_t* window_create(const char* owner_service, uint32_t width, uint32_t
 		((res.height - AWM_DOCK_HEIGHT) / 2) - (height / 2)
 	);
 	window->frame = rect_make(origin, size_zero());
-	window->layer = create_layer(res);
+	// Everything below the title bar is drawn from the content view
+	window->layer = create_layer(size_make(res.width, WINDOW_TITLE_BAR_HEIGHT));
 
 	view_t* content_view = calloc(1, sizeof(view_t));
 	content_view->layer = calloc(1, sizeof(ca_layer));
 	content_view->layer->size = res;
-	content_view->layer->raw = (uint8_t*)shmem_local;
+	content_view->layer->raw = (uint8_t*)window->framebuffers[0];
 	content_view->layer->alpha = 1.0;
 	window->content_view = content_view;
+	window->front_framebuffer = 0;
 
 	// Copy the owner service name as we don't own it
 	window->owner_service = strndup(owner_service, AMC_MAX_SERVICE_NAME_LEN);
@@ -932,16 +1142,21 @@ user_window_t* window_create(const char* owner_service, uint32_t width, uint32_t
 	// Now that we've configured the initial window state on our end, 
 	// provide the buffer to the client
 	printf("AWM made shared framebuffer for %s\n", owner_service);
-	printf("\tAWM    memory: %p - %p\n", shmem_local, shmem_local + shmem_size);
-	printf("\tRemote memory: %p - %p\n", shmem_remote, shmem_remote + shmem_size);
+	for (uint32_t i = 0; i < AWM_WINDOW_FRAMEBUFFER_COUNT; i++) {
+		printf("\t[%d] AWM    memory: %p - %p\n", i, window->framebuffers[i], window->framebuffers[i] + shmem_size);
+		printf("\t[%d] Remote memory: %p - %p\n", i, remote_framebuffers[i], remote_framebuffers[i] + shmem_size);
+	}
 
     Size screen_size = screen_resolution();
     awm_create_window_response_t req2 = {
         .event = AWM_CREATE_WINDOW_RESPONSE,
         .screen_resolution = screen_size,
         .bytes_per_pixel = screen_bytes_per_pixel(),
-        .framebuffer = shmem_remote
+        .framebuffer = (void*)remote_framebuffers[0]
     };
+	for (uint32_t i = 0; i < AWM_WINDOW_FRAMEBUFFER_COUNT; i++) {
+		req2.framebuffers[i] = (void*)remote_framebuffers[i];
+	}
     amc_message_send(owner_service, &req2, sizeof(req2));
 
     awm_animation_open_window_t* open_window_animation = NULL;
@@ -999,6 +1214,24 @@ user_window_t* window_create(const char* owner_service, uint32_t width, uint32_t
     return window;
 }
 
+void window_ensure_framebuffer_rows(user_window_t* window, uint32_t rows) {
+	Size res = screen_resolution();
+	rows = min(rows, res.height);
+	if (rows <= window->framebuffer_committed_rows) {
+		return;
+	}
+	// Grow in place, so the mappings in both awm and the owner stay put
+	uint32_t bytes_per_row = res.width * screen_bytes_per_pixel();
+	for (uint32_t i = 0; i < AWM_WINDOW_FRAMEBUFFER_COUNT; i++) {
+		if (!amc_shmem_resize(window->framebuffer_shmem[i], bytes_per_row * rows)) {
+			printf("[AWM] Failed to grow framebuffer %d of %s to %d rows\n", i, window->owner_service, rows);
+			// Framebuffers that did grow keep their extra rows, which is harmless
+			return;
+		}
+	}
+	window->framebuffer_committed_rows = rows;
+}
+
 void window_destroy(user_window_t* window) {
     assert(window != NULL, "Expected non-NULL window");
 
@@ -1028,14 +1261,23 @@ void window_destroy(user_window_t* window) {
 	compositor_queue_rect_to_redraw(window->frame);
 
 	layer_teardown(window->layer);
+	if (window->scaled_snapshot) {
+		layer_teardown(window->scaled_snapshot);
+	}
 
 	// Special 'virtual' layer that doesn't need its internal buffer freed (because it's backed by shared memory)
+	// The shared memory itself is freed once the owner has also let go of it
+	for (uint32_t i = 0; i < AWM_WINDOW_FRAMEBUFFER_COUNT; i++) {
+		amc_shmem_unmap(window->framebuffer_shmem[i]);
+	}
 	free(window->content_view->layer);
 	free(window->content_view);
 
 	free(window->owner_service);
 	free(window->title);
 
+	region_teardown(&window->drawable_region);
+	region_teardown(&window->extra_draw_region);
 	free(window);
 }
 
@@ -1052,259 +1294,126 @@ array_t* desktop_views_ready_to_composite_array(void) {
 }
 
 void windows_invalidate_drawable_regions_in_rect(Rect r) {
-    //printf("windows_invalidate_drawable_regions_in_rect(%d, %d, %d, %d)\n", r.origin.x, r.origin.y, r.size.width, r.size.height);
+    // Views keep their drawable regions between calls, so only the part of each region within r
+    // can have changed. Walk the views once from top to bottom, accumulating the area within r
+    // that's covered by the views above, rather than re-occluding each view against every view above it.
+    frame_stats_phase_begin(AWM_FRAME_PHASE_OCCLUSION);
     array_t* all_views = all_desktop_views();
-    for (int32_t i = all_views->size - 1; i >= 0; i--) {
+    region_t covered_region;
+    region_init(&covered_region);
+    region_t frame_in_rect_region;
+    region_init(&frame_in_rect_region);
+    region_t exposed_region;
+    region_init(&exposed_region);
+
+    for (int32_t i = 0; i < all_views->size; i++) {
         view_t* view = array_lookup(all_views, i);
+        // Drop the stale parts of the region within r. The view may have previously been visible within r
+        // even if its frame no longer intersects it.
+        if (region_intersects_rect(&view->drawable_region, r)) {
+            region_subtract_rect(&view->drawable_region, r);
+        }
         if (!rect_intersects(view->frame, r)) {
             continue;
         }
 
-        // Recompute the non-occluded rects belonging to the view
-        for (int32_t j = view->drawable_rects->size - 1; j >= 0; j--) {
-            Rect* r = array_lookup(view->drawable_rects, j);
-            free(r);
-            array_remove(view->drawable_rects, j);
-        }
-
-        rect_add(view->drawable_rects, view->frame);
-
-        for (int32_t j = i - 1; j >= 0; j--) {
-            view_t* occluding_view = array_lookup(all_views, j);
-            if (!rect_intersects(occluding_view->frame, view->frame)) {
-                continue;
-            }
-            view->drawable_rects = update_occlusions(view->drawable_rects, occluding_view->frame);
-            if (!view->drawable_rects->size) {
-                break;
-            }
-        }
-        //printf("\tUpdated drawable rects of view %d to contain %d rects\n", i, view->drawable_rects->size);
-        if (view->drawable_rects->size) {
-            /*
-            for (int j = 0; j < view->drawable_rects->size; j++) {
-                Rect* r = array_lookup(view->drawable_rects, j);
-                printf("\t\t(%d, %d, %d, %d)\n", rect_min_x(*r), rect_min_y(*r), r->size.width, r->size.height);
-            }
-            */
-            desktop_view_queue_composite(view);
-        }
-        else {
-            //printf("Will not composite %s because it's fully occluded\n", window->owner_service);
+        // The parts of the view within r that aren't covered by anything above it are now visible
+        region_set_rect(&frame_in_rect_region, view->frame);
+        region_intersect_rect(&frame_in_rect_region, r);
+        region_subtract(&exposed_region, &frame_in_rect_region, &covered_region);
+        if (!region_is_empty(&exposed_region)) {
+            region_union(&view->drawable_region, &view->drawable_region, &exposed_region);
+            // Only the newly exposed parts need to be redrawn, rather than the whole view
+            region_union(&view->extra_draw_region, &view->extra_draw_region, &exposed_region);
         }
+        region_union(&covered_region, &covered_region, &frame_in_rect_region);
     }
-    array_destroy(all_views);
-}
 
-void windows_composite(ca_layer* dest, Rect updated_rect) {
-    // TODO(PT): This is unused?!
-    //printf("Update rect: (%d, %d), (%d, %d)\n", rect_min_x(updated_rect), rect_min_y(updated_rect), updated_rect.size.width, updated_rect.size.height);
-
-    for (uint32_t i = 0; i < windows->size; i++) {
-        user_window_t* window = array_lookup(windows, i);
-        Rect* r = calloc(1, sizeof(Rect));
-        *r = window->frame;
-        array_insert(window->drawable_rects, r);
-    }
-    
-    printf("Windows without z order %d with %d\n", windows_without_z_order->size, windows_with_z_order->size);
-    array_t* windows_in_z_order = array_create(windows_with_z_order->size + windows_without_z_order->size);
-    // Always draw windows without Z-order on top
-    for (int i = 0; i < windows_without_z_order->size; i++) {
-        array_insert(windows_in_z_order, array_lookup(windows_without_z_order, i));
-    }
-    for (int i = 0; i < windows_with_z_order->size; i++) {
-        array_insert(windows_in_z_order, array_lookup(windows_with_z_order, i));
-    }
-
-    for (int i = 0; i < windows_in_z_order->size; i++) {
-        user_window_t* window = array_lookup(windows_in_z_order, i);
-        if (!window->has_done_first_draw) {
-            continue;
-        }
-
-        for (int outer_rect_idx = 0; outer_rect_idx < window->drawable_rects->size; outer_rect_idx++) {
-            Rect* outer_rect_ptr = array_lookup(window->drawable_rects, outer_rect_idx);
-            Rect outer_rect = *outer_rect_ptr;
-
-            for (int j = i + 1; j < windows_in_z_order->size; j++) {
-                user_window_t* bg_window = array_lookup(windows_in_z_order, j);
-                Color c = color_rand();
-
-                array_t* new_drawable_rects = array_create(bg_window->drawable_rects->max_size);
-                for (int k = 0; k < bg_window->drawable_rects->size; k++) {
-                    Rect* inner_rect_ptr = array_lookup(bg_window->drawable_rects, k);
-                    Rect inner_rect = *inner_rect_ptr;
-                    if (!rect_intersects(outer_rect, inner_rect)) {
-                        array_insert(new_drawable_rects, inner_rect_ptr);
-                    }
-                    else {
-                        array_t* splits = rect_diff(inner_rect, outer_rect);
-                        for (int split_idx = 0; split_idx < splits->size; split_idx++) {
-                            Rect* r = array_lookup(splits, split_idx);
-                            //printf("%d %d %d %d\n", r->origin.x, r->origin.y, r->size.width, r->size.height);
-                            array_insert(new_drawable_rects, r);
-                        }
-                        array_destroy(splits);
-
-                        free(inner_rect_ptr);
-                    }
-                }
-                array_destroy(bg_window->drawable_rects);
-                bg_window->drawable_rects = new_drawable_rects;
-            }
-        }
-
-        if (window->has_title_bar) {
-            // TODO(PT): Can these calls be combined?
-            blit_layer(
-                dest, 
-                window->layer, 
-                window->frame, 
-                rect_make(
-                    point_zero(), 
-                    size_make(
-                        window->frame.size.width,
-                        WINDOW_TITLE_BAR_VISIBLE_HEIGHT
-                    )
-                )
-            );
-            blit_layer(
-                dest, 
-                window->layer, 
-                rect_make(
-                    point_make(
-                        window->frame.origin.x,
-                        window->frame.origin.y + WINDOW_TITLE_BAR_HEIGHT
-                    ),
-                    size_make(
-                        window->frame.size.width,
-                        window->frame.size.height - WINDOW_TITLE_BAR_HEIGHT
-                    )
-                ),
-                rect_make(
-                    point_make(
-                        0,
-                        WINDOW_TITLE_BAR_HEIGHT
-                    ), 
-                    size_make(
-                        window->frame.size.width,
-                        window->frame.size.height - WINDOW_TITLE_BAR_HEIGHT
-                    )
-                )
-            );
-        }
-        else {
-            blit_layer(
-                dest, 
-                window->layer, 
-                window->frame, 
-                rect_make(
-                    point_zero(), 
-                    window->frame.size
-                )
-            );
-        }
-    }
-    /*
-    draw_rect(dest, updated_rect, color_red(), 1);
-
-    for (int32_t i = windows->size - 1; i >= 0; i--) {
-        user_window_t* window = array_lookup(windows, i);
-        //printf("%s has %d drawable rects\n", window->owner_service, window->drawable_rects->size);
-        for (int j = 0; j < window->drawable_rects->size; j++) {
-            Rect* r = array_lookup(window->drawable_rects, j);
-            if (!rect_intersects(*r, updated_rect)) {
-                continue;
-            }
-
-            uint32_t offset_x = r->origin.x - rect_min_x(window->frame);
-            uint32_t offset_y = r->origin.y - rect_min_y(window->frame);
-            blit_layer(
-                dest, 
-                window->layer, 
-                *r, 
-                rect_make(
-                    point_make(offset_x, offset_y), 
-                    r->size
-                )
-            );
-            draw_rect(dest, *r, color_rand(), 2);
-        }
-    }
-    */
-
-    for (uint32_t i = 0; i < windows_in_z_order->size; i++) {
-        user_window_t* window = array_lookup(windows_in_z_order, i);
-        for (int32_t j = window->drawable_rects->size - 1; j >= 0; j--) {
-            Rect* r = array_lookup(window->drawable_rects, j);
-            free(r);
-            array_remove(window->drawable_rects, j);
-        }
-    }
-
-    array_destroy(windows_in_z_order);
+    region_teardown(&exposed_region);
+    region_teardown(&frame_in_rect_region);
+    region_teardown(&covered_region);
+    array_destroy(all_views);
+    frame_stats_phase_end(AWM_FRAME_PHASE_OCCLUSION);
 }
 
 view_t* view_create(Rect frame) {
     view_t* v = calloc(1, sizeof(view_t));
     v->frame = frame;
 	v->layer = create_layer(frame.size);
-    v->drawable_rects = array_create(256);
-    v->extra_draws_this_cycle = array_create(256);
+    region_init(&v->drawable_region);
+    region_init(&v->extra_draw_region);
     return v;
 }
 
 void view_destroy(view_t** view_ptr) {
     view_t* view = *view_ptr;
-    array_destroy(view->drawable_rects);
-    array_destroy(view->extra_draws_this_cycle);
+    region_teardown(&view->drawable_region);
+    region_teardown(&view->extra_draw_region);
     layer_teardown(view->layer);
     free(view);
     // Prevent UAF
     *view_ptr = NULL;
 }
 
-void draw_queued_extra_draws(array_t* views, ca_layer* dest_layer) {
-    for (int32_t i = 0; i < views->size; i++) {
-        //user_window_t* window = array_lookup(windows, i);
-        view_t* view = array_lookup(views, i);
-        for (int32_t j = view->extra_draws_this_cycle->size - 1; j >= 0; j--) {
-            Rect* r_ptr = array_lookup(view->extra_draws_this_cycle, j);
-            Rect r = *r_ptr;
-            int32_t offset_x = r.origin.x - rect_min_x(view->frame);
-            int32_t offset_y = r.origin.y - rect_min_y(view->frame);
-            if (rect_max_x(r) < rect_min_x(view->frame) || rect_max_y(r) < rect_min_y(view->frame)) {
-                continue;
-            }
+static void _view_blit_own_layer(ca_layer* dest_layer, view_t* view, Rect r) {
+    blit_layer(
+        dest_layer,
+        view->layer,
+        r,
+        rect_make(
+            point_make(r.origin.x - rect_min_x(view->frame), r.origin.y - rect_min_y(view->frame)),
+            r.size
+        )
+    );
+}
 
-            int x_origin = rect_min_x(view->frame) - rect_min_x(r);
-            if (x_origin > 0){ 
-                r.origin.x += x_origin;
-            }
-            int y_origin = rect_min_y(view->frame) - rect_min_y(r);
-            if (y_origin > 0){ 
-                r.origin.y += y_origin;
-            }
+void view_draw_rect(ca_layer* dest_layer, view_t* view, Rect r) {
+    if (view->scaled_snapshot) {
+        blit_layer_scaled_bilinear(dest_layer, view->scaled_snapshot, view->frame, r);
+        return;
+    }
 
-            int x_overhang = rect_max_x(r) - rect_max_x(view->frame);
-            if (x_overhang > 0) {
-                r.size.width -= x_overhang;
-            }
-            int y_overhang = rect_max_y(r) - rect_max_y(view->frame);
-            if (y_overhang > 0) {
-                r.size.height -= y_overhang;
-            }
+    view_t* content_view = view->content_view;
+    if (!content_view) {
+        _view_blit_own_layer(dest_layer, view, r);
+        return;
+    }
 
-            blit_layer(
-                dest_layer,
-                view->layer,
-                r,
-                rect_make(
-                    point_make(offset_x, offset_y), 
-                    r.size
-                )
-            );
+    Rect content_frame = content_view->frame;
+    content_frame.origin.x += rect_min_x(view->frame);
+    content_frame.origin.y += rect_min_y(view->frame);
+    if (!rect_intersects(r, content_frame)) {
+        _view_blit_own_layer(dest_layer, view, r);
+        return;
+    }
+
+    // Draw the content directly from the content view's layer, and the view's own layer only around it
+    Rect content_part = rect_intersect(r, content_frame);
+    blit_layer(
+        dest_layer,
+        content_view->layer,
+        content_part,
+        rect_make(
+            point_make(content_part.origin.x - rect_min_x(content_frame), content_part.origin.y - rect_min_y(content_frame)),
+            content_part.size
+        )
+    );
+    Rect surrounding_parts[4];
+    uint32_t surrounding_part_count = rect_subtract(r, content_frame, surrounding_parts);
+    for (uint32_t i = 0; i < surrounding_part_count; i++) {
+        _view_blit_own_layer(dest_layer, view, surrounding_parts[i]);
+    }
+}
+
+void draw_queued_extra_draws(array_t* views, ca_layer* dest_layer) {
+    for (int32_t i = 0; i < views->size; i++) {
+        view_t* view = array_lookup(views, i);
+        // Extra draws can be queued for any rect, and the view may have been occluded or moved since,
+        // so only keep the parts where the view is currently visible
+        region_intersect(&view->extra_draw_region, &view->extra_draw_region, &view->drawable_region);
+        for (uint32_t j = 0; j < region_rect_count(&view->extra_draw_region); j++) {
+            Rect r = region_rect_at(&view->extra_draw_region, j);
+            view_draw_rect(dest_layer, view, r);
             //draw_rect(_screen.vmem, r, color_rand(), 1);
         }
     }
@@ -1313,33 +1422,21 @@ void draw_queued_extra_draws(array_t* views, ca_layer* dest_layer) {
 void complete_queued_extra_draws(array_t* views, ca_layer* source_layer, ca_layer* dest_layer) {
     for (int32_t i = 0; i < views->size; i++) {
         view_t* view = array_lookup(views, i);
-        for (int32_t j = view->extra_draws_this_cycle->size - 1; j >= 0; j--) {
-            Rect* r_ptr = array_lookup(view->extra_draws_this_cycle, j);
-            Rect r = *r_ptr;
-            blit_layer(dest_layer, source_layer, r, r);
-            array_remove(view->extra_draws_this_cycle, j);
-            free(r_ptr);
+        for (uint32_t j = 0; j < region_rect_count(&view->extra_draw_region); j++) {
+            Rect r = region_rect_at(&view->extra_draw_region, j);
+            blit_layer__scanline(dest_layer, source_layer, r, r, screen_pixels_per_scanline());
+            frame_stats_note_scanout_rect(r);
         }
+        region_clear(&view->extra_draw_region);
     }
 }
 
 void draw_views_to_layer(array_t* views, ca_layer* dest_layer) {
     for (int32_t i = 0; i < views->size; i++) {
         view_t* view = array_lookup(views, i);
-        for (int32_t j = 0; j < view->drawable_rects->size; j++) {
-            Rect* r_ptr = array_lookup(view->drawable_rects, j);
-            Rect r = *r_ptr;
-            uint32_t offset_x = r.origin.x - rect_min_x(view->frame);
-            uint32_t offset_y = r.origin.y - rect_min_y(view->frame);
-            blit_layer(
-                dest_layer,
-                view->layer,
-                r,
-                rect_make(
-                    point_make(offset_x, offset_y), 
-                    r.size
-                )
-            );
+        for (uint32_t j = 0; j < region_rect_count(&view->drawable_region); j++) {
+            Rect r = region_rect_at(&view->drawable_region, j);
+            view_draw_rect(dest_layer, view, r);
             //draw_rect(_screen.vmem, r, color_rand(), 1);
         }
     }
@@ -3,32 +3,41 @@
 
 #include <libagx/lib/shapes.h>
 #include <libagx/lib/ca_layer.h>
+#include <libagx/lib/region.h>
 #include "awm_internal.h"
+#include "awm_messages.h"
 #include "utils.h"
 
 typedef struct view {
 	Rect frame;
 	ca_layer* layer;
-	array_t* drawable_rects;
-	array_t* extra_draws_this_cycle;
+	// The parts of the frame that aren't occluded by other views, in screen coordinates
+	region_t drawable_region;
+	// Parts of the frame to redraw this cycle, in screen coordinates
+	region_t extra_draw_region;
 	bool should_scale_layer;
+	// Optional view composited from its own layer within this one, with a frame relative to this view
+	struct view* content_view;
+	// When set, drawn scaled to fill the frame in place of the layer and content view
+	ca_layer* scaled_snapshot;
 } view_t;
 
 typedef struct user_window {
 	// TODO(PT): These fields can't be reordered because draw_queued_extra_draws() 
 	// interprets user_window_t as a view_t.
 	Rect frame;
+	// Only holds the decorations. The content is composited straight from the owner's front framebuffer.
 	ca_layer* layer;
-	array_t* drawable_rects;
-	array_t* extra_draws_this_cycle;
+	region_t drawable_region;
+	region_t extra_draw_region;
 	bool should_scale_layer;
+	view_t* content_view;
+	ca_layer* scaled_snapshot;
 
 	uint32_t window_id;
 	const char* owner_service;
 	const char* title;
 
-	view_t* content_view;
-
 	Rect close_button_frame;
 	Rect minimize_button_frame;
 	Rect unminimized_frame;
@@ -41,6 +50,38 @@ typedef struct user_window {
 	bool is_resizable;
 	bool is_minimized;
 	bool is_mouse_within_content_view;
+
+	// Shared memory objects backing the owner's swap chain
+	// Rows are a full screen-width apart, and are committed as the window grows taller
+	uint32_t framebuffer_shmem[AWM_WINDOW_FRAMEBUFFER_COUNT];
+	uintptr_t framebuffers[AWM_WINDOW_FRAMEBUFFER_COUNT];
+	uint32_t framebuffer_committed_rows;
+	// The framebuffer the content view is composited from
+	uint32_t front_framebuffer;
+
+	// Regions of the content view that the owner has redrawn since the last fetch, in content view coordinates
+	// Ignored when the whole content view needs to be redrawn
+	Rect pending_damage[AWM_WINDOW_REDRAW_MAX_DAMAGE_RECTS];
+	uint32_t pending_damage_count;
+	bool pending_damage_is_full;
+	// When the owner committed the oldest redraw that hasn't been presented yet, or 0 if there isn't one
+	uint32_t redraw_committed_at;
+
+	// The state the decorations in the layer were last drawn with, so they're only redrawn when something changes
+	// Cleared whenever the decorations must be redrawn from scratch, such as when the title changes
+	bool title_bar_is_drawn;
+	uint32_t title_bar_drawn_width;
+	bool title_bar_drawn_active;
+	bool close_button_drawn_active;
+	bool minimize_button_drawn_active;
+
+	// How many animations are currently compositing the window from its scaled snapshot
+	uint32_t scaled_snapshot_users;
+
+	// The owner is sent at most one resize at a time, and must commit a redraw before it's sent another
+	bool is_awaiting_resize_commit;
+	// The window was resized while a resize was outstanding, so the owner must be sent its newest size
+	bool has_deferred_resize;
 } user_window_t;
 
 typedef struct desktop_shortcut desktop_shortcut_t;
@@ -73,11 +114,25 @@ user_window_t* window_with_service_name(const char* service_name);
 void windows_fetch_queued_windows(void);
 void windows_clear_queued_windows(void);
 void window_queue_fetch(user_window_t* window);
+// Fetches only the provided regions of the window's content view
+void window_queue_fetch_damage(user_window_t* window, Rect* damage_rects, uint32_t damage_rect_count);
+// Composites the window's content from the provided framebuffer from now on, and releases the previous one
+void window_present_framebuffer(user_window_t* window, uint32_t framebuffer_index);
+// Flattens the decorations and the current content into a new layer the size of the window
+ca_layer* window_snapshot(user_window_t* window);
+// Composites the window from a snapshot of its decorations and content, scaled to fill its frame,
+// so that the frame can be animated without the owner relaying out at each intermediate size
+void window_begin_scaled_snapshot(user_window_t* window);
+// Retakes the snapshot, for windows whose owner is still drawing while they animate
+void window_refresh_scaled_snapshot(user_window_t* window);
+void window_end_scaled_snapshot(user_window_t* window);
 
 void desktop_view_queue_composite(view_t* view);
 void desktop_view_queue_extra_draw(view_t* view, Rect extra);
 void desktop_views_flush_queues(void);
 array_t* desktop_views_ready_to_composite_array(void);
+// Windows whose owners have committed a redraw that will be composited this cycle
+array_t* windows_queued(void);
 
 void window_redraw_title_bar(user_window_t* window, bool title_bar_active, bool close_button_hovered, bool minimize_button_hovered);
 
@@ -94,21 +149,25 @@ void window_handle_keyboard_event(user_window_t* window, uint32_t event, uint32_
 void windows_init(void);
 user_window_t* window_create(const char* owner_service, uint32_t width, uint32_t height);
 void window_destroy(user_window_t* window);
+// Makes sure the shared framebuffer is backed by memory for the given number of content rows
+void window_ensure_framebuffer_rows(user_window_t* window, uint32_t rows);
 
 user_window_t* window_with_id(uint32_t window_id);
 void window_initiate_minimize(user_window_t* window);
 void window_minimize_from_message(awm_dock_window_minimize_with_info_event_t* event);
 void window_unminimize_from_message(awm_dock_task_view_clicked_event_t* event);
 
-void windows_composite(ca_layer* dest, Rect updated_rect);
 
 void windows_invalidate_drawable_regions_in_rect(Rect r);
 
 void windows_fetch_resource_images(void);
 
 view_t* view_create(Rect frame);
+// Draws a region of a view, in screen coordinates, to the destination layer
+void view_draw_rect(ca_layer* dest_layer, view_t* view, Rect r);
 
 void draw_queued_extra_draws(array_t* views, ca_layer* dest_layer);
+// Copies the extra draws from the composited frame to the memory-mapped framebuffer
 void complete_queued_extra_draws(array_t* views, ca_layer* source_layer, ca_layer* dest_layer);
 
 void draw_views_to_layer(array_t* views, ca_layer* dest_layer);
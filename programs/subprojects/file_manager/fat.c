@@ -6,6 +6,7 @@
 
 #include <libutils/assert.h>
 #include <libutils/sleep.h>
+#include <libamc/libamc.h>
 
 #include "ata.h"
 #include "vfs.h"
@@ -313,10 +314,24 @@ static void _parse_fat_directory(fat_fs_node_t* directory) {
 static array_t* _g_fat_sector_cache = NULL;
 
 typedef struct fat_cached_sector {
-	bool valid;
-	uint8_t data[512];
+	// NULL when the sector isn't cached. Allocated on demand so it can be freed under memory pressure.
+	uint8_t* data;
 } fat_cached_sector_t;
 
+static void _fat_cache_shrink(amc_memory_pressure_level_t level, uint64_t bytes_to_reclaim, void* ctx) {
+	// Table sectors are re-read from disk on the next lookup
+	uint32_t evicted_count = 0;
+	for (uint32_t i = 0; i < _g_fat_sector_cache->size; i++) {
+		fat_cached_sector_t* cached_sector = array_lookup(_g_fat_sector_cache, i);
+		if (cached_sector->data) {
+			free(cached_sector->data);
+			cached_sector->data = NULL;
+			evicted_count += 1;
+		}
+	}
+	printf("[FAT] Evicted %ld cached table sectors under memory pressure\n", evicted_count);
+}
+
 fat_fs_node_t* fat_parse_from_disk(fs_base_node_t* vfs_root) {
 	// TODO(PT): If the disk has been formatted, read these values from disk
 	// Otherwise, format the disk and store them
@@ -358,9 +373,9 @@ fat_fs_node_t* fat_parse_from_disk(fs_base_node_t* vfs_root) {
 	_g_fat_sector_cache = array_create(_g_fat_drive_info.fat_sector_count);
 	for (uint32_t i = 0; i < _g_fat_drive_info.fat_sector_count; i++) {
 		fat_cached_sector_t* desc = calloc(1, sizeof(fat_cached_sector_t));
-		desc->valid = false;
 		array_insert(_g_fat_sector_cache, desc);
 	}
+	amc_memory_pressure_register_shrink_callback(_fat_cache_shrink, NULL);
 
 	return fat_root;
 }
@@ -404,9 +419,10 @@ uint8_t* fat_read_file(fat_fs_node_t* fs_node, uint32_t* out_file_size) {
 
 void fat_cache_invalidate_table_sector(uint32_t fat_table_sector_idx) {
 	fat_cached_sector_t* cached_sector = array_lookup(_g_fat_sector_cache, fat_table_sector_idx);
-	if (cached_sector->valid) {
+	if (cached_sector->data) {
 		printf("[FAT] Invalidating cache of table sector %ld\n", fat_table_sector_idx);
-		cached_sector->valid = false;
+		free(cached_sector->data);
+		cached_sector->data = NULL;
 	}
 }
 
@@ -418,21 +434,21 @@ fat_entry_t* fat_read_table_sector(uint32_t fat_table_sector_idx) {
 	}
 
 	fat_cached_sector_t* cached_sector = array_lookup(_g_fat_sector_cache, fat_table_sector_idx);
-	if (cached_sector->valid) {
+	if (cached_sector->data) {
 		//printf("[FAT] Returning FAT sector index %ld from cache\n", fat_table_sector_idx);
-		return (fat_entry_t*)&cached_sector->data;
+		return (fat_entry_t*)cached_sector->data;
 	}
 
 	fat_drive_info_t drive_info = fat_drive_info();
 	ata_sector_t* fat_sector = ata_read_sector(drive_info.fat_head_sector + fat_table_sector_idx);
 
 	printf("[FAT] Inserting FAT sector index %ld into cache\n", fat_table_sector_idx);
-	cached_sector->valid = true;
-	memcpy(&cached_sector->data, &fat_sector->data, drive_info.sector_size);
+	cached_sector->data = malloc(drive_info.sector_size);
+	memcpy(cached_sector->data, &fat_sector->data, drive_info.sector_size);
 
 	free(fat_sector);
 
-	return (fat_entry_t*)&cached_sector->data;
+	return (fat_entry_t*)cached_sector->data;
 }
 
 uint8_t* fat_read_file_partial(fat_fs_node_t* fs_node, uint32_t offset, uint32_t length, uint32_t* out_length) {
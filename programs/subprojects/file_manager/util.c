@@ -92,7 +92,8 @@ void launch_amc_service_if_necessary(const char* service_name) {
 	amc_message_send(AXLE_CORE_SERVICE_NAME, &query, sizeof(query));
 
 	amc_message_t* response_msg;
-	amc_message_await(AXLE_CORE_SERVICE_NAME, &response_msg);
+	// Other messages from core, such as memory pressure events, may be queued ahead of the response
+	amc_message_await__u32_event(AXLE_CORE_SERVICE_NAME, AMC_QUERY_SERVICE_RESPONSE, &response_msg);
 	amc_query_service_response_t* response = (amc_query_service_response_t*)&response_msg->body;
 	assert(response->event == AMC_QUERY_SERVICE_RESPONSE, "Wrong core message received");
 	if (response->service_exists) {
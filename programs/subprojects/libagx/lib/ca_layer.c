@@ -1,6 +1,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "ca_layer.h"
 #include "rect.h"
@@ -242,6 +247,85 @@ Rect blit_layer(ca_layer* dest, ca_layer* src, Rect dest_frame, Rect src_frame)
 	return dest_frame;
 }
 
+static void _stream_row(uint8_t* dest, const uint8_t* src, uint32_t len) {
+#if defined(__SSE2__)
+	// Write with regular stores until the destination is aligned for streaming stores
+	uint32_t head_len = (16 - ((uintptr_t)dest & 15)) & 15;
+	head_len = MIN(head_len, len);
+	memcpy(dest, src, head_len);
+	dest += head_len;
+	src += head_len;
+	len -= head_len;
+
+	// Consecutive 16-byte streaming stores fill whole cache lines in the write-combining buffers,
+	// so each line goes out to the framebuffer as a single burst
+	while (len >= 64) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + 0));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(src + 32));
+		__m128i d = _mm_loadu_si128((const __m128i*)(src + 48));
+		_mm_stream_si128((__m128i*)(dest + 0), a);
+		_mm_stream_si128((__m128i*)(dest + 16), b);
+		_mm_stream_si128((__m128i*)(dest + 32), c);
+		_mm_stream_si128((__m128i*)(dest + 48), d);
+		dest += 64;
+		src += 64;
+		len -= 64;
+	}
+	while (len >= 16) {
+		_mm_stream_si128((__m128i*)dest, _mm_loadu_si128((const __m128i*)src));
+		dest += 16;
+		src += 16;
+		len -= 16;
+	}
+#endif
+	memcpy(dest, src, len);
+}
+
+void blit_layer__scanline(ca_layer* dest, ca_layer* src, Rect dest_frame, Rect src_frame, uint32_t dest_pixels_per_scanline) {
+	if (
+		rect_min_x(dest_frame) < 0 ||
+		rect_min_y(dest_frame) < 0 ||
+		rect_min_x(src_frame) < 0 ||
+		rect_min_y(src_frame) < 0 ||
+		dest_frame.size.width <= 0 ||
+		dest_frame.size.height <= 0 ||
+		src_frame.size.width <= 0 ||
+		src_frame.size.height <= 0
+	) {
+		return;
+	}
+	if (!dest_pixels_per_scanline) {
+		dest_pixels_per_scanline = dest->size.width;
+	}
+
+	// Don't read or write outside either layer
+	int width = MIN(dest_frame.size.width, src_frame.size.width);
+	width = MIN(width, dest->size.width - rect_min_x(dest_frame));
+	width = MIN(width, src->size.width - rect_min_x(src_frame));
+	int height = MIN(dest_frame.size.height, src_frame.size.height);
+	height = MIN(height, dest->size.height - rect_min_y(dest_frame));
+	height = MIN(height, src->size.height - rect_min_y(src_frame));
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+
+	int bpp = gfx_bytes_per_pixel();
+	uintptr_t dest_stride = dest_pixels_per_scanline * bpp;
+	uintptr_t src_stride = src->size.width * bpp;
+	uint8_t* dest_row = dest->raw + (rect_min_y(dest_frame) * dest_stride) + (rect_min_x(dest_frame) * bpp);
+	uint8_t* src_row = src->raw + (rect_min_y(src_frame) * src_stride) + (rect_min_x(src_frame) * bpp);
+	for (int i = 0; i < height; i++) {
+		_stream_row(dest_row, src_row, width * bpp);
+		dest_row += dest_stride;
+		src_row += src_stride;
+	}
+#if defined(__SSE2__)
+	// Streaming stores are weakly ordered, so make sure they've all landed before anyone else looks at the framebuffer
+	_mm_sfence();
+#endif
+}
+
 void blit_layer_scaled(ca_layer* dest, ca_layer* src, Size dest_size) {
 	// TODO(PT): Perhaps exactly 0 is OK
 	//assert(dest_size.width > 0 && dest_size.height > 0, "Invalid size passed to blit_layer_scaled");
@@ -274,6 +358,65 @@ void blit_layer_scaled(ca_layer* dest, ca_layer* src, Size dest_size) {
 	}
 }
 
+// Maps a destination pixel to a 16.16 fixed-point source coordinate, sampling at pixel centres
+static inline uint32_t _bilinear_source_coordinate(int32_t dest_offset, uint32_t step, int32_t src_length) {
+	int64_t coordinate = ((int64_t)dest_offset * step) + (step >> 1) - (1 << 15);
+	coordinate = MAX(coordinate, 0);
+	return MIN(coordinate, (int64_t)(src_length - 1) << 16);
+}
+
+void blit_layer_scaled_bilinear(ca_layer* dest, ca_layer* src, Rect dest_frame, Rect clip) {
+	if (dest_frame.size.width <= 0 || dest_frame.size.height <= 0 || src->size.width <= 0 || src->size.height <= 0) {
+		return;
+	}
+
+	// Only write within the clip rect, and within the destination layer
+	int32_t min_x = MAX(MAX(rect_min_x(dest_frame), rect_min_x(clip)), 0);
+	int32_t min_y = MAX(MAX(rect_min_y(dest_frame), rect_min_y(clip)), 0);
+	int32_t max_x = MIN(MIN(rect_max_x(dest_frame), rect_max_x(clip)), dest->size.width);
+	int32_t max_y = MIN(MIN(rect_max_y(dest_frame), rect_max_y(clip)), dest->size.height);
+	if (min_x >= max_x || min_y >= max_y) {
+		return;
+	}
+
+	// How far to move through the source for each destination pixel, in 16.16 fixed-point
+	uint32_t step_x = ((uint64_t)src->size.width << 16) / dest_frame.size.width;
+	uint32_t step_y = ((uint64_t)src->size.height << 16) / dest_frame.size.height;
+
+	int bpp = gfx_bytes_per_pixel();
+	uint32_t src_stride = src->size.width * bpp;
+	uint32_t dest_stride = dest->size.width * bpp;
+
+	for (int32_t y = min_y; y < max_y; y++) {
+		uint32_t src_y = _bilinear_source_coordinate(y - rect_min_y(dest_frame), step_y, src->size.height);
+		uint32_t y0 = src_y >> 16;
+		uint32_t y1 = MIN(y0 + 1, src->size.height - 1);
+		// Weights are kept to 8 bits so the products of both passes fit in 32 bits
+		uint32_t weight_y = (src_y >> 8) & 0xff;
+		uint8_t* top_row = src->raw + (y0 * src_stride);
+		uint8_t* bottom_row = src->raw + (y1 * src_stride);
+		uint8_t* dest_pixel = dest->raw + (y * dest_stride) + (min_x * bpp);
+
+		for (int32_t x = min_x; x < max_x; x++) {
+			uint32_t src_x = _bilinear_source_coordinate(x - rect_min_x(dest_frame), step_x, src->size.width);
+			uint32_t x0 = src_x >> 16;
+			uint32_t x1 = MIN(x0 + 1, src->size.width - 1);
+			uint32_t weight_x = (src_x >> 8) & 0xff;
+
+			uint8_t* top_left = top_row + (x0 * bpp);
+			uint8_t* top_right = top_row + (x1 * bpp);
+			uint8_t* bottom_left = bottom_row + (x0 * bpp);
+			uint8_t* bottom_right = bottom_row + (x1 * bpp);
+			for (int c = 0; c < bpp; c++) {
+				uint32_t top = (top_left[c] * (256 - weight_x)) + (top_right[c] * weight_x);
+				uint32_t bottom = (bottom_left[c] * (256 - weight_x)) + (bottom_right[c] * weight_x);
+				dest_pixel[c] = ((top * (256 - weight_y)) + (bottom * weight_y)) >> 16;
+			}
+			dest_pixel += bpp;
+		}
+	}
+}
+
 ca_layer* layer_snapshot(ca_layer* src, Rect frame) {
 	//clip frame
 	rect_min_x(frame) = MAX(0, rect_min_x(frame));
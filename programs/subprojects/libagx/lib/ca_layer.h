@@ -44,6 +44,19 @@ void layer_teardown(ca_layer* layer);
  */
 Rect blit_layer(ca_layer* dest, ca_layer* src, Rect dest_frame, Rect src_frame);
 
+/**
+ * @brief Copy pixels from a layer into a memory-mapped framebuffer.
+ * 			Rows in @p dest are @p dest_pixels_per_scanline apart, which may be wider than the layer.
+ * 			The destination is written with non-temporal stores that fill whole cache lines,
+ * 			which is the fast path for write-combining memory, and is never read from.
+ * @param dest Framebuffer layer to copy pixels to
+ * @param src Layer to copy pixels from
+ * @param dest_frame Rectangle inset of @p dest which pixels should be copied into
+ * @param src_frame Rectangle inset of @p src which pixels should be copied from
+ * @param dest_pixels_per_scanline Distance between the starts of consecutive rows in @p dest
+ */
+void blit_layer__scanline(ca_layer* dest, ca_layer* src, Rect dest_frame, Rect src_frame, uint32_t dest_pixels_per_scanline);
+
 /**
  * @brief Scale the contents of the source layer onto the destination layer,
  * 			filling the specified size.
@@ -51,6 +64,17 @@ Rect blit_layer(ca_layer* dest, ca_layer* src, Rect dest_frame, Rect src_frame);
  */
 void blit_layer_scaled(ca_layer* dest, ca_layer* src, Size dest_size);
 
+/**
+ * @brief Scale the whole source layer to fill @p dest_frame using bilinear filtering,
+ * 			but only write the destination pixels that lie within @p clip.
+ * 			This allows a scaled layer to be redrawn piecemeal, one damaged rect at a time.
+ * @param dest Destination layer to copy pixels to
+ * @param src Layer whose contents are scaled to fit
+ * @param dest_frame Rectangle inset of @p dest which the scaled source fills
+ * @param clip Rectangle inset of @p dest outside of which no pixels are written
+ */
+void blit_layer_scaled_bilinear(ca_layer* dest, ca_layer* src, Rect dest_frame, Rect clip);
+
 //create a copy of layer pointed to by src
 //only copies pixels bounded by the rectangle 'frame'
 /**
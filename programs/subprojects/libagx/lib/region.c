@@ -0,0 +1,397 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "../math.h"
+#include "shapes.h"
+#include "region.h"
+
+typedef enum region_op {
+	REGION_OP_UNION = 0,
+	REGION_OP_INTERSECT = 1,
+	REGION_OP_SUBTRACT = 2,
+} region_op_t;
+
+static bool _box_is_empty(region_box_t b) {
+	return b.x1 >= b.x2 || b.y1 >= b.y2;
+}
+
+static region_box_t _box_from_rect(Rect r) {
+	return (region_box_t){
+		.x1 = rect_min_x(r),
+		.y1 = rect_min_y(r),
+		.x2 = rect_max_x(r),
+		.y2 = rect_max_y(r),
+	};
+}
+
+static Rect _rect_from_box(region_box_t b) {
+	return rect_make(point_make(b.x1, b.y1), size_make(b.x2 - b.x1, b.y2 - b.y1));
+}
+
+static void _region_reserve(region_t* region, uint32_t capacity) {
+	if (capacity <= region->capacity) {
+		return;
+	}
+	uint32_t new_capacity = max(region->capacity * 2, max(capacity, 8));
+	region->boxes = realloc(region->boxes, new_capacity * sizeof(region_box_t));
+	region->capacity = new_capacity;
+}
+
+static void _region_append(region_t* region, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+	_region_reserve(region, region->count + 1);
+	region->boxes[region->count++] = (region_box_t){x1, y1, x2, y2};
+}
+
+void region_init(region_t* region) {
+	region->boxes = NULL;
+	region->count = 0;
+	region->capacity = 0;
+}
+
+void region_init_rect(region_t* region, Rect r) {
+	region_init(region);
+	region_set_rect(region, r);
+}
+
+void region_teardown(region_t* region) {
+	free(region->boxes);
+	region_init(region);
+}
+
+void region_clear(region_t* region) {
+	region->count = 0;
+}
+
+void region_set_rect(region_t* region, Rect r) {
+	region_clear(region);
+	region_box_t box = _box_from_rect(r);
+	if (!_box_is_empty(box)) {
+		_region_append(region, box.x1, box.y1, box.x2, box.y2);
+	}
+}
+
+void region_copy(region_t* dest, const region_t* src) {
+	if (dest == src) {
+		return;
+	}
+	region_clear(dest);
+	if (region_is_empty(src)) {
+		return;
+	}
+	_region_reserve(dest, src->count);
+	memcpy(dest->boxes, src->boxes, src->count * sizeof(region_box_t));
+	dest->count = src->count;
+}
+
+bool region_is_empty(const region_t* region) {
+	return region->count == 0;
+}
+
+Rect region_extents(const region_t* region) {
+	if (region_is_empty(region)) {
+		return rect_zero();
+	}
+	// The first and last boxes are in the top and bottom bands
+	region_box_t extents = {
+		.x1 = INT32_MAX,
+		.y1 = region->boxes[0].y1,
+		.x2 = INT32_MIN,
+		.y2 = region->boxes[region->count - 1].y2,
+	};
+	for (uint32_t i = 0; i < region->count; i++) {
+		extents.x1 = min(extents.x1, region->boxes[i].x1);
+		extents.x2 = max(extents.x2, region->boxes[i].x2);
+	}
+	return _rect_from_box(extents);
+}
+
+bool region_intersects_rect(const region_t* region, Rect r) {
+	region_box_t b = _box_from_rect(r);
+	for (uint32_t i = 0; i < region->count; i++) {
+		region_box_t box = region->boxes[i];
+		if (box.y1 >= b.y2) {
+			// Sorted by y, so no later box can intersect
+			return false;
+		}
+		if (box.x1 < b.x2 && box.x2 > b.x1 && box.y1 < b.y2 && box.y2 > b.y1) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Banded operations
+ * Both operands are swept from top to bottom, stopping at every y where either region has a band edge.
+ * Between two stops, each operand is either empty or covered by exactly one of its bands, so the output
+ * for that strip is a 1-dimensional operation on the two bands' spans.
+ */
+
+static bool _op_includes(region_op_t op, bool in_a, bool in_b) {
+	switch (op) {
+		case REGION_OP_UNION:
+			return in_a || in_b;
+		case REGION_OP_INTERSECT:
+			return in_a && in_b;
+		case REGION_OP_SUBTRACT:
+		default:
+			return in_a && !in_b;
+	}
+}
+
+// Returns the number of boxes in the band starting at idx
+static uint32_t _band_length(const region_t* region, uint32_t idx) {
+	uint32_t end = idx;
+	while (end < region->count && region->boxes[end].y1 == region->boxes[idx].y1) {
+		end += 1;
+	}
+	return end - idx;
+}
+
+// Advances band_idx past the bands that end at or above y, and finds the next band edge below y
+// Returns false if the region has no more edges
+static bool _next_band_edge(const region_t* region, uint32_t* band_idx, int32_t y, int32_t* out_edge) {
+	while (*band_idx < region->count && region->boxes[*band_idx].y2 <= y) {
+		*band_idx += _band_length(region, *band_idx);
+	}
+	if (*band_idx >= region->count) {
+		return false;
+	}
+	region_box_t band = region->boxes[*band_idx];
+	*out_edge = (band.y1 > y) ? band.y1 : band.y2;
+	return true;
+}
+
+static void _op_spans(
+	region_t* out,
+	region_op_t op,
+	const region_box_t* a, uint32_t a_count,
+	const region_box_t* b, uint32_t b_count,
+	int32_t y1, int32_t y2
+) {
+	int32_t x = INT32_MAX;
+	if (a_count) {
+		x = a[0].x1;
+	}
+	if (b_count) {
+		x = min(x, b[0].x1);
+	}
+
+	uint32_t i = 0;
+	uint32_t j = 0;
+	bool is_span_open = false;
+	int32_t span_start = 0;
+	while (true) {
+		while (i < a_count && a[i].x2 <= x) {
+			i += 1;
+		}
+		while (j < b_count && b[j].x2 <= x) {
+			j += 1;
+		}
+		bool in_a = i < a_count && a[i].x1 <= x;
+		bool in_b = j < b_count && b[j].x1 <= x;
+
+		if (_op_includes(op, in_a, in_b)) {
+			if (!is_span_open) {
+				is_span_open = true;
+				span_start = x;
+			}
+		}
+		else if (is_span_open) {
+			_region_append(out, span_start, y1, x, y2);
+			is_span_open = false;
+		}
+
+		int32_t next_x = INT32_MAX;
+		if (i < a_count) {
+			next_x = min(next_x, in_a ? a[i].x2 : a[i].x1);
+		}
+		if (j < b_count) {
+			next_x = min(next_x, in_b ? b[j].x2 : b[j].x1);
+		}
+		if (next_x == INT32_MAX) {
+			break;
+		}
+		x = next_x;
+	}
+}
+
+// Merges the band starting at band_start into the band above it, if the two are adjacent and have identical spans
+// Returns the start of the last band in the region
+static uint32_t _coalesce_band(region_t* region, uint32_t previous_band_start, uint32_t band_start) {
+	uint32_t previous_band_length = band_start - previous_band_start;
+	uint32_t band_length = region->count - band_start;
+	if (previous_band_length == 0 || previous_band_length != band_length) {
+		return band_start;
+	}
+	region_box_t* previous_band = &region->boxes[previous_band_start];
+	region_box_t* band = &region->boxes[band_start];
+	if (previous_band[0].y2 != band[0].y1) {
+		return band_start;
+	}
+	for (uint32_t i = 0; i < band_length; i++) {
+		if (previous_band[i].x1 != band[i].x1 || previous_band[i].x2 != band[i].x2) {
+			return band_start;
+		}
+	}
+	for (uint32_t i = 0; i < band_length; i++) {
+		previous_band[i].y2 = band[i].y2;
+	}
+	region->count = band_start;
+	return previous_band_start;
+}
+
+static void _region_op(region_t* dest, const region_t* a, const region_t* b, region_op_t op) {
+	// Operands may alias dest, in which case the result is built separately and swapped in at the end
+	bool dest_is_operand = dest == a || dest == b;
+	region_t out = {0};
+	if (!dest_is_operand) {
+		// Reuse the destination's storage
+		out = *dest;
+		out.count = 0;
+	}
+	_region_reserve(&out, a->count + b->count);
+
+	int32_t y = INT32_MAX;
+	if (a->count) {
+		y = a->boxes[0].y1;
+	}
+	if (b->count) {
+		y = min(y, b->boxes[0].y1);
+	}
+
+	uint32_t a_band = 0;
+	uint32_t b_band = 0;
+	uint32_t previous_band_start = 0;
+	while (true) {
+		int32_t a_edge = INT32_MAX;
+		int32_t b_edge = INT32_MAX;
+		bool a_has_edge = _next_band_edge(a, &a_band, y, &a_edge);
+		bool b_has_edge = _next_band_edge(b, &b_band, y, &b_edge);
+		if (!a_has_edge && !b_has_edge) {
+			break;
+		}
+		int32_t next_y = min(a_edge, b_edge);
+
+		// Which bands cover the strip between y and next_y?
+		const region_box_t* a_spans = NULL;
+		uint32_t a_span_count = 0;
+		if (a_has_edge && a->boxes[a_band].y1 <= y) {
+			a_spans = &a->boxes[a_band];
+			a_span_count = _band_length(a, a_band);
+		}
+		const region_box_t* b_spans = NULL;
+		uint32_t b_span_count = 0;
+		if (b_has_edge && b->boxes[b_band].y1 <= y) {
+			b_spans = &b->boxes[b_band];
+			b_span_count = _band_length(b, b_band);
+		}
+
+		uint32_t band_start = out.count;
+		_op_spans(&out, op, a_spans, a_span_count, b_spans, b_span_count, y, next_y);
+		if (out.count > band_start) {
+			previous_band_start = _coalesce_band(&out, previous_band_start, band_start);
+		}
+		y = next_y;
+	}
+
+	if (dest_is_operand) {
+		region_teardown(dest);
+	}
+	*dest = out;
+}
+
+void region_union(region_t* dest, const region_t* a, const region_t* b) {
+	_region_op(dest, a, b, REGION_OP_UNION);
+}
+
+void region_intersect(region_t* dest, const region_t* a, const region_t* b) {
+	_region_op(dest, a, b, REGION_OP_INTERSECT);
+}
+
+void region_subtract(region_t* dest, const region_t* a, const region_t* b) {
+	_region_op(dest, a, b, REGION_OP_SUBTRACT);
+}
+
+static void _region_op_rect(region_t* region, Rect r, region_op_t op) {
+	region_box_t box = _box_from_rect(r);
+	region_t operand = {
+		.boxes = &box,
+		.count = _box_is_empty(box) ? 0 : 1,
+		.capacity = 1,
+	};
+	_region_op(region, region, &operand, op);
+}
+
+void region_union_rect(region_t* region, Rect r) {
+	region_box_t box = _box_from_rect(r);
+	if (_box_is_empty(box)) {
+		return;
+	}
+	if (region_is_empty(region)) {
+		_region_append(region, box.x1, box.y1, box.x2, box.y2);
+		return;
+	}
+	_region_op_rect(region, r, REGION_OP_UNION);
+}
+
+void region_intersect_rect(region_t* region, Rect r) {
+	_region_op_rect(region, r, REGION_OP_INTERSECT);
+}
+
+void region_subtract_rect(region_t* region, Rect r) {
+	if (!region_intersects_rect(region, r)) {
+		return;
+	}
+	_region_op_rect(region, r, REGION_OP_SUBTRACT);
+}
+
+void region_translate(region_t* region, int32_t dx, int32_t dy) {
+	for (uint32_t i = 0; i < region->count; i++) {
+		region->boxes[i].x1 += dx;
+		region->boxes[i].x2 += dx;
+		region->boxes[i].y1 += dy;
+		region->boxes[i].y2 += dy;
+	}
+}
+
+uint32_t region_rect_count(const region_t* region) {
+	return region->count;
+}
+
+Rect region_rect_at(const region_t* region, uint32_t idx) {
+	return _rect_from_box(region->boxes[idx]);
+}
+
+uint32_t rect_subtract(Rect bg, Rect fg, Rect out[4]) {
+	region_box_t b = _box_from_rect(bg);
+	region_box_t f = _box_from_rect(fg);
+	if (_box_is_empty(b)) {
+		return 0;
+	}
+	if (_box_is_empty(f) || f.x1 >= b.x2 || f.x2 <= b.x1 || f.y1 >= b.y2 || f.y2 <= b.y1) {
+		out[0] = bg;
+		return 1;
+	}
+
+	uint32_t count = 0;
+	// Band above the foreground
+	if (f.y1 > b.y1) {
+		out[count++] = _rect_from_box((region_box_t){b.x1, b.y1, b.x2, f.y1});
+	}
+	// Left and right of the foreground, within its vertical extent
+	int32_t middle_y1 = max(b.y1, f.y1);
+	int32_t middle_y2 = min(b.y2, f.y2);
+	if (f.x1 > b.x1) {
+		out[count++] = _rect_from_box((region_box_t){b.x1, middle_y1, f.x1, middle_y2});
+	}
+	if (f.x2 < b.x2) {
+		out[count++] = _rect_from_box((region_box_t){f.x2, middle_y1, b.x2, middle_y2});
+	}
+	// Band below the foreground
+	if (f.y2 < b.y2) {
+		out[count++] = _rect_from_box((region_box_t){b.x1, f.y2, b.x2, b.y2});
+	}
+	return count;
+}
@@ -0,0 +1,62 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rect.h"
+
+// A set of pixels, stored as y-x banded boxes in the style of X11/pixman regions:
+// boxes are sorted by y and then by x. Boxes that share a band have the same vertical extent,
+// and boxes within a band never overlap or touch. Adjacent bands with identical spans are
+// coalesced, so every region has a single canonical representation.
+// The boxes live in one flat array, so operations never allocate per-rect.
+
+typedef struct region_box {
+	int32_t x1;
+	int32_t y1;
+	int32_t x2;
+	int32_t y2;
+} region_box_t;
+
+typedef struct region {
+	region_box_t* boxes;
+	uint32_t count;
+	uint32_t capacity;
+} region_t;
+
+void region_init(region_t* region);
+void region_init_rect(region_t* region, Rect r);
+void region_teardown(region_t* region);
+
+// Empties the region, but keeps its storage around for reuse
+void region_clear(region_t* region);
+void region_set_rect(region_t* region, Rect r);
+void region_copy(region_t* dest, const region_t* src);
+
+bool region_is_empty(const region_t* region);
+// The smallest rect that bounds the region
+Rect region_extents(const region_t* region);
+bool region_intersects_rect(const region_t* region, Rect r);
+
+// dest may be the same region as either of the operands
+void region_union(region_t* dest, const region_t* a, const region_t* b);
+void region_intersect(region_t* dest, const region_t* a, const region_t* b);
+void region_subtract(region_t* dest, const region_t* a, const region_t* b);
+
+void region_union_rect(region_t* region, Rect r);
+void region_intersect_rect(region_t* region, Rect r);
+void region_subtract_rect(region_t* region, Rect r);
+
+void region_translate(region_t* region, int32_t dx, int32_t dy);
+
+// Iterate a region with:
+// for (uint32_t i = 0; i < region_rect_count(&region); i++) { Rect r = region_rect_at(&region, i); }
+uint32_t region_rect_count(const region_t* region);
+Rect region_rect_at(const region_t* region, uint32_t idx);
+
+// Splits the area of bg that isn't covered by fg into at most 4 banded rects, without allocating
+// Returns the number of rects written to out
+uint32_t rect_subtract(Rect bg, Rect fg, Rect out[4]);
+
+#endif
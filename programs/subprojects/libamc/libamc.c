@@ -115,7 +115,41 @@ void amc_msg_u32_5__request_response_sync(
 	}
 }
 
+#define MAX_SHRINK_CALLBACKS 16
+
+typedef struct shrink_callback {
+    amc_memory_pressure_shrink_cb_t cb;
+    void* ctx;
+} shrink_callback_t;
+
+static shrink_callback_t _shrink_callbacks[MAX_SHRINK_CALLBACKS] = {0};
+static uint32_t _shrink_callback_count = 0;
+
+void amc_memory_pressure_register_shrink_callback(amc_memory_pressure_shrink_cb_t cb, void* ctx) {
+    assert(_shrink_callback_count < MAX_SHRINK_CALLBACKS, "Too many shrink callbacks");
+    _shrink_callbacks[_shrink_callback_count++] = (shrink_callback_t){.cb = cb, .ctx = ctx};
+    if (_shrink_callback_count == 1) {
+        amc_msg_u32_1__send(AXLE_CORE_SERVICE_NAME, AMC_MEMORY_PRESSURE_SUBSCRIBE);
+    }
+}
+
+static void _handle_memory_pressure_event(amc_memory_pressure_event_t* event) {
+    if (event->level == AMC_MEMORY_PRESSURE_NONE) {
+        return;
+    }
+    printf("Trimming caches under memory pressure level %d (%d of %d frames free)\n", event->level, (uint32_t)event->free_frames, (uint32_t)event->total_frames);
+    for (uint32_t i = 0; i < _shrink_callback_count; i++) {
+        _shrink_callbacks[i].cb(event->level, event->bytes_to_reclaim, _shrink_callbacks[i].ctx);
+    }
+}
+
 bool libamc_handle_message(amc_message_t* msg) {
+    if (!strncmp(msg->source, AXLE_CORE_SERVICE_NAME, AMC_MAX_SERVICE_NAME_LEN)) {
+        if (amc_msg_u32_get_word(msg, 0) == AMC_MEMORY_PRESSURE_EVENT) {
+            _handle_memory_pressure_event((amc_memory_pressure_event_t*)msg->body);
+            return true;
+        }
+    }
     if (!strncmp(msg->source, WATCHDOGD_SERVICE_NAME, AMC_MAX_SERVICE_NAME_LEN)) {
         if (amc_msg_u32_get_word(msg, 0) == WATCHDOGD_LIVELINESS_PING) {
             printf("libamc responding to liveliness check!\n");
@@ -140,3 +174,52 @@ void amc_alloc_physical_range(uintptr_t buffer_size, uintptr_t* out_phys_base, u
     *out_phys_base = phys_range_info->phys_base;
     *out_virt_base = phys_range_info->virt_base;
 }
+
+uint32_t amc_shmem_create(uint64_t size, uint64_t max_size, uintptr_t* out_local_base) {
+    amc_shmem_create_cmd_t req = {
+        .event = AMC_SHMEM_CREATE_REQUEST,
+        .size = size,
+        .max_size = max_size
+    };
+    amc_message_send(AXLE_CORE_SERVICE_NAME, &req, sizeof(req));
+    amc_message_t* out_resp;
+    amc_message_await__u32_event(AXLE_CORE_SERVICE_NAME, AMC_SHMEM_CREATE_RESPONSE, &out_resp);
+    amc_shmem_create_response_t* resp = (amc_shmem_create_response_t*)out_resp->body;
+    *out_local_base = resp->local_buffer_start;
+    return resp->handle;
+}
+
+bool amc_shmem_share(uint32_t handle, const char* remote_service, uintptr_t* out_remote_base) {
+    amc_shmem_share_cmd_t req = {
+        .event = AMC_SHMEM_SHARE_REQUEST,
+        .handle = handle
+    };
+    snprintf(req.remote_service_name, sizeof(req.remote_service_name), "%s", remote_service);
+    amc_message_send(AXLE_CORE_SERVICE_NAME, &req, sizeof(req));
+    amc_message_t* out_resp;
+    amc_message_await__u32_event(AXLE_CORE_SERVICE_NAME, AMC_SHMEM_SHARE_RESPONSE, &out_resp);
+    amc_shmem_share_response_t* resp = (amc_shmem_share_response_t*)out_resp->body;
+    *out_remote_base = resp->remote_buffer_start;
+    return resp->success;
+}
+
+bool amc_shmem_resize(uint32_t handle, uint64_t new_size) {
+    amc_shmem_resize_cmd_t req = {
+        .event = AMC_SHMEM_RESIZE_REQUEST,
+        .handle = handle,
+        .new_size = new_size
+    };
+    amc_message_send(AXLE_CORE_SERVICE_NAME, &req, sizeof(req));
+    amc_message_t* out_resp;
+    amc_message_await__u32_event(AXLE_CORE_SERVICE_NAME, AMC_SHMEM_RESIZE_RESPONSE, &out_resp);
+    amc_shmem_resize_response_t* resp = (amc_shmem_resize_response_t*)out_resp->body;
+    return resp->success;
+}
+
+void amc_shmem_unmap(uint32_t handle) {
+    amc_shmem_unmap_cmd_t req = {
+        .event = AMC_SHMEM_UNMAP,
+        .handle = handle
+    };
+    amc_message_send(AXLE_CORE_SERVICE_NAME, &req, sizeof(req));
+}
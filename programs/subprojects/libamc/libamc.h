@@ -52,7 +52,22 @@ void amc_msg_u32_5__request_response_sync(
 
 bool libamc_handle_message(amc_message_t* msg);
 
+// Invoked from libamc_handle_message() when the kernel reports memory pressure.
+// The callback should release cached memory proportional to the level, and may free more
+// than bytes_to_reclaim, which is a system-wide figure rather than a per-service quota.
+typedef void (*amc_memory_pressure_shrink_cb_t)(amc_memory_pressure_level_t level, uint64_t bytes_to_reclaim, void* ctx);
+
+// Registers a callback to trim a cache under memory pressure.
+// The first registration subscribes this service to the kernel's memory pressure events.
+void amc_memory_pressure_register_shrink_callback(amc_memory_pressure_shrink_cb_t cb, void* ctx);
+
 // Convenience helpers around messages to core
 void amc_alloc_physical_range(uintptr_t buffer_size, uintptr_t* out_phys_base, uintptr_t* out_virt_base);
 
+// Shared memory objects. Returns the object's handle, or 0 on failure.
+uint32_t amc_shmem_create(uint64_t size, uint64_t max_size, uintptr_t* out_local_base);
+bool amc_shmem_share(uint32_t handle, const char* remote_service, uintptr_t* out_remote_base);
+bool amc_shmem_resize(uint32_t handle, uint64_t new_size);
+void amc_shmem_unmap(uint32_t handle);
+
 #endif
\ No newline at end of file
@@ -84,6 +84,13 @@ gui_window_t* gui_window_create(char* window_title, uint32_t width, uint32_t hei
 
 	gui_window_t* window = calloc(1, sizeof(gui_window_t));
 	window->size = size_make(width, height);
+	window->_priv_framebuffers[0] = (uint8_t*)framebuffer_addr;
+	// awm2 doesn't provide a swap chain, and sends a shorter response
+	if (msg->len >= sizeof(awm_create_window_response_t) && resp->framebuffers[1] != NULL) {
+		window->_priv_framebuffers[1] = (uint8_t*)resp->framebuffers[1];
+		window->_priv_is_double_buffered = true;
+		window->_priv_back_framebuffer = 1;
+	}
 	window->layer = dummy_gui_layer;
 	window->views = array_create(32);
 	window->all_gui_elems = array_create(128);
@@ -142,6 +149,7 @@ static void gui_window_teardown(gui_window_t* window) {
 	assert(window->all_gui_elems->size == 0, "not zero all");
 	array_destroy(window->all_gui_elems);
 
+	free(window->_priv_last_frame);
 	free(window);
 
 	printf("** Frees done\n");
@@ -307,7 +315,7 @@ static void _handle_amc_messages(gui_application_t* app, bool should_block, bool
 		amc_message_t* msg;
 		amc_message_await_any(&msg);
 
-		// Allow libamc to handle watchdogd pings
+		// Allow libamc to handle watchdogd pings and memory pressure events
 		if (libamc_handle_message(msg)) {
 			continue;
 		}
@@ -323,7 +331,11 @@ static void _handle_amc_messages(gui_application_t* app, bool should_block, bool
 
 			// Handle awm messages that do require a window handle
 			if (window != NULL) {
-				if (event == AWM_KEY_DOWN) {
+				if (event == AWM_WINDOW_FRAMEBUFFER_RELEASED) {
+					window->_priv_awaiting_framebuffer_release = false;
+					continue;
+				}
+				else if (event == AWM_KEY_DOWN) {
 					uint32_t ch = amc_msg_u32_get_word(msg, 1);
 					_handle_key_down(window, ch);
 					continue;
@@ -447,7 +459,115 @@ static void _process_amc_messages(gui_application_t* app, bool should_block, boo
 	_handle_amc_messages(app, should_block, did_exit);
 }
 
+// Elements draw their whole frame on every pass, so damage is found by comparing each frame
+// against the previous one, in tiles. This keeps awm from copying and compositing the whole window
+// when only a cursor blinked.
+#define DAMAGE_TILE_SIZE 32
+
+static bool _tile_changed(gui_window_t* window, Rect tile) {
+	ca_layer* framebuffer = window->layer->fixed_layer.inner;
+	uint32_t bpp = _screen.bytes_per_pixel;
+	uint32_t framebuffer_stride = framebuffer->size.width * bpp;
+	uint32_t last_frame_stride = window->_priv_last_frame_size.width * bpp;
+	uint32_t tile_row_len = tile.size.width * bpp;
+
+	bool changed = false;
+	for (int32_t y = rect_min_y(tile); y < rect_max_y(tile); y++) {
+		uint8_t* current = framebuffer->raw + (y * framebuffer_stride) + (tile.origin.x * bpp);
+		uint8_t* last = window->_priv_last_frame + (y * last_frame_stride) + (tile.origin.x * bpp);
+		if (changed || memcmp(current, last, tile_row_len)) {
+			// Keep the copy in sync for the next comparison
+			memcpy(last, current, tile_row_len);
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+static void _add_damage_rect(awm_window_redraw_ready_msg_t* msg, Rect r, bool* overflowed) {
+	// Extend a rect from the tile row above if this one lines up with it
+	for (uint32_t i = 0; i < msg->damage_rect_count; i++) {
+		Rect* existing = &msg->damage_rects[i];
+		if (existing->origin.x == r.origin.x && existing->size.width == r.size.width && rect_max_y(*existing) == rect_min_y(r)) {
+			existing->size.height += r.size.height;
+			return;
+		}
+	}
+	if (msg->damage_rect_count == AWM_WINDOW_REDRAW_MAX_DAMAGE_RECTS) {
+		*overflowed = true;
+		return;
+	}
+	msg->damage_rects[msg->damage_rect_count++] = r;
+}
+
+static void _present_frame(gui_window_t* window, awm_window_redraw_ready_msg_t* msg) {
+	msg->presented_framebuffer = window->_priv_back_framebuffer;
+	amc_message_send(AWM_SERVICE_NAME, msg, sizeof(awm_window_redraw_ready_msg_t));
+	if (window->_priv_is_double_buffered) {
+		// The next frame is drawn to the framebuffer awm was compositing from until now
+		window->_priv_back_framebuffer = !window->_priv_back_framebuffer;
+		window->_priv_awaiting_framebuffer_release = true;
+	}
+}
+
+static void _send_damage_to_awm(gui_window_t* window) {
+	Size size = window->size;
+	uint32_t bpp = _screen.bytes_per_pixel;
+	awm_window_redraw_ready_msg_t msg = {.event = AWM_WINDOW_REDRAW_READY};
+
+	if (!window->_priv_last_frame || size.width != window->_priv_last_frame_size.width || size.height != window->_priv_last_frame_size.height) {
+		// No frame to compare against, so the whole window is damaged
+		free(window->_priv_last_frame);
+		window->_priv_last_frame = calloc(1, size.width * size.height * bpp);
+		window->_priv_last_frame_size = size;
+		Rect everything = rect_make(point_zero(), size);
+		_tile_changed(window, everything);
+		_present_frame(window, &msg);
+		return;
+	}
+
+	bool overflowed = false;
+	for (int32_t y = 0; y < size.height; y += DAMAGE_TILE_SIZE) {
+		int32_t tile_height = min(DAMAGE_TILE_SIZE, size.height - y);
+		// Consecutive changed tiles in a row are reported as one rect
+		int32_t span_start = -1;
+		for (int32_t x = 0; x < size.width; x += DAMAGE_TILE_SIZE) {
+			int32_t tile_width = min(DAMAGE_TILE_SIZE, size.width - x);
+			if (_tile_changed(window, rect_make(point_make(x, y), size_make(tile_width, tile_height)))) {
+				if (span_start < 0) {
+					span_start = x;
+				}
+			}
+			else if (span_start >= 0) {
+				_add_damage_rect(&msg, rect_make(point_make(span_start, y), size_make(x - span_start, tile_height)), &overflowed);
+				span_start = -1;
+			}
+		}
+		if (span_start >= 0) {
+			_add_damage_rect(&msg, rect_make(point_make(span_start, y), size_make(size.width - span_start, tile_height)), &overflowed);
+		}
+	}
+
+	if (!msg.damage_rect_count) {
+		// Nothing changed, so there's no need to bother awm
+		return;
+	}
+	if (overflowed) {
+		// Too fragmented to be worth describing, so redraw the whole window
+		msg.damage_rect_count = 0;
+	}
+	_present_frame(window, &msg);
+}
+
 static void _redraw_dirty_elems(gui_window_t* window) {
+	if (window->_priv_awaiting_framebuffer_release) {
+		// Don't draw over the framebuffer awm might still be compositing from
+		amc_message_t* msg;
+		amc_message_await__u32_event(AWM_SERVICE_NAME, AWM_WINDOW_FRAMEBUFFER_RELEASED, &msg);
+		window->_priv_awaiting_framebuffer_release = false;
+	}
+	window->layer->fixed_layer.inner->raw = window->_priv_framebuffers[window->_priv_back_framebuffer];
+
 	uintptr_t start = ms_since_boot();
 	for (uint32_t i = 0; i < window->all_gui_elems->size; i++) {
 		gui_elem_t* elem = array_lookup(window->all_gui_elems, i);
@@ -464,8 +584,7 @@ static void _redraw_dirty_elems(gui_window_t* window) {
 		//printf("[%d] libgui draw took %dms\n", getpid(), t);
 	}
 
-	// Ask awm to update the window
-	amc_msg_u32_1__send(AWM_SERVICE_NAME, AWM_WINDOW_REDRAW_READY);
+	_send_damage_to_awm(window);
 }
 
 typedef enum timers_state {
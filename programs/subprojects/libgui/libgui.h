@@ -6,6 +6,8 @@
 #include <kernel/amc.h>
 // For KEY_IDENT_UP_ARROW, etc
 #include <drivers/kb/kb_driver_messages.h>
+// For AWM_WINDOW_FRAMEBUFFER_COUNT
+#include <awm/awm_messages.h>
 
 #include "gui_elem.h"
 #include "gui_scrollbar.h"
@@ -31,6 +33,18 @@ typedef struct gui_window {
     // The GUI element the mouse is currently hovered over
     gui_elem_t* hover_elem;
     array_t* all_gui_elems;
+
+    // The swap chain shared with awm. Frames are drawn to the back framebuffer, then presented.
+    // Without a second framebuffer, frames are drawn straight to the one awm composites from.
+    uint8_t* _priv_framebuffers[AWM_WINDOW_FRAMEBUFFER_COUNT];
+    uint32_t _priv_back_framebuffer;
+    bool _priv_is_double_buffered;
+    // Set once a frame is presented, until awm releases the framebuffer that was replaced
+    bool _priv_awaiting_framebuffer_release;
+
+    // Copy of the last frame sent to awm, used to find the regions that changed in the next one
+    uint8_t* _priv_last_frame;
+    Size _priv_last_frame_size;
 } gui_window_t;
 
 typedef union gui_elem {
@@ -6,18 +6,63 @@
 
 #include <libgui/libgui.h>
 
+#include <kernel/log_ring.h>
+
+#define LOG_POLL_INTERVAL_MS 100
+#define LOG_READ_BATCH_SIZE 32
+
 static gui_text_view_t* _g_text_view = NULL;
+static log_ring_cursor_t _g_log_cursor = {0};
+static uint64_t _g_reported_drop_count = 0;
 
 static Rect _logs_text_view_sizer(gui_text_view_t* logs_text_view, Size window_size) {
 	return rect_make(point_zero(), window_size);
 }
 
-static void _amc_message_received(amc_message_t* msg) {
-	char buf[msg->len+1];
-	strncpy(buf, msg->body, msg->len);
-	buf[msg->len] = '\0';
-	gui_text_view_puts(_g_text_view, buf, color_white());
-	_g_text_view->content_layer->scroll_layer.scroll_offset.y = (_g_text_view->content_layer->scroll_layer.max_y - _g_text_view->content_layer_frame.size.height + _g_text_view->font_size.height);
+static Color _color_for_severity(log_severity_t severity) {
+	switch (severity) {
+		case LOG_SEVERITY_ERROR:
+			return color_red();
+		case LOG_SEVERITY_INFO:
+		default:
+			return color_white();
+	}
+}
+
+static void _poll_log_ring(void* ctx) {
+	log_entry_t entries[LOG_READ_BATCH_SIZE];
+	int entry_count = 0;
+	bool did_append = false;
+	do {
+		entry_count = log_ring_read(&_g_log_cursor, entries, LOG_READ_BATCH_SIZE);
+		if (_g_log_cursor.dropped_count != _g_reported_drop_count) {
+			char buf[64];
+			snprintf(buf, sizeof(buf), "[%d log entries dropped]\n", (int)(_g_log_cursor.dropped_count - _g_reported_drop_count));
+			gui_text_view_puts(_g_text_view, buf, color_orange());
+			_g_reported_drop_count = _g_log_cursor.dropped_count;
+		}
+
+		for (int i = 0; i < entry_count; i++) {
+			log_entry_t* entry = &entries[i];
+			Color color = _color_for_severity(entry->severity);
+			if (entry->flags & LOG_ENTRY_FLAG_LINE_START) {
+				char prefix[32];
+				snprintf(prefix, sizeof(prefix), "[%d ms] ", (int)entry->timestamp_ms);
+				gui_text_view_puts(_g_text_view, prefix, color_light_gray());
+			}
+			char buf[LOG_ENTRY_TEXT_SIZE + 1];
+			memcpy(buf, entry->text, entry->length);
+			buf[entry->length] = '\0';
+			gui_text_view_puts(_g_text_view, buf, color);
+			did_append = true;
+		}
+	// Keep reading while there's a backlog
+	} while (entry_count == LOG_READ_BATCH_SIZE);
+
+	if (did_append) {
+		_g_text_view->content_layer->scroll_layer.scroll_offset.y = (_g_text_view->content_layer->scroll_layer.max_y - _g_text_view->content_layer_frame.size.height + _g_text_view->font_size.height);
+	}
+	gui_timer_start(LOG_POLL_INTERVAL_MS, _poll_log_ring, NULL);
 }
 
 int main(int argc, char** argv) {
@@ -28,7 +73,8 @@ int main(int argc, char** argv) {
 		window,
 		(gui_window_resized_cb_t)_logs_text_view_sizer
 	);
-	gui_add_message_handler(_amc_message_received);
+	// Log output is read directly from the kernel's log ring
+	_poll_log_ring(NULL);
 	gui_enter_event_loop();
 
 	return 0;
@@ -0,0 +1,166 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <kernel/profiler.h>
+#include <libutils/libutils.h>
+
+// Samples every core for a while, then prints the collected stacks in the folded format
+// understood by flamegraph.pl. The output is written between markers so that it can be
+// pulled out of the serial log with scripts/extract_folded_stacks.py.
+
+#define PROFILE_DURATION_MS 10000
+#define SAMPLE_INTERVAL_MS 1
+// Each core buffers 512 samples, so drain well before they fill up
+#define DRAIN_INTERVAL_MS 100
+
+#define SYMBOL_CACHE_SIZE 4096
+#define SYMBOL_NAME_MAX 64
+#define STACK_TABLE_SIZE 4096
+#define FOLDED_STACK_MAX 1024
+
+typedef struct symbol_cache_entry {
+	bool in_use;
+	int32_t pid;
+	uint64_t addr;
+	char name[SYMBOL_NAME_MAX];
+} symbol_cache_entry_t;
+
+typedef struct stack_entry {
+	char* folded;
+	uint32_t hash;
+	uint32_t count;
+} stack_entry_t;
+
+static symbol_cache_entry_t _symbol_cache[SYMBOL_CACHE_SIZE] = {0};
+static stack_entry_t _stacks[STACK_TABLE_SIZE] = {0};
+static uint32_t _stack_count = 0;
+// Samples whose stack didn't fit in the table
+static uint32_t _overflow_count = 0;
+static uint64_t _sample_count = 0;
+static uint64_t _dropped_count = 0;
+
+static profiler_sample_t _sample_buf[512];
+
+static uint32_t _hash_bytes(const void* buf, uint32_t len, uint32_t hash) {
+	const uint8_t* bytes = buf;
+	for (uint32_t i = 0; i < len; i++) {
+		hash = (hash * 33) ^ bytes[i];
+	}
+	return hash;
+}
+
+static const char* _symbolize(int32_t pid, uint64_t addr) {
+	// Kernel symbols are the same in every process
+	int32_t key_pid = addr >= 0xFFFF800000000000 ? -1 : pid;
+	uint32_t hash = _hash_bytes(&addr, sizeof(addr), _hash_bytes(&key_pid, sizeof(key_pid), 5381));
+	symbol_cache_entry_t* entry = NULL;
+	for (uint32_t i = 0; i < SYMBOL_CACHE_SIZE; i++) {
+		entry = &_symbol_cache[(hash + i) % SYMBOL_CACHE_SIZE];
+		if (!entry->in_use || (entry->pid == key_pid && entry->addr == addr)) {
+			break;
+		}
+		entry = NULL;
+	}
+
+	static char uncached_name[SYMBOL_NAME_MAX];
+	char* name = entry ? entry->name : uncached_name;
+	if (entry && entry->in_use) {
+		return name;
+	}
+
+	if (profiler_symbolize(pid, addr, name, SYMBOL_NAME_MAX) < 0) {
+		snprintf(name, SYMBOL_NAME_MAX, "0x%lx", (unsigned long)addr);
+	}
+	if (entry) {
+		entry->in_use = true;
+		entry->pid = key_pid;
+		entry->addr = addr;
+	}
+	return name;
+}
+
+static void _record_folded_stack(const char* folded) {
+	uint32_t len = strlen(folded);
+	uint32_t hash = _hash_bytes(folded, len, 5381);
+	for (uint32_t i = 0; i < STACK_TABLE_SIZE; i++) {
+		stack_entry_t* entry = &_stacks[(hash + i) % STACK_TABLE_SIZE];
+		if (!entry->folded) {
+			entry->folded = strdup(folded);
+			entry->hash = hash;
+			entry->count = 1;
+			_stack_count += 1;
+			return;
+		}
+		if (entry->hash == hash && !strcmp(entry->folded, folded)) {
+			entry->count += 1;
+			return;
+		}
+	}
+	_overflow_count += 1;
+}
+
+static void _process_sample(profiler_sample_t* sample) {
+	char folded[FOLDED_STACK_MAX];
+	int off = snprintf(folded, sizeof(folded), "pid %d", sample->pid);
+
+	// Folded stacks go from the outermost frame to the innermost
+	for (int32_t i = sample->frame_count - 1; i >= 0; i--) {
+		uint64_t addr = sample->frames[i];
+		// Return addresses point just past the call, which may be in the next function
+		uint64_t lookup_addr = i == 0 ? addr : addr - 1;
+		const char* name = _symbolize(sample->pid, lookup_addr);
+		// flamegraph.pl colours frames with a _[k] suffix as kernel code
+		const char* suffix = addr >= 0xFFFF800000000000 ? "_[k]" : "";
+		int len = snprintf(folded + off, sizeof(folded) - off, ";%s%s", name, suffix);
+		if (len < 0 || off + len >= (int)sizeof(folded)) {
+			break;
+		}
+		off += len;
+	}
+
+	_record_folded_stack(folded);
+}
+
+static void _drain_samples(void) {
+	while (true) {
+		uint64_t dropped = 0;
+		int count = profiler_read_samples(_sample_buf, sizeof(_sample_buf) / sizeof(_sample_buf[0]), &dropped);
+		_dropped_count += dropped;
+		if (count <= 0) {
+			return;
+		}
+		for (int i = 0; i < count; i++) {
+			_process_sample(&_sample_buf[i]);
+		}
+		_sample_count += count;
+	}
+}
+
+int main(int argc, char** argv) {
+	printf("[Profiler] Sampling every core for %dms\n", PROFILE_DURATION_MS);
+	profiler_start(SAMPLE_INTERVAL_MS);
+	for (uint32_t elapsed = 0; elapsed < PROFILE_DURATION_MS; elapsed += DRAIN_INTERVAL_MS) {
+		usleep(DRAIN_INTERVAL_MS);
+		_drain_samples();
+	}
+	profiler_stop();
+	_drain_samples();
+
+	printf("[Profiler] %d samples, %d unique stacks, %d dropped samples, %d samples that didn't fit\n", (int)_sample_count, _stack_count, (int)_dropped_count, _overflow_count);
+	// Flush each line separately, so that every line of the output gets its own log prefix
+	printf("[Profiler] BEGIN FOLDED STACKS\n");
+	fflush(stdout);
+	for (uint32_t i = 0; i < STACK_TABLE_SIZE; i++) {
+		if (_stacks[i].folded) {
+			printf("%s %d\n", _stacks[i].folded, _stacks[i].count);
+			fflush(stdout);
+		}
+	}
+	printf("[Profiler] END FOLDED STACKS\n");
+	fflush(stdout);
+	return 0;
+}
@@ -8,6 +8,7 @@
 #include <math.h>
 
 #include <libgui/libgui.h>
+#include <kernel/adi.h>
 
 #define TASK_VIEWER_GET_TASK_INFO 777
 typedef struct task_viewer_get_task_info {
@@ -38,12 +39,15 @@ typedef struct task_viewer_get_task_info_response {
 } task_viewer_get_task_info_response_t;
 
 #define MAX_TASK_COUNT 64
+#define MAX_IRQ_COUNT 32
 
 typedef struct state {
 	gui_window_t* window;
 	gui_scroll_view_t* scroll_view;
 	int task_count;
 	task_info_t tasks[MAX_TASK_COUNT];
+	int irq_count;
+	adi_irq_stats_t irqs[MAX_IRQ_COUNT];
 } state_t;
 
 state_t _g_state = {0};
@@ -155,6 +159,122 @@ static Rect _draw_string(gui_view_t* view, char* text, Point origin, Size font_s
 	);
 }
 
+static void _format_latency_bucket(uint32_t bucket, char* buf, uint64_t buf_size) {
+	// Bucket i holds latencies below 2^i us
+	if (bucket == 0) {
+		snprintf(buf, buf_size, "<1us");
+		return;
+	}
+	uint64_t bound_us = 1LL << bucket;
+	if (bucket == ADI_LATENCY_BUCKET_COUNT - 1) {
+		snprintf(buf, buf_size, ">%dms", (int)((bound_us >> 1) / 1000));
+	}
+	else if (bound_us < 10000) {
+		snprintf(buf, buf_size, "<%dus", (int)bound_us);
+	}
+	else {
+		snprintf(buf, buf_size, "<%dms", (int)(bound_us / 1000));
+	}
+}
+
+static uint32_t _latency_percentile_bucket(uint64_t* histogram, uint64_t total, uint32_t percentile) {
+	uint64_t threshold = (total * percentile + 99) / 100;
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < ADI_LATENCY_BUCKET_COUNT; i++) {
+		seen += histogram[i];
+		if (seen >= threshold) {
+			return i;
+		}
+	}
+	return ADI_LATENCY_BUCKET_COUNT - 1;
+}
+
+static Point _draw_latency_histogram(gui_view_t* view, const char* title, uint64_t* histogram, Point cursor, Size font_size) {
+	uint64_t total = 0;
+	uint64_t max_count = 0;
+	for (uint32_t i = 0; i < ADI_LATENCY_BUCKET_COUNT; i++) {
+		total += histogram[i];
+		max_count = max(max_count, histogram[i]);
+	}
+
+	char buf[256];
+	if (!total) {
+		snprintf(buf, sizeof(buf), "  %s: no samples", title);
+	}
+	else {
+		char p50[16];
+		char p99[16];
+		char worst[16];
+		_format_latency_bucket(_latency_percentile_bucket(histogram, total, 50), p50, sizeof(p50));
+		_format_latency_bucket(_latency_percentile_bucket(histogram, total, 99), p99, sizeof(p99));
+		_format_latency_bucket(_latency_percentile_bucket(histogram, total, 100), worst, sizeof(worst));
+		snprintf(buf, sizeof(buf), "  %s: p50 %s, p99 %s, max %s", title, p50, p99, worst);
+	}
+	Rect string_end = _draw_string(view, buf, cursor, font_size, color_black(), color_white(), 0, 0);
+
+	// One bar per log2 bucket, to the right of the summary
+	if (total) {
+		int bar_width = 6;
+		int max_bar_height = string_end.size.height;
+		Point bar_origin = point_make(max(rect_max_x(string_end) + 8, 420), cursor.y);
+		for (uint32_t i = 0; i < ADI_LATENCY_BUCKET_COUNT; i++) {
+			int bar_height = histogram[i] ? max(1, (histogram[i] * max_bar_height) / max_count) : 0;
+			gui_layer_draw_rect(
+				view->content_layer,
+				rect_make(
+					point_make(bar_origin.x + (i * bar_width), bar_origin.y + max_bar_height - bar_height),
+					size_make(bar_width - 1, bar_height)
+				),
+				color_make(70, 130, 180),
+				THICKNESS_FILLED
+			);
+		}
+	}
+	return point_make(cursor.x, cursor.y + (font_size.height * 2));
+}
+
+static void _layout_irq_stats(void) {
+	for (int i = 0; i < _g_state.irq_count; i++) {
+		adi_irq_stats_t* irq = &_g_state.irqs[i];
+		view_with_info_t* view = calloc(1, sizeof(view_with_info_t));
+		// IRQs are shown above every task
+		view->idx = i;
+
+		gui_view_alloc_dynamic_fields((gui_view_t*)view);
+		gui_view_init((gui_view_t*)view, _g_state.window, (gui_window_resized_cb_t)_task_view_sizer);
+		gui_view_add_subview(&_g_state.scroll_view->base, view);
+		view->view.controls_content_layer = true;
+
+		gui_layer_draw_rect(
+			view->view.content_layer, 
+			rect_make(point_zero(), view->view.content_layer_frame.size),
+			color_make(235, 235, 245),
+			THICKNESS_FILLED
+		);
+
+		Size font_size = size_make(8, 12);
+		Point cursor = point_make(4, 4);
+		char buf[512];
+		snprintf(buf, sizeof(buf), "IRQ %02d %s", irq->irq, irq->driver_name[0] ? irq->driver_name : "(no driver)");
+		_draw_string(&view->view, buf, cursor, font_size, color_black(), color_white(), 0, 0);
+
+		cursor = point_make(4, cursor.y + (font_size.height * 2));
+		snprintf(
+			buf, 
+			sizeof(buf), 
+			"  Interrupts: %d, spurious: %d, dropped: %d", 
+			(int)irq->interrupt_count,
+			(int)irq->spurious_count,
+			(int)irq->dropped_count
+		);
+		_draw_string(&view->view, buf, cursor, font_size, color_black(), color_white(), 0, 0);
+
+		cursor = point_make(4, cursor.y + (font_size.height * 2));
+		cursor = _draw_latency_histogram(&view->view, "IRQ to driver", irq->dispatch_latency_histogram, cursor, font_size);
+		_draw_latency_histogram(&view->view, "Driver to EOI", irq->service_latency_histogram, cursor, font_size);
+	}
+}
+
 static void _layout_tasks() {
 	// Remove all subviews from the main scroll view
 	int view_count = _g_state.scroll_view->base.subviews->size;
@@ -167,6 +287,8 @@ static void _layout_tasks() {
 		//printf("View after remove: 0x%016lx\n", view);
 	}
 
+	_layout_irq_stats();
+
 	// Lay out new views
 	for (int i = 0; i < _g_state.task_count; i++) {
 		task_info_t* task = &_g_state.tasks[i];
@@ -175,7 +297,7 @@ static void _layout_tasks() {
 		// It's important that this is set before the sizer runs, which is kicked off by the libgui code below
 		// Otherwise, this will be shown in an incorrect index
 		// Also, order them bottom-to-top so new tasks show up first
-		view->idx = _g_state.task_count - i - 1;
+		view->idx = _g_state.irq_count + (_g_state.task_count - i - 1);
 		view->rip = task->rip;
 
 		gui_view_alloc_dynamic_fields((gui_view_t*)view);
@@ -283,6 +405,8 @@ static void _refresh_tasks(void) {
 		memcpy(&_g_state.tasks[i], task, sizeof(task_info_t));
 	}
 
+	_g_state.irq_count = adi_irq_stats_read(_g_state.irqs, MAX_IRQ_COUNT);
+
 	_layout_tasks();
 
 	// Schedule another refresh
@@ -66,6 +66,15 @@ pub fn local_apic_timer_cancel() {
     cpu_local_apic().timer_cancel()
 }
 
+#[no_mangle]
+pub fn local_apic_send_fixed_ipi(int_vector: u8, apic_id: usize) {
+    cpu_local_apic().write_interrupt_command(InterProcessorInterruptDescription::new(
+        int_vector,
+        InterProcessorInterruptDeliveryMode::Fixed,
+        InterProcessorInterruptDestination::OtherProcessor(apic_id),
+    ))
+}
+
 #[no_mangle]
 pub fn cpu_core_set_lapic_timer_ticks_per_ms(lapic_timer_ticks_per_ms: usize) {
     cpu_core_private_info().lapic_timer_ticks_per_ms = lapic_timer_ticks_per_ms;
@@ -146,6 +155,11 @@ impl ProcessorLocalApic {
 
     pub fn send_ipi(&self, ipi: InterProcessorInterruptDescription) {
         println!("Sending IPI {ipi:?}");
+        self.write_interrupt_command(ipi)
+    }
+
+    /// Sends an IPI without logging, for hot paths such as TLB shootdowns
+    pub fn write_interrupt_command(&self, ipi: InterProcessorInterruptDescription) {
         // Intel SDM §10.6.1
         // > The act of writing to the low doubleword of the ICR causes the IPI to be sent.
         // Therefore, we need to write the high word first so we know we're ready
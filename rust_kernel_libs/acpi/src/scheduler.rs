@@ -5,12 +5,12 @@ use alloc::collections::BTreeMap;
 use alloc::vec;
 use alloc::vec::Vec;
 use core::alloc::Layout;
-use core::cmp::min;
+use core::ffi::c_void;
 use core::mem::align_of;
 use ffi_bindings::{
     amc_core_populate_task_info_int, amc_service_of_task, cpu_id, getpid, println,
-    vas_get_active_state, vas_is_page_present, vas_load_state, TaskContext, TaskControlBlock,
-    TaskViewerGetTaskInfoResponse, TaskViewerTaskInfo, VasRange,
+    vas_copy_ranges, vas_get_active_state, vas_is_page_present, vas_load_state, TaskContext,
+    TaskControlBlock, TaskViewerGetTaskInfoResponse, TaskViewerTaskInfo,
 };
 use lazy_static::lazy_static;
 use spin::Mutex;
@@ -59,6 +59,22 @@ pub fn tasking_get_task_with_pid(pid: u32) -> *const TaskControlBlock {
         .map_or(core::ptr::null(), |&tcb| tcb)
 }
 
+/// Invokes the callback with the task with the provided PID, or NULL if there's no such task.
+/// The task list stays locked until the callback returns, so the task can't be destroyed in the meantime.
+#[no_mangle]
+pub unsafe fn tasking_with_task_with_pid(
+    pid: u32,
+    callback: unsafe extern "C" fn(*const TaskControlBlock, *mut c_void),
+    ctx: *mut c_void,
+) {
+    let all_tasks = ALL_TASKS.lock();
+    let task = all_tasks
+        .iter()
+        .find(|&&tcb| tcb.pid == pid)
+        .map_or(core::ptr::null(), |&tcb| tcb as *const TaskControlBlock);
+    callback(task, ctx);
+}
+
 #[no_mangle]
 pub unsafe fn tasking_populate_tasks_info() -> *mut TaskViewerGetTaskInfoResponse {
     let all_tasks = ALL_TASKS.lock();
@@ -96,20 +112,12 @@ pub unsafe fn tasking_populate_tasks_info() -> *mut TaskViewerGetTaskInfoRespons
             find_user_mode_rip((*task.machine_state).rbp)
         };
 
-        let vas_ranges_to_copy = min(16, (*task.vas_state).range_count) as usize;
-        tasks[i].vas_range_count = vas_ranges_to_copy as _;
-        let vas_ranges_slice = {
-            let vas_ranges_slice = core::ptr::slice_from_raw_parts(
-                core::ptr::addr_of!((*task.vas_state).ranges),
-                (*task.vas_state).range_count as usize,
-            );
-            let vas_ranges_slice: &[VasRange] = &*(vas_ranges_slice as *const [VasRange]);
-            vas_ranges_slice
-        };
-        for j in 0..vas_ranges_to_copy {
-            tasks[i].vas_ranges[j].start = vas_ranges_slice[j].start;
-            tasks[i].vas_ranges[j].size = vas_ranges_slice[j].size;
-        }
+        let vas_ranges_copied = vas_copy_ranges(
+            task.vas_state,
+            tasks[i].vas_ranges.as_mut_ptr(),
+            tasks[i].vas_ranges.len() as u32,
+        );
+        tasks[i].vas_range_count = vas_ranges_copied as _;
 
         // Copy AMC service info
         let amc_service_of_task = amc_service_of_task(task);
@@ -50,6 +50,8 @@ extern "C" {
     pub fn vas_get_active_state() -> *const VasState;
     pub fn vas_load_state(state: *const VasState);
     pub fn vas_is_page_present(state: *const VasState, page_addr: u64) -> bool;
+    pub fn vas_range_count(state: *const VasState) -> u32;
+    pub fn vas_copy_ranges(state: *const VasState, out: *mut VasRange, max_count: u32) -> u32;
 
     // boot_info.h
     pub fn boot_info_get() -> *const BootInfo;
@@ -253,6 +255,8 @@ pub struct CpuCorePrivateInfo {
     pub tss: usize,
     pub lapic_timer_ticks_per_ms: usize,
     pub idle_task: usize,
+    pub syscall_kernel_stack: usize,
+    pub syscall_user_rsp_scratch: usize,
 }
 
 /// Represents spinlock_t
@@ -362,12 +366,10 @@ pub struct TaskContext {
 }
 
 /// Represents vas_state_t
+/// The allocated ranges live in a tree that should only be accessed via vas_copy_ranges()
 #[repr(C)]
 pub struct VasState {
     pml4_phys: usize,
-    pub range_count: u32,
-    max_range_count: u32,
-    pub ranges: [VasRange; 0],
 }
 
 /// Represents physical_memory_region_type
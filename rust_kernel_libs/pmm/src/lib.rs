@@ -9,6 +9,7 @@
 
 extern crate ffi_bindings;
 
+use core::sync::atomic::{AtomicU16, AtomicUsize, Ordering};
 use heapless::spsc::Queue;
 use spin::Mutex;
 
@@ -18,7 +19,8 @@ use heapless::Vec;
 use std::vec::Vec;
 
 use ffi_bindings::{
-    boot_info_get, PhysicalMemoryRegionType, _panic, phys_addr_to_virt_ram_remap, PhysicalAddr,
+    boot_info_get, printf, PhysicalMemoryRegionType, _panic, phys_addr_to_virt_ram_remap,
+    PhysicalAddr,
 };
 
 // PT: Must match the definitions in kernel/ap_bootstrap.h
@@ -143,6 +145,24 @@ static mut CONTIGUOUS_CHUNK_POOL: ContiguousChunkPool = ContiguousChunkPool::new
 static mut FREE_FRAMES: Mutex<Queue<PhysicalAddr, MAX_FRAMES_ALLOCATOR_CAN_BOOKKEEP>> =
     Mutex::new(Queue::new());
 
+/// Number of address-space mappings referencing each general-purpose frame.
+/// A count of zero means the frame has never been handed out by pmm_alloc(), or that it's
+/// outside the PMM's bookkeeping (such as a memory-mapped device), and has no tracked owner.
+/// With 16GB tracked, this occupies 8MB.
+const UNREFERENCED_FRAME: AtomicU16 = AtomicU16::new(0);
+static FRAME_REFERENCE_COUNTS: [AtomicU16; MAX_FRAMES_ALLOCATOR_CAN_BOOKKEEP] =
+    [UNREFERENCED_FRAME; MAX_FRAMES_ALLOCATOR_CAN_BOOKKEEP];
+
+/// Number of general-purpose frames the PMM was given at boot
+static TOTAL_FRAME_COUNT: AtomicUsize = AtomicUsize::new(0);
+/// Number of frames in the free pool. Maintained alongside the queue so that it can be read
+/// without taking the free list lock, such as when sampling memory pressure.
+static FREE_FRAME_COUNT: AtomicUsize = AtomicUsize::new(0);
+
+fn frame_reference_count(frame_addr: usize) -> Option<&'static AtomicU16> {
+    FRAME_REFERENCE_COUNTS.get(frame_addr / PAGE_SIZE)
+}
+
 fn page_ceil(mut addr: usize) -> usize {
     ((addr) + PAGE_SIZE - 1) & !(PAGE_SIZE - 1)
 }
@@ -161,6 +181,7 @@ pub unsafe fn pmm_init() {
     // Mark usable sections of the address space
     // TODO(PT): Will there be any bug with PMM allocating the frame used for the init kernel stack?
     let mut free_frames_queue = FREE_FRAMES.lock();
+    let mut untracked_frame_count: usize = 0;
     for region in &boot_info.mem_regions[..boot_info.mem_region_count as usize] {
         if region.region_type != PhysicalMemoryRegionType::Usable {
             continue;
@@ -187,10 +208,28 @@ pub unsafe fn pmm_init() {
             if FRAMES_TO_HIDE_FROM_PMM.contains(&frame_addr) {
                 continue;
             }
+            // Frames we can't reference-count can't be safely shared, so don't hand them out
+            if frame_addr >= MAX_MEMORY_ALLOCATOR_CAN_BOOKKEEP {
+                untracked_frame_count += 1;
+                continue;
+            }
             // Keep track of the frame
             free_frames_queue.enqueue(PhysicalAddr(frame_addr));
         }
     }
+    TOTAL_FRAME_COUNT.store(free_frames_queue.len(), Ordering::SeqCst);
+    FREE_FRAME_COUNT.store(free_frames_queue.len(), Ordering::SeqCst);
+
+    // The bookkeeping tables are statically sized, so make it obvious when usable RAM is left idle
+    // printf doesn't allocate, unlike the formatting machinery behind println
+    if untracked_frame_count > 0 {
+        printf(
+            "[PMM] Ignoring %dMB of usable memory above the %dMB the PMM can track\n\0".as_ptr()
+                as *const u8,
+            (untracked_frame_count * PAGE_SIZE) / MEGABYTE,
+            MAX_MEMORY_ALLOCATOR_CAN_BOOKKEEP / MEGABYTE,
+        );
+    }
 }
 
 #[no_mangle]
@@ -206,6 +245,11 @@ pub unsafe fn pmm_alloc() -> usize {
         );
     }
     let allocated_frame = free_frames_queue.dequeue().unwrap();
+    FREE_FRAME_COUNT.fetch_sub(1, Ordering::SeqCst);
+    // The caller holds the only reference
+    frame_reference_count(allocated_frame.0)
+        .unwrap()
+        .store(1, Ordering::SeqCst);
 
     // Memset the frame to all zeroes, for convenience
     let frame_in_ram_remap = phys_addr_to_virt_ram_remap(allocated_frame);
@@ -219,10 +263,65 @@ pub unsafe fn pmm_alloc() -> usize {
     return allocated_frame.0;
 }
 
+/// Drops a reference to the frame, and returns it to the free pool once nobody references it.
 #[no_mangle]
 pub unsafe fn pmm_free(frame_addr: usize) {
+    if let Some(reference_count) = frame_reference_count(frame_addr) {
+        let previous_count = reference_count
+            .fetch_update(Ordering::SeqCst, Ordering::SeqCst, |count| {
+                Some(count.saturating_sub(1))
+            })
+            .unwrap();
+        if previous_count > 1 {
+            // Another address space still maps this frame
+            return;
+        }
+    }
     let mut free_frames_queue = FREE_FRAMES.lock();
     free_frames_queue.enqueue(PhysicalAddr(frame_addr)).unwrap();
+    FREE_FRAME_COUNT.fetch_add(1, Ordering::SeqCst);
+}
+
+/// Returns the number of frames that can currently be allocated with pmm_alloc()
+#[no_mangle]
+pub unsafe fn pmm_free_frame_count() -> usize {
+    FREE_FRAME_COUNT.load(Ordering::SeqCst)
+}
+
+/// Returns the number of general-purpose frames managed by the PMM
+#[no_mangle]
+pub unsafe fn pmm_total_frame_count() -> usize {
+    TOTAL_FRAME_COUNT.load(Ordering::SeqCst)
+}
+
+/// Records an additional mapping of the frame, such as a copy-on-write page shared by two
+/// address spaces. Each reference is dropped with pmm_free().
+#[no_mangle]
+pub unsafe fn pmm_frame_retain(frame_addr: usize) {
+    if let Some(reference_count) = frame_reference_count(frame_addr) {
+        // A frame with no tracked owner is implicitly referenced by whoever mapped it
+        let did_overflow = reference_count
+            .fetch_update(Ordering::SeqCst, Ordering::SeqCst, |count| {
+                core::cmp::max(count, 1).checked_add(1)
+            })
+            .is_err();
+        if did_overflow {
+            _panic(
+                "Frame reference count overflow\0".as_ptr() as *const u8,
+                "pmm/lib.rs\0".as_ptr() as *const u8,
+                0,
+            );
+        }
+    }
+}
+
+/// Returns the number of mappings referencing the frame. Untracked frames report a single owner.
+#[no_mangle]
+pub unsafe fn pmm_frame_reference_count(frame_addr: usize) -> u32 {
+    match frame_reference_count(frame_addr) {
+        Some(reference_count) => core::cmp::max(reference_count.load(Ordering::SeqCst), 1) as u32,
+        None => 1,
+    }
 }
 
 #[no_mangle]
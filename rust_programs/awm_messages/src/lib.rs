@@ -67,6 +67,11 @@ impl ExpectsEventField for AwmCreateWindowResponse {
 #[cfg(target_os = "axle")]
 pub struct AwmWindowRedrawReady {
     event: u32,
+    // Always the first framebuffer, as these clients don't use awm's swap chain
+    pub presented_framebuffer: u32,
+    // A count of zero means the whole window should be redrawn
+    pub rect_count: u32,
+    pub rects: [RectU32; 64],
 }
 
 #[cfg(target_os = "axle")]
@@ -74,6 +79,26 @@ impl AwmWindowRedrawReady {
     pub fn new() -> Self {
         AwmWindowRedrawReady {
             event: Self::EXPECTED_EVENT,
+            presented_framebuffer: 0,
+            rect_count: 0,
+            rects: [RectU32::zero(); 64],
+        }
+    }
+
+    pub fn with_damage(rects: &[Rect]) -> Self {
+        // Too many rects to describe individually, so redraw everything
+        if rects.len() > 64 {
+            return Self::new();
+        }
+        let mut dst_rects = [RectU32::zero(); 64];
+        for (dst, src) in dst_rects.iter_mut().zip(rects.iter()) {
+            *dst = RectU32::from(*src);
+        }
+        AwmWindowRedrawReady {
+            event: Self::EXPECTED_EVENT,
+            presented_framebuffer: 0,
+            rect_count: rects.len() as u32,
+            rects: dst_rects,
         }
     }
 }
@@ -167,7 +167,13 @@ impl AwmWindow {
     }
 
     pub fn commit(&self) {
-        amc_message_send(AwmWindow::AWM_SERVICE_NAME, AwmWindowRedrawReady::new());
+        // Report the areas that elements drew to since the last commit.
+        // If nothing was reported, fall back to redrawing the whole window.
+        let damages: Vec<Rect> = self.damaged_rects.borrow_mut().drain(..).collect();
+        amc_message_send(
+            AwmWindow::AWM_SERVICE_NAME,
+            AwmWindowRedrawReady::with_damage(&damages),
+        );
     }
 
     pub fn commit_partial(&self) {
@@ -281,7 +287,6 @@ impl AwmWindow {
 
         self.draw();
         self.commit();
-        self.commit_partial();
     }
 
     fn mouse_left_click_up(&self, event: &MouseLeftClickEnded) {
@@ -21,6 +21,9 @@ def copy_kernel_headers():
         (src_root / "kernel" / "util" / "amc" / "core_commands.h", include_dir / "kernel" / "core_commands.h"),
         (src_root / "kernel" / "util" / "adi" / "adi.h", include_dir / "kernel" / "adi.h"),
         (src_root / "kernel" / "interrupts" / "idt.h", include_dir / "kernel" / "idt.h"),
+        (src_root / "kernel" / "util" / "kernel_info" / "kernel_info.h", include_dir / "kernel" / "kernel_info.h"),
+        (src_root / "kernel" / "util" / "log_ring" / "log_ring.h", include_dir / "kernel" / "log_ring.h"),
+        (src_root / "kernel" / "util" / "profiler" / "profiler.h", include_dir / "kernel" / "profiler.h"),
         # Copy bootloader header to the sysroot
         (bootloader_root / "axle_boot_info.h", include_dir / "bootloader" / "axle_boot_info.h"),
     ]
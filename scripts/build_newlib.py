@@ -6,6 +6,7 @@ from pathlib import Path
 from typing import Tuple
 
 from build_utils import download_and_unpack_archive, run_and_check
+from build_kernel_headers import copy_kernel_headers
 
 
 def clone_tool_and_prepare_build_dir(build_dir: Path, url: str) -> Tuple[Path, Path]:
@@ -71,6 +72,9 @@ def build() -> None:
         # And autoreconf in the axle directory
         run_and_check(['autoreconf'], cwd=newlib_src_dir / "newlib" / "libc" / "sys" / "axle", env_additions=env)
 
+        # The axle syscall stubs include kernel headers, such as <kernel/kernel_info.h>, from the sysroot
+        copy_kernel_headers()
+
         newlib_configure_path = newlib_src_dir / "configure"
         run_and_check(
             [newlib_configure_path.as_posix(), "--prefix=/usr", f"--target={arch}-elf-axle"],
@@ -145,6 +145,7 @@ def main():
         kernel_root / "kernel" / "segmentation" / "gdt_activate.s",
         kernel_root / "kernel" / "interrupts" / "idt_activate.s",
         kernel_root / "kernel" / "interrupts" / "int_handler_stubs.s",
+        kernel_root / "kernel" / "syscall" / "syscall_entry.s",
         kernel_root / "kernel" / "pmm" / "pmm_int.h",
         kernel_root / "kernel" / "vmm" / "vmm.h",
         kernel_root / "kernel" / "vmm" / "vmm.c",
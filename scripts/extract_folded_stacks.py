@@ -0,0 +1,38 @@
+#!/usr/local/bin/python3
+"""Pulls the folded stacks printed by the profiler program out of a serial log,
+so they can be rendered with flamegraph.pl:
+    python3 scripts/extract_folded_stacks.py syslog.log > profile.folded
+    flamegraph.pl profile.folded > profile.svg
+"""
+import re
+import sys
+from pathlib import Path
+
+# Serial output prefix, followed by the writing process's PID
+_LINE_PREFIX = re.compile(r"^(Cpu\[\d+\],Pid\[-?\d+\],Clk\[\d+\]: )?(\[\d+\] )?")
+
+
+def extract_folded_stacks(log_path: Path) -> list[str]:
+    stacks = []
+    in_stacks = False
+    for line in log_path.read_text(errors="replace").splitlines():
+        line = _LINE_PREFIX.sub("", line.strip())
+        if line == "[Profiler] BEGIN FOLDED STACKS":
+            # Only keep the most recent profile
+            stacks = []
+            in_stacks = True
+        elif line == "[Profiler] END FOLDED STACKS":
+            in_stacks = False
+        elif in_stacks and line:
+            stacks.append(line)
+    return stacks
+
+
+def main():
+    log_path = Path(sys.argv[1]) if len(sys.argv) > 1 else Path("syslog.log")
+    for stack in extract_folded_stacks(log_path):
+        print(stack)
+
+
+if __name__ == "__main__":
+    main()